@@ -68,10 +68,15 @@ SOURCES += \
     src/cpp/multimap/internal/Base64Test.cpp \
     src/cpp/multimap/internal/ListTest.cpp \
     src/cpp/multimap/internal/DescriptorTest.cpp \
+    src/cpp/multimap/internal/EliasFanoTest.cpp \
+    src/cpp/multimap/internal/HugePagesTest.cpp \
+    src/cpp/multimap/internal/KeyIndexTest.cpp \
     src/cpp/multimap/internal/MphTableTest.cpp \
     src/cpp/multimap/internal/MphTest.cpp \
+    src/cpp/multimap/internal/NumaTest.cpp \
     src/cpp/multimap/internal/PartitionTest.cpp \
     src/cpp/multimap/internal/StoreTest.cpp \
+    src/cpp/multimap/internal/TaskQueueTest.cpp \
     src/cpp/multimap/internal/UintVectorTest.cpp \
     src/cpp/multimap/thirdparty/googlemock/src/gmock_main.cc \
     src/cpp/multimap/thirdparty/googlemock/src/gmock-cardinalities.cc \
@@ -87,9 +92,12 @@ SOURCES += \
     src/cpp/multimap/thirdparty/googletest/src/gtest-typed-test.cc \
     src/cpp/multimap/thirdparty/googletest/src/gtest.cc \
     src/cpp/multimap/ArenaTest.cpp \
+    src/cpp/multimap/ImmutableMapTest.cpp \
     src/cpp/multimap/MapTest.cpp \
     src/cpp/multimap/SliceTest.cpp \
-    src/cpp/multimap/VersionTest.cpp
+    src/cpp/multimap/ThreadPoolTest.cpp \
+    src/cpp/multimap/VersionTest.cpp \
+    src/cpp/multimap/WriteBatchTest.cpp
 
 CONFIG(debug, debug|release) {
     TARGET = multimap-tests-dbg
@@ -5,6 +5,10 @@ VERSION = 0.6.0
 
 QMAKE_LFLAGS += -rdynamic # for GNU backtrace
 
+# Replaces all locks that protect the data of a map with no-op locks, which
+# speeds up bulk imports that use the library from a single thread only.
+#DEFINES += MULTIMAP_SINGLE_THREADED
+
 INCLUDEPATH += \
     src/cpp \
     src/cpp/multimap/thirdparty
@@ -12,12 +16,18 @@ INCLUDEPATH += \
 HEADERS += \
     src/cpp/multimap/internal/Base64.h \
     src/cpp/multimap/internal/Descriptor.h \
+    src/cpp/multimap/internal/EliasFano.h \
+    src/cpp/multimap/internal/HugePages.h \
+    src/cpp/multimap/internal/KeyIndex.h \
     src/cpp/multimap/internal/List.h \
+    src/cpp/multimap/internal/LockPolicy.h \
     src/cpp/multimap/internal/Locks.h \
     src/cpp/multimap/internal/Mph.h \
     src/cpp/multimap/internal/MphTable.h \
+    src/cpp/multimap/internal/Numa.h \
     src/cpp/multimap/internal/Partition.h \
     src/cpp/multimap/internal/SharedMutex.h \
+    src/cpp/multimap/internal/TaskQueue.h \
     src/cpp/multimap/internal/Store.h \
     src/cpp/multimap/internal/TsvFileReader.h \
     src/cpp/multimap/internal/TsvFileWriter.h \
@@ -71,23 +81,31 @@ HEADERS += \
     src/cpp/multimap/Arena.h \
     src/cpp/multimap/Bytes.h \
     src/cpp/multimap/callables.h \
+    src/cpp/multimap/Cursor.h \
     src/cpp/multimap/ImmutableMap.h \
     src/cpp/multimap/Iterator.h \
     src/cpp/multimap/Map.h \
     src/cpp/multimap/Options.h \
     src/cpp/multimap/Slice.h \
     src/cpp/multimap/Stats.h \
-    src/cpp/multimap/Version.h
+    src/cpp/multimap/ThreadPool.h \
+    src/cpp/multimap/Version.h \
+    src/cpp/multimap/WriteBatch.h
 
 SOURCES += \
     src/cpp/multimap/internal/Base64.cpp \
     src/cpp/multimap/internal/Descriptor.cpp \
+    src/cpp/multimap/internal/EliasFano.cpp \
+    src/cpp/multimap/internal/HugePages.cpp \
+    src/cpp/multimap/internal/KeyIndex.cpp \
     src/cpp/multimap/internal/List.cpp \
     src/cpp/multimap/internal/Mph.cpp \
     src/cpp/multimap/internal/MphTable.cpp \
+    src/cpp/multimap/internal/Numa.cpp \
     src/cpp/multimap/internal/Partition.cpp \
     src/cpp/multimap/internal/SharedMutex.cpp \
     src/cpp/multimap/internal/Store.cpp \
+    src/cpp/multimap/internal/TaskQueue.cpp \
     src/cpp/multimap/internal/TsvFileReader.cpp \
     src/cpp/multimap/internal/TsvFileWriter.cpp \
     src/cpp/multimap/internal/UintVector.cpp \
@@ -124,12 +142,15 @@ SOURCES += \
     src/cpp/multimap/thirdparty/xxhash/xxhash.c \
     src/cpp/multimap/Arena.cpp \
     src/cpp/multimap/Bytes.cpp \
+    src/cpp/multimap/Cursor.cpp \
     src/cpp/multimap/ImmutableMap.cpp \
     src/cpp/multimap/Iterator.cpp \
     src/cpp/multimap/Map.cpp \
     src/cpp/multimap/Slice.cpp \
     src/cpp/multimap/Stats.cpp \
-    src/cpp/multimap/Version.cpp
+    src/cpp/multimap/ThreadPool.cpp \
+    src/cpp/multimap/Version.cpp \
+    src/cpp/multimap/WriteBatch.cpp
 
 OTHER_FILES += \
     install-dependencies-debian.sh \
@@ -17,54 +17,221 @@
 
 #include "multimap/Arena.h"
 
+#include <sys/mman.h>
+#include <cstdlib>
+#include <mutex>  // NOLINT
+#include <new>
+#include <vector>
+#include "multimap/internal/HugePages.h"
+#include "multimap/internal/Numa.h"
 #include "multimap/thirdparty/mt/assert.h"
+#include "multimap/thirdparty/mt/memory.h"
 
 namespace multimap {
 
-Arena::Arena(size_t block_size)
-    : mutex_(new std::mutex()), block_size_(block_size) {
+namespace {
+
+class ThreadIndex {
+  // Assigns to each thread an index that is unique among all running threads.
+  // Indexes of exited threads are reused, so that they remain small.
+
+ public:
+  ThreadIndex() {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (registry.free_indexes.empty()) {
+      value_ = registry.num_indexes++;
+    } else {
+      value_ = registry.free_indexes.back();
+      registry.free_indexes.pop_back();
+    }
+  }
+
+  ~ThreadIndex() {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.free_indexes.push_back(value_);
+  }
+
+  size_t value() const { return value_; }
+
+ private:
+  struct Registry {
+    std::mutex mutex;
+    std::vector<size_t> free_indexes;
+    size_t num_indexes = 0;
+  };
+
+  static Registry& getRegistry() {
+    static Registry registry;
+    return registry;
+  }
+
+  size_t value_ = 0;
+};
+
+thread_local ThreadIndex thread_index;
+
+// Smaller remainders of split chunks are not kept in the free lists.
+const size_t MIN_FREE_CHUNK_SIZE = 8;
+
+}  // namespace
+
+const size_t Arena::MAX_LOCAL_BLOCK_SIZE;
+
+Arena::Arena(size_t block_size) : Arena(block_size, -1) {}
+
+Arena::Arena(size_t block_size, int numa_node)
+    : Arena(block_size, numa_node, false) {}
+
+Arena::Arena(size_t block_size, int numa_node, bool huge_pages)
+    : shared_(new Shared()),
+      block_size_(block_size),
+      local_block_size_(mt::min(block_size, MAX_LOCAL_BLOCK_SIZE)),
+      numa_node_(numa_node),
+      huge_pages_(huge_pages) {
   MT_REQUIRE_TRUE(mt::isPowerOfTwo(block_size_));
   MT_REQUIRE_NOT_ZERO(block_size_);
 }
 
 byte* Arena::allocate(size_t nbytes) {
   MT_REQUIRE_NOT_ZERO(nbytes);  // TODO(mtrenkmann): Should we allow zero size?
-  std::lock_guard<std::mutex> lock(*mutex_);
 
-  byte* result;
-  if (nbytes <= block_size_) {
-    if (blocks_.empty()) {
-      blocks_.emplace_back(new byte[block_size_]);
-      block_offset_ = 0;
+  // Remainders of split chunks may be too small for any further request, so
+  // that checking for free chunks at all would take the lock every time.
+  if (nbytes <= shared_->max_free_size.load(std::memory_order_relaxed)) {
+    std::lock_guard<internal::Mutex> lock(shared_->mutex);
+    const auto free_list = free_lists_.lower_bound(nbytes);
+    if (free_list != free_lists_.end()) {
+      const size_t chunk_size = free_list->first;
+      byte* result = free_list->second.back();
+      free_list->second.pop_back();
+      if (free_list->second.empty()) {
+        free_lists_.erase(free_list);
+      }
+      if (chunk_size - nbytes >= MIN_FREE_CHUNK_SIZE) {
+        free_lists_[chunk_size - nbytes].push_back(result + nbytes);
+      }
+      updateMaxFreeSizeUnlocked();
+      shared_->allocated += nbytes;
+      return result;
     }
-    const auto num_bytes_free = block_size_ - block_offset_;
-    if (nbytes > num_bytes_free) {
-      blocks_.emplace_back(new byte[block_size_]);
-      block_offset_ = 0;
+  }
+
+  const size_t index = thread_index.value();
+  if (nbytes <= local_block_size_ && index < MAX_LOCAL_BLOCKS) {
+    // The block is owned by the calling thread, so that no locking is needed
+    // unless the block is exhausted. The rest of an exhausted block is lost.
+    LocalBlock& block = shared_->local_blocks[index];
+    if (nbytes > block.remaining) {
+      std::lock_guard<internal::Mutex> lock(shared_->mutex);
+      block.pos = allocateFromBlockUnlocked(local_block_size_);
+      block.remaining = local_block_size_;
+      if (index >= shared_->num_local_blocks) {
+        shared_->num_local_blocks = index + 1;
+      }
     }
-    result = blocks_.back().get() + block_offset_;
-    block_offset_ += nbytes;
+    byte* result = block.pos;
+    block.pos += nbytes;
+    block.remaining -= nbytes;
+    block.allocated.store(
+        block.allocated.load(std::memory_order_relaxed) + nbytes,
+        std::memory_order_relaxed);
+    return result;
+  }
 
-  } else {
-    blobs_.emplace_back(new byte[nbytes]);
-    result = blobs_.back().get();
+  std::lock_guard<internal::Mutex> lock(shared_->mutex);
+  shared_->allocated += nbytes;
+  if (nbytes <= block_size_) {
+    return allocateFromBlockUnlocked(nbytes);
   }
+  blobs_.push_back(newChunk(nbytes));
+  return blobs_.back().get();
+}
 
-  allocated_ += nbytes;
-  return result;
+void Arena::deallocate(byte* data, size_t nbytes) {
+  MT_REQUIRE_NOT_NULL(data);
+  MT_REQUIRE_NOT_ZERO(nbytes);
+  std::lock_guard<internal::Mutex> lock(shared_->mutex);
+  free_lists_[nbytes].push_back(data);
+  updateMaxFreeSizeUnlocked();
+  shared_->allocated -= nbytes;
 }
 
 size_t Arena::allocated() const {
-  std::lock_guard<std::mutex> lock(*mutex_);
-  return allocated_;
+  size_t allocated = shared_->allocated;
+  const size_t num_local_blocks = shared_->num_local_blocks;
+  for (size_t i = 0; i != num_local_blocks; ++i) {
+    allocated += shared_->local_blocks[i].allocated.load(
+        std::memory_order_relaxed);
+  }
+  return allocated;
 }
 
 void Arena::deallocateAll() {
-  std::lock_guard<std::mutex> lock(*mutex_);
+  std::lock_guard<internal::Mutex> lock(shared_->mutex);
   blocks_.clear();
   blobs_.clear();
+  free_lists_.clear();
+  for (LocalBlock& block : shared_->local_blocks) {
+    block.pos = nullptr;
+    block.remaining = 0;
+    block.allocated = 0;
+  }
   block_offset_ = 0;
-  allocated_ = 0;
+  shared_->max_free_size = 0;
+  shared_->allocated = 0;
+  shared_->num_local_blocks = 0;
+}
+
+void* Arena::Shared::operator new(size_t size) {
+  void* data = nullptr;
+  if (::posix_memalign(&data, alignof(Shared), size) != 0) {
+    throw std::bad_alloc();
+  }
+  return data;
+}
+
+void Arena::Shared::operator delete(void* data) { std::free(data); }
+
+void Arena::ChunkDeleter::operator()(byte* data) const {
+  if (mapped_size == 0) {
+    delete[] data;
+  } else {
+    ::munmap(data, mapped_size);
+  }
+}
+
+void Arena::updateMaxFreeSizeUnlocked() {
+  shared_->max_free_size.store(
+      free_lists_.empty() ? 0 : free_lists_.rbegin()->first,
+      std::memory_order_relaxed);
+}
+
+byte* Arena::allocateFromBlockUnlocked(size_t nbytes) {
+  if (blocks_.empty() || nbytes > block_size_ - block_offset_) {
+    blocks_.push_back(newChunk(block_size_));
+    block_offset_ = 0;
+  }
+  byte* result = blocks_.back().get() + block_offset_;
+  block_offset_ += nbytes;
+  return result;
+}
+
+Arena::Chunk Arena::newChunk(size_t nbytes) const {
+  if (numa_node_ < 0 && !huge_pages_) {
+    return Chunk(new byte[nbytes]);
+  }
+  auto memory = huge_pages_
+                    ? internal::HugePages::allocate(nbytes)
+                    : mt::mmap(nbytes, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (numa_node_ >= 0) {
+    internal::Numa::bind(memory.data(), memory.size(), numa_node_);
+  }
+  ChunkDeleter deleter;
+  deleter.mapped_size = memory.size();
+  return Chunk(memory.release().first, deleter);
 }
 
 }  // namespace multimap
@@ -22,9 +22,11 @@
 #ifndef MULTIMAP_ARENA_H_
 #define MULTIMAP_ARENA_H_
 
+#include <atomic>
+#include <map>
 #include <memory>
-#include <mutex>  // NOLINT
 #include <vector>
+#include "multimap/internal/LockPolicy.h"
 #include "multimap/thirdparty/mt/common.h"
 #include "multimap/Bytes.h"
 
@@ -36,19 +38,88 @@ class Arena {
 
   explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE);
 
+  Arena(size_t block_size, int numa_node);
+  // If `numa_node` is not negative, the memory is mapped separately and bound
+  // to the given NUMA node, otherwise it is allocated from the heap.
+
+  Arena(size_t block_size, int numa_node, bool huge_pages);
+  // If `huge_pages` is true, the memory is mapped separately, aligned to huge
+  // page boundaries, and backed by transparent huge pages if available. The
+  // block size should then be a multiple of the huge page size.
+
   byte* allocate(size_t nbytes);
+  // Each thread bump-allocates from its own local block without locking,
+  // except when it needs a new local block, which is carved out of the
+  // arena's current block. Requests larger than a local block and requests
+  // that fit into the largest free chunk take the arena's lock.
+
+  void deallocate(byte* data, size_t nbytes);
+  // Gives memory obtained via `allocate(nbytes)` back to the arena. The memory
+  // is not returned to the operating system, but kept in a free list in order
+  // to serve subsequent requests. A request is served from the smallest free
+  // chunk that is large enough, whose remainder is kept as a chunk of its own.
 
   size_t allocated() const;
+  // Sums up the counters of the threads that have allocated so far.
 
   void deallocateAll();
+  // Must not be called concurrently with allocate().
+
+  static const size_t MAX_LOCAL_BLOCKS = 64;
+  // The number of threads that can own a block of an arena at the same time.
+  // Any further threads allocate from a block that is shared under the lock.
+
+  static const size_t MAX_LOCAL_BLOCK_SIZE = mt::KiB(64);
+  // Limits the memory a thread reserves in each arena, independently of the
+  // block size, which is large if the arena is backed by huge pages.
 
  private:
-  std::unique_ptr<std::mutex> mutex_;
-  std::vector<std::unique_ptr<byte[]> > blocks_;
-  std::vector<std::unique_ptr<byte[]> > blobs_;
+  struct ChunkDeleter {
+    size_t mapped_size = 0;  // Zero if allocated from the heap.
+    void operator()(byte* data) const;
+  };
+
+  typedef std::unique_ptr<byte[], ChunkDeleter> Chunk;
+
+  struct alignas(64) LocalBlock {
+    // Occupies a cache line of its own, so that threads do not contend.
+    byte* pos = nullptr;
+    size_t remaining = 0;
+    std::atomic<size_t> allocated{0};  // Only written by the owning thread.
+  };
+
+  struct Shared {
+    // Lives on the heap, so that arenas remain movable. Allocated with cache
+    // line alignment, which plain new does not guarantee before C++17.
+    static void* operator new(size_t size);
+    static void operator delete(void* data);
+
+    LocalBlock local_blocks[MAX_LOCAL_BLOCKS];  // Indexed by thread.
+    internal::Mutex mutex;
+    std::atomic<size_t> allocated{0};
+    std::atomic<size_t> max_free_size{0};  // Zero if there are no free chunks.
+    std::atomic<size_t> num_local_blocks{0};
+    // `allocated` counts the bytes allocated and deallocated under the lock.
+    // It may wrap around, since memory allocated from a local block can be
+    // deallocated under the lock. `num_local_blocks` is one more than the
+    // highest index of a local block in use.
+  };
+
+  Chunk newChunk(size_t nbytes) const;
+
+  byte* allocateFromBlockUnlocked(size_t nbytes);
+
+  void updateMaxFreeSizeUnlocked();
+
+  std::unique_ptr<Shared> shared_;
+  std::vector<Chunk> blocks_;
+  std::vector<Chunk> blobs_;
+  std::map<size_t, std::vector<byte*> > free_lists_;  // Keyed by size.
   size_t block_offset_ = 0;
   size_t block_size_ = 0;
-  size_t allocated_ = 0;
+  size_t local_block_size_ = 0;
+  int numa_node_ = -1;
+  bool huge_pages_ = false;
 };
 
 }  // namespace multimap
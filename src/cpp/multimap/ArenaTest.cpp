@@ -15,8 +15,17 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 #include <type_traits>
+#include <vector>
 #include "gmock/gmock.h"
+#include "multimap/internal/HugePages.h"
+#include "multimap/internal/Numa.h"
 #include "multimap/thirdparty/mt/assert.h"
 #include "multimap/Arena.h"
 
@@ -55,4 +64,201 @@ TEST(ArenaTest, DefaultConstructedCanAllocateMemory) {
   ASSERT_EQ(arena.allocated(), 5131);
 }
 
+TEST(ArenaTest, DeallocatedMemoryIsReusedForSameSize) {
+  Arena arena;
+  byte* data = arena.allocate(32);
+  ASSERT_EQ(arena.allocated(), 32);
+  arena.deallocate(data, 32);
+  ASSERT_EQ(arena.allocated(), 0);
+  ASSERT_EQ(arena.allocate(32), data);
+  ASSERT_EQ(arena.allocated(), 32);
+}
+
+TEST(ArenaTest, DeallocatedMemoryIsSplitForSmallerSizes) {
+  Arena arena;
+  byte* large = arena.allocate(64);
+  byte* small = arena.allocate(24);
+  arena.deallocate(large, 64);
+  arena.deallocate(small, 24);
+  ASSERT_EQ(arena.allocated(), 0);
+  ASSERT_EQ(arena.allocate(20), small);  // Smallest chunk that fits.
+  ASSERT_EQ(arena.allocate(16), large);
+  ASSERT_EQ(arena.allocate(48), large + 16);
+  ASSERT_EQ(arena.allocated(), 84);
+}
+
+TEST(ArenaTest, RequestsLargerThanAnyFreeChunkAreServedFromBlocks) {
+  Arena arena;
+  byte* chunk = arena.allocate(24);
+  arena.deallocate(chunk, 24);
+  byte* large = arena.allocate(32);
+  ASSERT_NE(large, chunk);
+  ASSERT_EQ(arena.allocate(16), chunk);
+  ASSERT_EQ(arena.allocate(8), chunk + 16);
+  ASSERT_NE(arena.allocate(8), chunk + 24);  // No free chunks left.
+  ASSERT_EQ(arena.allocated(), 64);
+}
+
+TEST(ArenaTest, DeallocateThrowsIfArgumentsAreInvalid) {
+  Arena arena;
+  ASSERT_THROW(arena.deallocate(nullptr, 1), mt::AssertionError);
+  ASSERT_THROW(arena.deallocate(arena.allocate(1), 0), mt::AssertionError);
+}
+
+TEST(ArenaTest, ArenaBoundToNumaNodeCanAllocateMemory) {
+  Arena arena(Arena::DEFAULT_BLOCK_SIZE, 0);
+  byte* small = arena.allocate(16);
+  small[15] = 1;
+  byte* large = arena.allocate(Arena::DEFAULT_BLOCK_SIZE + 1);
+  large[Arena::DEFAULT_BLOCK_SIZE] = 1;
+  ASSERT_EQ(arena.allocated(), Arena::DEFAULT_BLOCK_SIZE + 17);
+  arena.deallocateAll();
+  ASSERT_EQ(arena.allocated(), 0);
+}
+
+TEST(ArenaTest, ArenaBackedByHugePagesCanAllocateMemory) {
+  const size_t block_size = internal::HugePages::getSize();
+  Arena arena(block_size, -1, true);
+  byte* small = arena.allocate(16);
+  small[15] = 1;
+  byte* large = arena.allocate(block_size + 1);
+  large[block_size] = 1;
+  ASSERT_EQ(arena.allocated(), block_size + 17);
+  arena.deallocateAll();
+  ASSERT_EQ(arena.allocated(), 0);
+}
+
+TEST(ArenaTest, ConcurrentAllocationsDoNotOverlap) {
+  // Uses more threads than there are local blocks, so that some threads
+  // allocate from the shared block.
+  const size_t num_threads = Arena::MAX_LOCAL_BLOCKS + 8;
+  const size_t num_allocations = 1000;
+  Arena arena;
+  std::atomic<size_t> num_started(0);
+  std::vector<std::vector<byte*> > allocations(num_threads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t != num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      // All threads are running at the same time to get distinct indexes.
+      ++num_started;
+      while (num_started != num_threads) {
+        std::this_thread::yield();
+      }
+      for (size_t i = 0; i != num_allocations; ++i) {
+        byte* data = arena.allocate(8);
+        std::memset(data, static_cast<int>(t), 8);
+        allocations[t].push_back(data);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(arena.allocated(), num_threads * num_allocations * 8);
+  for (size_t t = 0; t != num_threads; ++t) {
+    for (byte* data : allocations[t]) {
+      for (size_t i = 0; i != 8; ++i) {
+        ASSERT_EQ(data[i], static_cast<byte>(t));
+      }
+    }
+  }
+  arena.deallocateAll();
+  ASSERT_EQ(arena.allocated(), 0);
+  ASSERT_NE(arena.allocate(8), nullptr);
+}
+
+TEST(ArenaTest, ThreadsShareHugePageBlocks) {
+  // Each thread takes a local block of at most MAX_LOCAL_BLOCK_SIZE bytes out
+  // of the arena's current block instead of a huge page of its own.
+  const size_t num_threads = 8;
+  const size_t block_size = internal::HugePages::getSize();
+  Arena arena(block_size, -1, true);
+  std::atomic<size_t> num_started(0);
+  std::vector<byte*> allocations(num_threads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t != num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      // All threads are running at the same time to get distinct indexes.
+      ++num_started;
+      while (num_started != num_threads) {
+        std::this_thread::yield();
+      }
+      allocations[t] = arena.allocate(16);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto minmax =
+      std::minmax_element(allocations.begin(), allocations.end());
+  ASSERT_LT(*minmax.second - *minmax.first,
+            num_threads * Arena::MAX_LOCAL_BLOCK_SIZE);
+  ASSERT_EQ(arena.allocated(), num_threads * 16);
+}
+
+#ifdef MULTIMAP_RUN_LARGE_TESTS
+
+TEST(ArenaTest, AllocationThroughputUnderContention) {
+  // Compares allocations from thread-local blocks with allocations that take
+  // a lock on every call, as all allocations did before.
+  const size_t num_allocations = 1000000;
+  for (size_t num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    for (const bool locked : {true, false}) {
+      Arena arena;
+      std::mutex mutex;
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t != num_threads; ++t) {
+        threads.emplace_back([&] {
+          for (size_t i = 0; i != num_allocations; ++i) {
+            if (locked) {
+              std::lock_guard<std::mutex> lock(mutex);
+              arena.allocate(16);
+            } else {
+              arena.allocate(16);
+            }
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start).count();
+      mt::log() << num_threads << " threads, "
+                << (locked ? "locked" : "thread-local") << ": "
+                << nanos / static_cast<double>(num_allocations * num_threads)
+                << " ns per allocation\n";
+    }
+  }
+}
+
+TEST(ArenaTest, NumaBoundArenaReducesRemotePages) {
+  // Allocates from a thread that may run on any node and counts the pages
+  // that end up on a node other than the one the memory is intended for.
+  const size_t num_nodes = internal::Numa::getNumNodes();
+  const size_t num_blocks = 4096;
+  for (size_t node = 0; node != num_nodes; ++node) {
+    for (const bool bound : {false, true}) {
+      Arena arena(mt::KiB(64), bound ? static_cast<int>(node) : -1);
+      size_t num_remote_pages = 0;
+      size_t num_pages = 0;
+      for (size_t i = 0; i != num_blocks; ++i) {
+        byte* data = arena.allocate(mt::KiB(64));
+        for (size_t offset = 0; offset < mt::KiB(64); offset += mt::KiB(4)) {
+          data[offset] = 1;
+          const int actual = internal::Numa::getNode(data + offset);
+          num_remote_pages += (actual != static_cast<int>(node));
+          ++num_pages;
+        }
+      }
+      mt::log() << "Node " << node << (bound ? " bound: " : " unbound: ")
+                << num_remote_pages << " of " << num_pages
+                << " pages are remote\n";
+    }
+  }
+}
+
+#endif  // MULTIMAP_RUN_LARGE_TESTS
+
 }  // namespace multimap
@@ -0,0 +1,65 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// -----------------------------------------------------------------------------
+// Documentation:  https://multimap.io/cppreference/#cursorhpp
+// -----------------------------------------------------------------------------
+
+#ifndef MULTIMAP_CURSOR_H_
+#define MULTIMAP_CURSOR_H_
+
+#include <cstdint>
+#include <memory>
+#include "multimap/Iterator.h"
+#include "multimap/Slice.h"
+
+namespace multimap {
+
+struct Split {
+  // Describes a disjoint part of a map that can be scanned independently via
+  // a cursor. The fields are only meaningful to the map that created the
+  // split, but since a split is a plain value it can be stored in order to
+  // checkpoint the progress of a job that processes a map split by split.
+
+  uint32_t partition = 0;
+  uint64_t begin = 0;
+  uint64_t end = 0;
+};
+
+class Cursor {
+  // A pull-based scan over the entries of a split.
+
+ public:
+  static std::unique_ptr<Cursor> newEmptyInstance();
+
+  virtual ~Cursor() = default;
+
+  virtual bool next() = 0;
+  // Advances to the next entry of the split. Returns false if there are no
+  // more entries. Must be called once before accessing the first entry.
+
+  virtual Slice key() const = 0;
+  // Returns the key of the current entry.
+
+  virtual Iterator* values() = 0;
+  // Returns an iterator over the values of the current entry.
+  // The key and the iterator are valid until the next call to next().
+};
+
+}  // namespace multimap
+
+#endif  // MULTIMAP_CURSOR_H_
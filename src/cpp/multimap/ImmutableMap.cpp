@@ -18,12 +18,14 @@
 #include "multimap/ImmutableMap.h"
 
 #include <algorithm>
+#include <queue>
 #include <string>
 #include <vector>
 #include <boost/filesystem/operations.hpp>  // NOLINT
 #include "multimap/internal/Descriptor.h"
 #include "multimap/internal/TsvFileReader.h"
 #include "multimap/internal/TsvFileWriter.h"
+#include "multimap/thirdparty/mt/assert.h"
 #include "multimap/thirdparty/mt/check.h"
 #include "multimap/Arena.h"
 
@@ -60,6 +62,60 @@ const Element& select(const std::vector<Element>& elements, const Slice& key) {
   return elements[std::hash<Slice>()(key) % elements.size()];
 }
 
+Bytes getPrefixEnd(const Slice& prefix) {
+  // Returns the smallest key that is greater than all keys starting with
+  // `prefix`, or an empty key if there is none.
+  Bytes end = prefix.makeCopy();
+  while (!end.empty() && end.back() == 0xff) {
+    end.pop_back();
+  }
+  if (!end.empty()) ++end.back();
+  return end;
+}
+
+class MergedCursor : public Cursor {
+  // Merges cursors over disjoint sets of keys, each in ascending key order,
+  // into a single cursor in ascending key order.
+
+ public:
+  explicit MergedCursor(std::vector<std::unique_ptr<Cursor> >&& cursors)
+      : cursors_(std::move(cursors)), heap_(Greater{&cursors_}) {
+    for (size_t i = 0; i != cursors_.size(); ++i) {
+      if (cursors_[i]->next()) heap_.push(i);
+    }
+  }
+
+  bool next() override {
+    // The keys of the other cursors stay valid until they are advanced.
+    if (current_ != cursors_.size() && cursors_[current_]->next()) {
+      heap_.push(current_);
+    }
+    if (heap_.empty()) {
+      current_ = cursors_.size();
+      return false;
+    }
+    current_ = heap_.top();
+    heap_.pop();
+    return true;
+  }
+
+  Slice key() const override { return cursors_[current_]->key(); }
+
+  Iterator* values() override { return cursors_[current_]->values(); }
+
+ private:
+  struct Greater {
+    bool operator()(size_t a, size_t b) const {
+      return (*cursors)[b]->key() < (*cursors)[a]->key();
+    }
+    const std::vector<std::unique_ptr<Cursor> >* cursors;
+  };
+
+  std::vector<std::unique_ptr<Cursor> > cursors_;
+  std::priority_queue<size_t, std::vector<size_t>, Greater> heap_;
+  size_t current_ = cursors_.size();
+};
+
 }  // namespace
 
 size_t ImmutableMap::Limits::maxKeySize() {
@@ -95,22 +151,46 @@ std::vector<Stats> ImmutableMap::Builder::build() {
     }
     stats.push_back(table_builders_[i].build());
   }
+  writeDescriptor();
+  return stats;
+}
 
+std::vector<Stats> ImmutableMap::Builder::build(ThreadPool* pool) {
+  internal::requireMultiThreading("Thread pools");
+  // parallelFor() also runs tasks in the calling thread.
+  const size_t max_concurrency =
+      mt::min(pool->size() + 1, table_builders_.size());
+  const size_t max_memory_per_partition =
+      options_.max_build_memory / mt::max<size_t>(max_concurrency, 1);
+  std::vector<Stats> stats(table_builders_.size());
+  pool->parallelFor(table_builders_.size(), [&](size_t i) {
+    if (options_.verbose) {
+      mt::log() << "Building partition " << (i + 1) << " of "
+                << table_builders_.size() << std::endl;
+    }
+    stats[i] = table_builders_[i].build(max_memory_per_partition, pool);
+  });
+  writeDescriptor();
+  return stats;
+}
+
+void ImmutableMap::Builder::writeDescriptor() const {
   internal::Descriptor descriptor;
   descriptor.map_type = internal::Descriptor::TYPE_IMMUTABLE_MAP;
   descriptor.num_partitions = table_builders_.size();
   descriptor.writeToDirectory(dlock_.directory());
-
-  return stats;
 }
 
 ImmutableMap::ImmutableMap(const fs::path& directory)
+    : ImmutableMap(directory, Options()) {}
+
+ImmutableMap::ImmutableMap(const fs::path& directory, const Options& options)
     : dlock_(directory.string()) {
   const auto descriptor = internal::Descriptor::readFromDirectory(directory);
   checkDescriptor(descriptor, directory);
   for (int i = 0; i < descriptor.num_partitions; i++) {
     const fs::path prefix = directory / getPartitionPrefix(i);
-    tables_.push_back(internal::MphTable(prefix));
+    tables_.push_back(internal::MphTable(prefix, options));
   }
 }
 
@@ -118,22 +198,132 @@ std::unique_ptr<Iterator> ImmutableMap::get(const Slice& key) const {
   return select(tables_, key).get(key);
 }
 
+std::unique_ptr<Iterator> ImmutableMap::get(const Slice& key,
+                                             size_t first_value) const {
+  return select(tables_, key).get(key, first_value);
+}
+
+bool ImmutableMap::contains(const Slice& key) const {
+  return select(tables_, key).contains(key);
+}
+
+bool ImmutableMap::contains(const Slice& key, const Slice& value) const {
+  return select(tables_, key).contains(key, value);
+}
+
+size_t ImmutableMap::count(const Slice& key) const {
+  return select(tables_, key).count(key);
+}
+
 void ImmutableMap::forEachKey(Procedure process) const {
+  if (hasKeyIndex()) {
+    const auto cursor = newRangeCursor(Slice(), Slice());
+    while (cursor->next()) {
+      process(cursor->key());
+    }
+    return;
+  }
   for (const auto& table : tables_) {
     table.forEachKey(process);
   }
 }
 
+void ImmutableMap::forEachKey(Procedure process, ThreadPool* pool) const {
+  forEachKey(process, pool, nullptr);
+}
+
+void ImmutableMap::forEachKey(Procedure process, ThreadPool* pool,
+                              const std::atomic<bool>* cancelled) const {
+  internal::requireMultiThreading("Thread pools");
+  pool->parallelFor(tables_.size(), [&](size_t i) {
+    tables_[i].forEachKey(process, cancelled);
+  });
+}
+
+std::vector<std::unique_ptr<Iterator> > ImmutableMap::getChunks(
+    const Slice& key, size_t num_chunks) const {
+  return select(tables_, key).getChunks(key, num_chunks);
+}
+
 void ImmutableMap::forEachValue(const Slice& key, Procedure process) const {
   select(tables_, key).forEachValue(key, process);
 }
 
+void ImmutableMap::forEachValue(const Slice& key, Procedure process,
+                                ThreadPool* pool) const {
+  internal::requireMultiThreading("Thread pools");
+  const auto chunks = getChunks(key, pool->size() + 1);
+  pool->parallelFor(chunks.size(), [&](size_t i) {
+    while (chunks[i]->hasNext()) {
+      process(chunks[i]->next());
+    }
+  });
+}
+
 void ImmutableMap::forEachEntry(BinaryProcedure process) const {
+  if (hasKeyIndex()) {
+    const auto cursor = newRangeCursor(Slice(), Slice());
+    while (cursor->next()) {
+      process(cursor->key(), cursor->values());
+    }
+    return;
+  }
   for (const auto& table : tables_) {
     table.forEachEntry(process);
   }
 }
 
+void ImmutableMap::forEachEntry(BinaryProcedure process,
+                                ThreadPool* pool) const {
+  forEachEntry(process, pool, nullptr);
+}
+
+void ImmutableMap::forEachEntry(BinaryProcedure process, ThreadPool* pool,
+                                const std::atomic<bool>* cancelled) const {
+  internal::requireMultiThreading("Thread pools");
+  pool->parallelFor(tables_.size(), [&](size_t i) {
+    tables_[i].forEachEntry(process, cancelled);
+  });
+}
+
+std::vector<Split> ImmutableMap::getSplits(size_t num_splits) const {
+  MT_REQUIRE_NOT_ZERO(num_splits);
+  const size_t num_ranges = (num_splits + tables_.size() - 1) / tables_.size();
+  std::vector<Split> splits;
+  for (size_t i = 0; i != tables_.size(); ++i) {
+    for (const auto& range : tables_[i].getSplits(num_ranges)) {
+      Split split;
+      split.partition = i;
+      split.begin = range.first;
+      split.end = range.second;
+      splits.push_back(split);
+    }
+  }
+  return splits;
+}
+
+std::unique_ptr<Cursor> ImmutableMap::newCursor(const Split& split) const {
+  MT_REQUIRE_LT(split.partition, tables_.size());
+  return tables_[split.partition].newCursor(split.begin, split.end);
+}
+
+std::unique_ptr<Cursor> ImmutableMap::newRangeCursor(
+    const Slice& begin_key, const Slice& end_key) const {
+  mt::Check::isTrue(hasKeyIndex(),
+                    "Range queries require a map built with sorted keys: %s",
+                    dlock_.directory().c_str());
+  std::vector<std::unique_ptr<Cursor> > cursors;
+  for (const auto& table : tables_) {
+    cursors.push_back(table.newCursor(begin_key, end_key));
+  }
+  return std::unique_ptr<Cursor>(new MergedCursor(std::move(cursors)));
+}
+
+std::unique_ptr<Cursor> ImmutableMap::newPrefixCursor(
+    const Slice& prefix) const {
+  return newRangeCursor(prefix, getPrefixEnd(prefix));
+}
+
 std::vector<Stats> ImmutableMap::getStats() const {
   std::vector<Stats> stats(tables_.size());
   for (size_t i = 0; i != tables_.size(); i++) {
@@ -144,6 +334,10 @@ std::vector<Stats> ImmutableMap::getStats() const {
 
 Stats ImmutableMap::getTotalStats() const { return Stats::total(getStats()); }
 
+bool ImmutableMap::hasKeyIndex() const {
+  return !tables_.empty() && tables_.front().hasKeyIndex();
+}
+
 std::vector<Stats> ImmutableMap::stats(const fs::path& directory) {
   const auto descriptor = internal::Descriptor::readFromDirectory(directory);
   checkDescriptor(descriptor, directory);
@@ -185,7 +379,12 @@ void ImmutableMap::buildFromBase64(const fs::path& directory,
       builder.put(key, value);
     }
   }
-  builder.build();
+  if (internal::SINGLE_THREADED) {
+    builder.build();
+  } else {
+    ThreadPool pool;
+    builder.build(&pool);
+  }
 }
 
 void ImmutableMap::exportToBase64(const fs::path& directory,
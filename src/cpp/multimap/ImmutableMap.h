@@ -22,10 +22,13 @@
 #ifndef MULTIMAP_IMMUTABLEMAP_H_
 #define MULTIMAP_IMMUTABLEMAP_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "multimap/internal/Locks.h"
 #include "multimap/internal/MphTable.h"
+#include "multimap/Cursor.h"
+#include "multimap/ThreadPool.h"
 
 namespace multimap {
 
@@ -45,10 +48,24 @@ class ImmutableMap {
     Builder(const boost::filesystem::path& directory, const Options& options);
 
     void put(const Slice& key, const Slice& value);
+    // May be called concurrently, unless MULTIMAP_SINGLE_THREADED is defined.
+    // Values put by the same thread keep their order, values of different
+    // threads are interleaved arbitrarily.
 
     std::vector<Stats> build();
 
+    std::vector<Stats> build(ThreadPool* pool);
+    // Builds the partitions concurrently. `Options::max_build_memory` is the
+    // total budget, which is divided among the partitions in progress.
+    // Lists that exceed the budget of their partition are written without
+    // being held in memory, unless `Options::compare` or `Options::filter` is
+    // set. Each list must then fit into memory, regardless of the budget.
+    // The stats of each partition include its build time and the estimated
+    // peak memory usage of its build.
+
    private:
+    void writeDescriptor() const;
+
     std::vector<internal::MphTable::Builder> table_builders_;
     internal::DirectoryLock dlock_;
     Options options_;
@@ -56,14 +73,89 @@ class ImmutableMap {
 
   explicit ImmutableMap(const boost::filesystem::path& directory);
 
+  ImmutableMap(const boost::filesystem::path& directory,
+               const Options& options);
+  // If `Options::huge_pages` is set, the kernel is advised to back the mapped
+  // hash tables and lists with huge pages. This is only effective on kernels
+  // that support huge pages for the page cache of read-only files.
+  // `Options::compare` must be the comparator the map was built with, if any.
+
   std::unique_ptr<Iterator> get(const Slice& key) const;
 
+  std::unique_ptr<Iterator> get(const Slice& key, size_t first_value) const;
+  // Returns an iterator that starts at the value with index `first_value`,
+  // e.g. to fetch a page of a list. If the map was built with
+  // `Options::index_lists`, lists with at least
+  // `Options::min_indexed_list_size` values have an index of their value
+  // positions, which makes this a constant time operation. Other lists skip
+  // the preceding values one by one.
+
+  bool contains(const Slice& key) const;
+
+  bool contains(const Slice& key, const Slice& value) const;
+  // Tests whether `value` is in the key's list. Indexed lists are binary
+  // searched if `Options::compare` was given both during the build and when
+  // opening the map, and no `Options::filter` was given during the build.
+  // Other lists are scanned.
+
+  size_t count(const Slice& key) const;
+
   void forEachKey(Procedure process) const;
+  // Visits the keys in ascending order if the map was built with
+  // `Options::sorted_keys`, and in an unspecified order otherwise. The same
+  // holds for forEachEntry() without a thread pool.
+
+  void forEachKey(Procedure process, ThreadPool* pool) const;
+
+  void forEachKey(Procedure process, ThreadPool* pool,
+                  const std::atomic<bool>* cancelled) const;
+
+  std::vector<std::unique_ptr<Iterator> > getChunks(const Slice& key,
+                                                    size_t num_chunks) const;
+  // Divides the list associated with `key` into at most `num_chunks`
+  // consecutive chunks of roughly the same number of values and returns an
+  // iterator for each of them. The iterators can be consumed by different
+  // threads in parallel. The map must outlive the returned iterators.
 
   void forEachValue(const Slice& key, Procedure process) const;
 
+  void forEachValue(const Slice& key, Procedure process,
+                    ThreadPool* pool) const;
+  // Visits the values of a single list in parallel using getChunks(), so
+  // that `process` may be invoked concurrently and must be thread-safe.
+
   void forEachEntry(BinaryProcedure process) const;
 
+  void forEachEntry(BinaryProcedure process, ThreadPool* pool) const;
+
+  void forEachEntry(BinaryProcedure process, ThreadPool* pool,
+                    const std::atomic<bool>* cancelled) const;
+  // The overloads taking a thread pool scan the partitions in parallel.
+  // Callables may therefore be invoked concurrently from different threads
+  // and must be thread-safe. Setting `cancelled` to true, e.g. from within a
+  // callable, stops the scan after the keys currently being processed.
+
+  std::vector<Split> getSplits(size_t num_splits) const;
+  // Returns disjoint splits that together cover the entire map. Each partition
+  // is divided into at most ceil(num_splits / num_partitions) ranges of
+  // stored lists, so that cursors read the underlying files sequentially.
+
+  std::unique_ptr<Cursor> newCursor(const Split& split) const;
+  // Returns a cursor over the entries of `split`.
+  // The map must outlive the cursor.
+
+  std::unique_ptr<Cursor> newRangeCursor(const Slice& begin_key,
+                                         const Slice& end_key) const;
+  // Returns a cursor over the entries whose keys are in [begin_key, end_key),
+  // in ascending key order. An empty `end_key` means that there is no upper
+  // bound. Requires a map built with `Options::sorted_keys`, which writes a
+  // sparse index of the keys of each partition. The partitions are merged on
+  // the fly. The map must outlive the cursor.
+
+  std::unique_ptr<Cursor> newPrefixCursor(const Slice& prefix) const;
+  // Returns a cursor over the entries whose keys start with `prefix`, in
+  // ascending key order. Has the same requirements as newRangeCursor().
+
   std::vector<Stats> getStats() const;
 
   Stats getTotalStats() const;
@@ -89,6 +181,8 @@ class ImmutableMap {
                              const Options& options);
 
  private:
+  bool hasKeyIndex() const;
+
   std::vector<internal::MphTable> tables_;
   internal::DirectoryLock dlock_;
 };
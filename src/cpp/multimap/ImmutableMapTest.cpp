@@ -0,0 +1,263 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <chrono>  // NOLINT
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <type_traits>
+#include <vector>
+#include <boost/filesystem/operations.hpp>  // NOLINT
+#include "gmock/gmock.h"
+#include "multimap/thirdparty/mt/common.h"
+#include "multimap/ImmutableMap.h"
+
+namespace multimap {
+
+using testing::Eq;
+using testing::Gt;
+
+struct ImmutableMapTestFixture : public testing::Test {
+  void SetUp() override {
+    boost::filesystem::remove_all(directory);
+    boost::filesystem::create_directory(directory);
+  }
+
+  void TearDown() override { boost::filesystem::remove_all(directory); }
+
+  const boost::filesystem::path directory =
+      "/tmp/multimap.ImmutableMapTestFixture";
+};
+
+TEST(ImmutableMapBuilderTest, IsNotDefaultConstructible) {
+  ASSERT_FALSE(std::is_default_constructible<ImmutableMap::Builder>::value);
+}
+
+TEST_F(ImmutableMapTestFixture, ParallelBuildWithLittleMemoryReadsAll) {
+  const int num_keys = 1000;
+  const int num_values = 100;
+  Options options;
+  options.verbose = false;
+  options.num_partitions = 5;
+  options.max_build_memory = mt::KiB(64);
+  {
+    ImmutableMap::Builder builder(directory, options);
+    for (int v = 0; v != num_values; ++v) {
+      for (int k = 0; k != num_keys; ++k) {
+        builder.put(std::to_string(k), std::to_string(v));
+      }
+    }
+    ThreadPool pool(3);
+    const auto stats = builder.build(&pool);
+    ASSERT_THAT(Stats::total(stats).num_values_total,
+                Eq(num_keys * num_values));
+    for (const auto& stat : stats) {
+      ASSERT_THAT(stat.build_memory_max, Gt(0));
+    }
+  }
+  ImmutableMap map(directory);
+  for (int k = 0; k != num_keys; ++k) {
+    auto iter = map.get(std::to_string(k));
+    ASSERT_THAT(iter->available(), Eq(num_values));
+    for (int v = 0; v != num_values; ++v) {
+      ASSERT_THAT(iter->next().toString(), Eq(std::to_string(v)));
+    }
+  }
+}
+
+TEST_F(ImmutableMapTestFixture, ConcurrentPutsKeepOrderPerThread) {
+  const int num_threads = 12;
+  const int num_keys = 100;
+  const int num_values = 100;
+  Options options;
+  options.verbose = false;
+  options.num_partitions = 3;
+  {
+    ImmutableMap::Builder builder(directory, options);
+    std::vector<std::thread> threads;
+    for (int t = 0; t != num_threads; ++t) {
+      threads.emplace_back([&builder, t]() {
+        for (int v = 0; v != num_values; ++v) {
+          for (int k = 0; k != num_keys; ++k) {
+            builder.put(std::to_string(k),
+                        std::to_string(t) + ' ' + std::to_string(v));
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    builder.build();
+  }
+  ImmutableMap map(directory);
+  for (int k = 0; k != num_keys; ++k) {
+    std::vector<int> next_values(num_threads, 0);
+    auto iter = map.get(std::to_string(k));
+    ASSERT_THAT(iter->available(), Eq(num_threads * num_values));
+    while (iter->hasNext()) {
+      std::istringstream stream(iter->next().toString());
+      int t, v;
+      stream >> t >> v;
+      ASSERT_THAT(v, Eq(next_values[t]++));
+    }
+  }
+}
+
+TEST_F(ImmutableMapTestFixture, SortedKeysSupportRangeAndPrefixQueries) {
+  const int num_keys = 1000;
+  Options options;
+  options.verbose = false;
+  options.num_partitions = 5;
+  options.sorted_keys = true;
+  options.key_index_block_size = 128;
+  std::set<std::string> keys;
+  {
+    ImmutableMap::Builder builder(directory, options);
+    for (int k = 0; k != num_keys; ++k) {
+      keys.insert(std::to_string(k));
+      builder.put(std::to_string(k), std::to_string(k * 2));
+    }
+    builder.build();
+  }
+  ImmutableMap map(directory);
+  std::vector<std::string> actual;
+  map.forEachKey([&actual](const Slice& key) {
+    actual.push_back(key.toString());
+  });
+  ASSERT_THAT(actual, Eq(std::vector<std::string>(keys.begin(), keys.end())));
+
+  actual.clear();
+  auto cursor = map.newRangeCursor("25", "26");
+  while (cursor->next()) {
+    const std::string key = cursor->key().toString();
+    ASSERT_THAT(cursor->values()->next().toString(),
+                Eq(std::to_string(std::stoi(key) * 2)));
+    actual.push_back(key);
+  }
+  ASSERT_THAT(actual, Eq(std::vector<std::string>(
+                          {"25", "250", "251", "252", "253", "254", "255",
+                           "256", "257", "258", "259"})));
+
+  actual.clear();
+  cursor = map.newPrefixCursor("99");
+  while (cursor->next()) {
+    actual.push_back(cursor->key().toString());
+  }
+  ASSERT_THAT(actual, Eq(std::vector<std::string>({"99", "990", "991", "992",
+                                                    "993", "994", "995", "996",
+                                                    "997", "998", "999"})));
+  ASSERT_FALSE(map.newPrefixCursor("x")->next());
+}
+
+TEST_F(ImmutableMapTestFixture, IndexedListsSupportPagingAndMembership) {
+  const int num_keys = 100;
+  const int num_values = 1000;
+  Options options;
+  options.verbose = false;
+  options.num_partitions = 5;
+  options.index_lists = true;
+  options.min_indexed_list_size = 100;
+  options.compare = [](const Slice& a, const Slice& b) {
+    return std::stoi(a.toString()) < std::stoi(b.toString());
+  };
+  {
+    ImmutableMap::Builder builder(directory, options);
+    for (int v = num_values - 1; v >= 0; --v) {
+      for (int k = 0; k != num_keys; ++k) {
+        builder.put(std::to_string(k), std::to_string(v * 2));
+      }
+    }
+    builder.build();
+  }
+  ImmutableMap map(directory, options);
+  for (int k = 0; k != num_keys; ++k) {
+    const std::string key = std::to_string(k);
+    for (int page = 0; page != 10; ++page) {
+      auto iter = map.get(key, page * 100);
+      ASSERT_THAT(iter->available(), Eq(num_values - page * 100));
+      ASSERT_THAT(iter->next().toString(), Eq(std::to_string(page * 200)));
+    }
+    ASSERT_TRUE(map.contains(key, "0"));
+    ASSERT_TRUE(map.contains(key, "1998"));
+    ASSERT_FALSE(map.contains(key, "1"));
+    ASSERT_FALSE(map.contains(key, "2000"));
+  }
+}
+
+#ifdef MULTIMAP_RUN_LARGE_TESTS
+
+TEST_F(ImmutableMapTestFixture, BuildTimeForDifferentNumbersOfThreads) {
+  const int num_keys = 1000000;
+  const int num_values = 10;
+  Options options;
+  options.verbose = false;
+  for (size_t num_threads : {1, 3, 7}) {
+    boost::filesystem::remove_all(directory);
+    boost::filesystem::create_directory(directory);
+    ImmutableMap::Builder builder(directory, options);
+    for (int v = 0; v != num_values; ++v) {
+      for (int k = 0; k != num_keys; ++k) {
+        builder.put(std::to_string(k), std::to_string(v));
+      }
+    }
+    ThreadPool pool(num_threads);
+    const auto start = std::chrono::steady_clock::now();
+    const auto stats = builder.build(&pool);
+    const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+    ASSERT_THAT(Stats::total(stats).num_values_total,
+                Eq(num_keys * num_values));
+    const Stats max = Stats::max(stats);
+    mt::log() << "Built " << options.num_partitions << " partitions with "
+              << (pool.size() + 1) << " threads in " << millis
+              << " ms, at most " << max.build_time_ms << " ms and "
+              << (max.build_memory_max >> 20) << " MiB per partition\n";
+  }
+}
+
+TEST_F(ImmutableMapTestFixture, PutThroughputForDifferentNumbersOfThreads) {
+  const int num_puts = 4000000;
+  Options options;
+  options.verbose = false;
+  for (int num_threads : {1, 2, 4, 8}) {
+    boost::filesystem::remove_all(directory);
+    boost::filesystem::create_directory(directory);
+    ImmutableMap::Builder builder(directory, options);
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t != num_threads; ++t) {
+      threads.emplace_back([&builder, t, num_threads, num_puts]() {
+        for (int i = t; i < num_puts; i += num_threads) {
+          builder.put(std::to_string(i % 1000000), std::to_string(i));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+    mt::log() << num_threads << " threads put " << num_puts << " values in "
+              << millis << " ms\n";
+  }
+}
+
+#endif  // MULTIMAP_RUN_LARGE_TESTS
+
+}  // namespace multimap
@@ -18,12 +18,16 @@
 #include "multimap/Map.h"
 
 #include <algorithm>
+#include <exception>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 #include <boost/filesystem/operations.hpp>  // NOLINT
+#include "multimap/internal/Numa.h"
 #include "multimap/internal/TsvFileReader.h"
 #include "multimap/internal/TsvFileWriter.h"
+#include "multimap/thirdparty/mt/assert.h"
 #include "multimap/thirdparty/mt/check.h"
 
 namespace fs = boost::filesystem;
@@ -55,6 +59,89 @@ std::string getPartitionPrefix(size_t index) {
   return getFilePrefix() + '.' + std::to_string(index);
 }
 
+const uint64_t NUM_KEY_RANGE_HASHES = uint64_t(1) << 32;
+
+uint64_t getKeyRangeHash(const Slice& key) {
+  // The lower bits of the hash value select the partition,
+  // the upper bits are used to divide a partition into key ranges.
+  return static_cast<uint64_t>(std::hash<Slice>()(key)) >> 32;
+}
+
+// The executor the current thread belongs to, if any.
+thread_local const ThreadPool* current_executor = nullptr;
+
+class CopiedValuesIterator : public Iterator {
+  // Holds copies of the values of another iterator, so that reading them
+  // neither accesses the store nor faults in its pages.
+
+ public:
+  explicit CopiedValuesIterator(Iterator* iter) {
+    std::vector<size_t> sizes;
+    while (iter->hasNext()) {
+      const Slice value = iter->next();
+      data_.insert(data_.end(), value.begin(), value.end());
+      sizes.push_back(value.size());
+    }
+    values_.reserve(sizes.size());
+    const byte* pos = data_.data();
+    for (size_t size : sizes) {
+      values_.emplace_back(pos, size);
+      pos += size;
+    }
+  }
+
+  size_t available() const override { return values_.size() - index_; }
+
+  bool hasNext() const override { return index_ != values_.size(); }
+
+  Slice next() override {
+    const Slice value = peekNext();
+    index_++;
+    return value;
+  }
+
+  Slice peekNext() override {
+    MT_REQUIRE_TRUE(hasNext());
+    return values_[index_];
+  }
+
+ private:
+  Bytes data_;
+  std::vector<Slice> values_;
+  size_t index_ = 0;
+};
+
+void logAsyncError(std::exception_ptr error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception& exception) {
+    mt::log() << "Map: asynchronous operation failed: " << exception.what()
+              << std::endl;
+  } catch (...) {
+    mt::log() << "Map: asynchronous operation failed" << std::endl;
+  }
+}
+
+class ShardCursor : public Cursor {
+  // Wraps a cursor over a partition that is owned by an executor. Moving to
+  // the next entry reads the partition and is therefore done by the owner,
+  // whereas the key and the snapshot of the list can be read by any thread.
+
+ public:
+  ShardCursor(std::shared_ptr<Cursor> cursor, std::function<bool()> next)
+      : cursor_(std::move(cursor)), next_(std::move(next)) {}
+
+  bool next() override { return next_(); }
+
+  Slice key() const override { return cursor_->key(); }
+
+  Iterator* values() override { return cursor_->values(); }
+
+ private:
+  std::shared_ptr<Cursor> cursor_;
+  std::function<bool()> next_;
+};
+
 }  // namespace
 
 size_t Map::Limits::maxKeySize() {
@@ -68,7 +155,7 @@ size_t Map::Limits::maxValueSize() {
 Map::Map(const fs::path& directory) : Map(directory, Options()) {}
 
 Map::Map(const fs::path& directory, const Options& options)
-    : dlock_(directory.string()) {
+    : dlock_(directory.string()), shard_per_core_(options.shard_per_core) {
   checkOptions(options);
   Options partition_options;
   partition_options.readonly = options.readonly;
@@ -78,106 +165,490 @@ Map::Map(const fs::path& directory, const Options& options)
     checkDescriptor(descriptor, directory);
     mt::Check::isFalse(options.error_if_exists, "Map in %s already exists",
                        fs::absolute(directory).c_str());
-    partitions_.resize(descriptor.num_partitions);
+    num_partitions_ = descriptor.num_partitions;
 
   } else {
     mt::Check::isTrue(options.create_if_missing, "Map in %s does not exist",
                       fs::absolute(directory).c_str());
-    partitions_.resize(mt::nextPrime(options.num_partitions));
+    num_partitions_ = mt::nextPrime(options.num_partitions);
     descriptor.map_type = internal::Descriptor::TYPE_MAP;
-    descriptor.num_partitions = partitions_.size();
+    descriptor.num_partitions = num_partitions_;
     descriptor.writeToDirectory(directory);
   }
-  for (size_t i = 0; i != partitions_.size(); i++) {
+  // Partitions are assigned to NUMA nodes round-robin.
+  if (options.numa_aware) {
+    num_numa_nodes_ = internal::Numa::getNumNodes();
+  }
+  for (size_t i = 0; i != num_partitions_; i++) {
     const fs::path prefix = directory / getPartitionPrefix(i);
-    partitions_[i].reset(new internal::Partition(prefix, partition_options));
+    const int numa_node = (num_numa_nodes_ > 1) ? i % num_numa_nodes_ : -1;
+    if (shard_per_core_) {
+      shards_.emplace_back(new Shard(prefix, partition_options, numa_node));
+    } else {
+      partitions_.emplace_back(
+          new internal::Partition(prefix, partition_options, numa_node));
+    }
+  }
+  if (shard_per_core_) {
+    getExecutor(0);  // Starts the owners of the partitions.
+  }
+}
+
+Map::~Map() {
+  for (const auto& queue : queues_) {
+    queue->wait();
   }
 }
 
 void Map::put(const Slice& key, const Slice& value) {
-  getPartition(key)->put(key, value);
+  const size_t index = getPartitionIndex(key);
+  if (shard_per_core_) {
+    runOnShard(index, [&](Shard* shard) { shard->put(key, value); });
+  } else {
+    partitions_[index]->put(key, value);
+  }
+}
+
+void Map::write(const WriteBatch& batch) {
+  std::vector<std::vector<WriteBatch::Operation> > operations_per_partition(
+      num_partitions_);
+  for (const auto& operation : batch.operations()) {
+    operations_per_partition[getPartitionIndex(operation.key)].push_back(
+        operation);
+  }
+  for (size_t p = 0; p != num_partitions_; ++p) {
+    if (operations_per_partition[p].empty()) continue;
+    auto& operations = operations_per_partition[p];
+    if (shard_per_core_) {
+      runOnShard(p, [&](Shard* shard) { shard->write(std::move(operations)); });
+    } else {
+      partitions_[p]->write(std::move(operations));
+    }
+  }
 }
 
 std::unique_ptr<Iterator> Map::get(const Slice& key) const {
+  if (shard_per_core_) {
+    // The iterator is used by the caller, hence it must not access the list.
+    return callOnShard<std::unique_ptr<Iterator> >(
+        getPartitionIndex(key), [&key](Shard* shard) {
+          return std::move(shard->getMany(std::vector<Slice>{key}).front());
+        });
+  }
   return getPartition(key)->get(key);
 }
 
-size_t Map::remove(const Slice& key) { return getPartition(key)->remove(key); }
+bool Map::contains(const Slice& key) const {
+  if (shard_per_core_) {
+    return callOnShard<bool>(getPartitionIndex(key), [&key](Shard* shard) {
+      return shard->contains(key);
+    });
+  }
+  return getPartition(key)->contains(key);
+}
+
+size_t Map::count(const Slice& key) const {
+  if (shard_per_core_) {
+    return callOnShard<size_t>(getPartitionIndex(key), [&key](Shard* shard) {
+      return shard->count(key);
+    });
+  }
+  return getPartition(key)->count(key);
+}
+
+void Map::getMany(const std::vector<Slice>& keys,
+                  BinaryProcedure process) const {
+  std::vector<std::vector<Slice> > keys_per_partition(num_partitions_);
+  std::vector<std::vector<size_t> > positions_per_partition(num_partitions_);
+  for (size_t i = 0; i != keys.size(); ++i) {
+    const size_t p = getPartitionIndex(keys[i]);
+    keys_per_partition[p].push_back(keys[i]);
+    positions_per_partition[p].push_back(i);
+  }
+  std::vector<std::unique_ptr<Iterator> > iters(keys.size());
+  for (size_t p = 0; p != num_partitions_; ++p) {
+    if (keys_per_partition[p].empty()) continue;
+    const auto& partition_keys = keys_per_partition[p];
+    auto partition_iters =
+        shard_per_core_
+            ? callOnShard<std::vector<std::unique_ptr<Iterator> > >(
+                  p, [&partition_keys](Shard* shard) {
+                    return shard->getMany(partition_keys);
+                  })
+            : partitions_[p]->getMany(partition_keys);
+    for (size_t j = 0; j != partition_iters.size(); ++j) {
+      iters[positions_per_partition[p][j]] = std::move(partition_iters[j]);
+    }
+  }
+  for (size_t i = 0; i != keys.size(); ++i) {
+    process(keys[i], iters[i].get());
+  }
+}
+
+std::vector<std::unique_ptr<Iterator> > Map::getChunks(
+    const Slice& key, size_t num_chunks) const {
+  if (shard_per_core_) {
+    return callOnShard<std::vector<std::unique_ptr<Iterator> > >(
+        getPartitionIndex(key), [&key, num_chunks](Shard* shard) {
+          return shard->getChunks(key, num_chunks);
+        });
+  }
+  return getPartition(key)->getChunks(key, num_chunks);
+}
+
+std::future<void> Map::putAsync(const Slice& key, const Slice& value) {
+  const auto promise = std::make_shared<std::promise<void> >();
+  auto future = promise->get_future();
+  const auto key_copy = std::make_shared<Bytes>(key.makeCopy());
+  const auto value_copy = std::make_shared<Bytes>(value.makeCopy());
+  pushAsync(key, [this, promise, key_copy, value_copy] {
+    try {
+      put(*key_copy, *value_copy);
+      promise->set_value();
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+  return future;
+}
+
+std::future<std::unique_ptr<Iterator> > Map::getAsync(const Slice& key) const {
+  typedef std::promise<std::unique_ptr<Iterator> > Promise;
+  const auto promise = std::make_shared<Promise>();
+  auto future = promise->get_future();
+  const auto key_copy = std::make_shared<Bytes>(key.makeCopy());
+  pushAsync(key, [this, promise, key_copy] {
+    try {
+      // The values are copied by the pool thread, so that the caller's
+      // thread does not block on page faults when iterating them.
+      std::unique_ptr<Iterator> iter;
+      if (shard_per_core_) {
+        iter = get(*key_copy);
+      } else {
+        iter = std::move(getPartition(*key_copy)->getMany(
+                             std::vector<Slice>{*key_copy}).front());
+      }
+      promise->set_value(
+          std::unique_ptr<Iterator>(new CopiedValuesIterator(iter.get())));
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+  return future;
+}
+
+void Map::getAsync(const Slice& key, BinaryProcedure process) const {
+  getAsync(key, process, logAsyncError);
+}
+
+void Map::getAsync(const Slice& key, BinaryProcedure process,
+                   std::function<void(std::exception_ptr)> fail) const {
+  MT_REQUIRE_TRUE(process);
+  MT_REQUIRE_TRUE(fail);
+  const auto key_copy = std::make_shared<Bytes>(key.makeCopy());
+  pushAsync(key, [this, process, fail, key_copy] {
+    try {
+      const auto iter = get(*key_copy);
+      process(*key_copy, iter.get());
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  });
+}
+
+std::future<size_t> Map::removeAsync(const Slice& key) {
+  const auto promise = std::make_shared<std::promise<size_t> >();
+  auto future = promise->get_future();
+  const auto key_copy = std::make_shared<Bytes>(key.makeCopy());
+  pushAsync(key, [this, promise, key_copy] {
+    try {
+      promise->set_value(remove(*key_copy));
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+  return future;
+}
+
+size_t Map::remove(const Slice& key) {
+  if (shard_per_core_) {
+    return callOnShard<size_t>(getPartitionIndex(key), [&key](Shard* shard) {
+      return shard->remove(key);
+    });
+  }
+  return getPartition(key)->remove(key);
+}
 
 bool Map::removeFirstEqual(const Slice& key, const Slice& value) {
+  if (shard_per_core_) {
+    return callOnShard<bool>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->removeFirstEqual(key, value);
+    });
+  }
   return getPartition(key)->removeFirstEqual(key, value);
 }
 
 size_t Map::removeAllEqual(const Slice& key, const Slice& value) {
+  if (shard_per_core_) {
+    return callOnShard<size_t>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->removeAllEqual(key, value);
+    });
+  }
   return getPartition(key)->removeAllEqual(key, value);
 }
 
 bool Map::removeFirstMatch(const Slice& key, Predicate predicate) {
+  if (shard_per_core_) {
+    return callOnShard<bool>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->removeFirstMatch(key, predicate);
+    });
+  }
   return getPartition(key)->removeFirstMatch(key, predicate);
 }
 
 size_t Map::removeFirstMatch(Predicate predicate) {
   size_t num_values_removed = 0;
-  for (const auto& partition : partitions_) {
-    num_values_removed = partition->removeFirstMatch(predicate);
+  for (size_t i = 0; i != num_partitions_; ++i) {
+    if (shard_per_core_) {
+      num_values_removed = callOnShard<size_t>(i, [&](Shard* shard) {
+        return shard->removeFirstMatch(predicate);
+      });
+    } else {
+      num_values_removed = partitions_[i]->removeFirstMatch(predicate);
+    }
     if (num_values_removed != 0) break;
   }
   return num_values_removed;
 }
 
+size_t Map::removeFirstMatch(Predicate predicate, ThreadPool* pool) {
+  if (!shard_per_core_) internal::requireMultiThreading("Thread pools");
+  std::atomic<bool> claimed(false);
+  std::atomic<size_t> num_values_removed(0);
+  pool->parallelFor(num_partitions_, [&](size_t i) {
+    if (shard_per_core_) {
+      num_values_removed += callOnShard<size_t>(i, [&](Shard* shard) {
+        return shard->removeFirstMatch(predicate, &claimed);
+      });
+    } else {
+      num_values_removed +=
+          partitions_[i]->removeFirstMatch(predicate, &claimed);
+    }
+  });
+  return num_values_removed;
+}
+
 size_t Map::removeAllMatches(const Slice& key, Predicate predicate) {
+  if (shard_per_core_) {
+    return callOnShard<size_t>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->removeAllMatches(key, predicate);
+    });
+  }
   return getPartition(key)->removeAllMatches(key, predicate);
 }
 
 std::pair<size_t, size_t> Map::removeAllMatches(Predicate predicate) {
   size_t num_keys_removed = 0;
   size_t num_values_removed = 0;
-  for (const auto& partition : partitions_) {
-    const auto result = partition->removeAllMatches(predicate);
+  for (size_t i = 0; i != num_partitions_; ++i) {
+    const auto result =
+        shard_per_core_
+            ? callOnShard<std::pair<size_t, size_t> >(
+                  i, [&predicate](Shard* shard) {
+                    return shard->removeAllMatches(predicate);
+                  })
+            : partitions_[i]->removeAllMatches(predicate);
     num_keys_removed += result.first;
     num_values_removed += result.second;
   }
   return std::make_pair(num_keys_removed, num_values_removed);
 }
 
+std::pair<size_t, size_t> Map::removeAllMatches(Predicate predicate,
+                                                ThreadPool* pool) {
+  if (!shard_per_core_) internal::requireMultiThreading("Thread pools");
+  std::atomic<size_t> num_keys_removed(0);
+  std::atomic<size_t> num_values_removed(0);
+  pool->parallelFor(num_partitions_, [&](size_t i) {
+    const auto result =
+        shard_per_core_
+            ? callOnShard<std::pair<size_t, size_t> >(
+                  i, [&predicate](Shard* shard) {
+                    return shard->removeAllMatches(predicate);
+                  })
+            : partitions_[i]->removeAllMatches(predicate);
+    num_keys_removed += result.first;
+    num_values_removed += result.second;
+  });
+  return std::make_pair(num_keys_removed.load(), num_values_removed.load());
+}
+
 bool Map::replaceFirstEqual(const Slice& key, const Slice& old_value,
                             const Slice& new_value) {
+  if (shard_per_core_) {
+    return callOnShard<bool>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->replaceFirstEqual(key, old_value, new_value);
+    });
+  }
   return getPartition(key)->replaceFirstEqual(key, old_value, new_value);
 }
 
 size_t Map::replaceAllEqual(const Slice& key, const Slice& old_value,
                             const Slice& new_value) {
+  if (shard_per_core_) {
+    return callOnShard<size_t>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->replaceAllEqual(key, old_value, new_value);
+    });
+  }
   return getPartition(key)->replaceAllEqual(key, old_value, new_value);
 }
 
 bool Map::replaceFirstMatch(const Slice& key, Function map) {
+  if (shard_per_core_) {
+    return callOnShard<bool>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->replaceFirstMatch(key, map);
+    });
+  }
   return getPartition(key)->replaceFirstMatch(key, map);
 }
 
 size_t Map::replaceAllMatches(const Slice& key, Function map) {
+  if (shard_per_core_) {
+    return callOnShard<size_t>(getPartitionIndex(key), [&](Shard* shard) {
+      return shard->replaceAllMatches(key, map);
+    });
+  }
   return getPartition(key)->replaceAllMatches(key, map);
 }
 
 void Map::forEachKey(Procedure process) const {
-  for (const auto& partition : partitions_) {
-    partition->forEachKey(process);
+  for (size_t i = 0; i != num_partitions_; ++i) {
+    if (shard_per_core_) {
+      runOnShard(i, [&process](Shard* shard) { shard->forEachKey(process); });
+    } else {
+      partitions_[i]->forEachKey(process);
+    }
   }
 }
 
+void Map::forEachKey(Procedure process, ThreadPool* pool) const {
+  forEachKey(process, pool, nullptr);
+}
+
+void Map::forEachKey(Procedure process, ThreadPool* pool,
+                     const std::atomic<bool>* cancelled) const {
+  if (!shard_per_core_) internal::requireMultiThreading("Thread pools");
+  pool->parallelFor(num_partitions_, [&](size_t i) {
+    if (shard_per_core_) {
+      runOnShard(i, [&](Shard* shard) {
+        shard->forEachKey(process, cancelled);
+      });
+    } else {
+      partitions_[i]->forEachKey(process, cancelled);
+    }
+  });
+}
+
 void Map::forEachValue(const Slice& key, Procedure process) const {
+  if (shard_per_core_) {
+    // `process` is invoked by the calling thread, as in the locking mode.
+    const auto iter = get(key);
+    while (iter->hasNext()) {
+      process(iter->next());
+    }
+    return;
+  }
   getPartition(key)->forEachValue(key, process);
 }
 
+void Map::forEachValue(const Slice& key, Procedure process,
+                       ThreadPool* pool) const {
+  if (!shard_per_core_) internal::requireMultiThreading("Thread pools");
+  const auto chunks = getChunks(key, pool->size() + 1);
+  pool->parallelFor(chunks.size(), [&](size_t i) {
+    while (chunks[i]->hasNext()) {
+      process(chunks[i]->next());
+    }
+  });
+}
+
 void Map::forEachEntry(BinaryProcedure process) const {
-  for (const auto& partition : partitions_) {
-    partition->forEachEntry(process);
+  forEachEntry(process, nullptr, nullptr);
+}
+
+void Map::forEachEntry(BinaryProcedure process, ThreadPool* pool) const {
+  forEachEntry(process, pool, nullptr);
+}
+
+void Map::forEachEntry(BinaryProcedure process, ThreadPool* pool,
+                       const std::atomic<bool>* cancelled) const {
+  if (pool && !shard_per_core_) {
+    internal::requireMultiThreading("Thread pools");
+  }
+  const auto scan = [&](size_t i) {
+    if (!shard_per_core_) {
+      partitions_[i]->forEachEntry(process, cancelled);
+      return;
+    }
+    // `process` is invoked by the scanning thread, as in the locking mode.
+    const auto cursor = newShardCursor(i, [](const Slice&) { return true; });
+    while (!(cancelled && *cancelled) && cursor->next()) {
+      process(cursor->key(), cursor->values());
+    }
+  };
+  if (pool) {
+    pool->parallelFor(num_partitions_, scan);
+  } else {
+    for (size_t i = 0; i != num_partitions_; ++i) {
+      scan(i);
+    }
+  }
+}
+
+std::vector<Split> Map::getSplits(size_t num_splits) const {
+  MT_REQUIRE_NOT_ZERO(num_splits);
+  const size_t num_ranges =
+      (num_splits + num_partitions_ - 1) / num_partitions_;
+  std::vector<Split> splits;
+  for (size_t i = 0; i != num_partitions_; ++i) {
+    for (size_t j = 0; j != num_ranges; ++j) {
+      Split split;
+      split.partition = i;
+      split.begin = NUM_KEY_RANGE_HASHES * j / num_ranges;
+      split.end = NUM_KEY_RANGE_HASHES * (j + 1) / num_ranges;
+      splits.push_back(split);
+    }
   }
+  return splits;
+}
+
+std::unique_ptr<Cursor> Map::newCursor(const Split& split) const {
+  MT_REQUIRE_LT(split.partition, num_partitions_);
+  MT_REQUIRE_LE(split.begin, split.end);
+  const auto select = [&split](const Slice& key) {
+    const uint64_t hash = getKeyRangeHash(key);
+    return hash >= split.begin && hash < split.end;
+  };
+  return shard_per_core_ ? newShardCursor(split.partition, select)
+                         : partitions_[split.partition]->newCursor(select);
+}
+
+int Map::getNumaNode(const Slice& key) const {
+  // The NUMA node of a partition does not change after construction.
+  const size_t index = getPartitionIndex(key);
+  return shard_per_core_ ? shards_[index]->getNumaNode()
+                         : partitions_[index]->getNumaNode();
 }
 
 std::vector<Stats> Map::getStats() const {
   std::vector<Stats> stats;
-  for (const auto& partition : partitions_) {
-    stats.push_back(partition->getStats());
+  for (size_t i = 0; i != num_partitions_; ++i) {
+    if (shard_per_core_) {
+      stats.push_back(callOnShard<Stats>(
+          i, [](Shard* shard) { return shard->getStats(); }));
+    } else {
+      stats.push_back(partitions_[i]->getStats());
+    }
   }
   return stats;
 }
@@ -326,12 +797,102 @@ void Map::optimize(const fs::path& directory, const fs::path& target,
   }
 }
 
+size_t Map::getPartitionIndex(const Slice& key) const {
+  return std::hash<Slice>()(key) % num_partitions_;
+}
+
 internal::Partition* Map::getPartition(const Slice& key) {
-  return partitions_[std::hash<Slice>()(key) % partitions_.size()].get();
+  return partitions_[getPartitionIndex(key)].get();
 }
 
 const internal::Partition* Map::getPartition(const Slice& key) const {
-  return partitions_[std::hash<Slice>()(key) % partitions_.size()].get();
+  return partitions_[getPartitionIndex(key)].get();
+}
+
+ThreadPool* Map::getExecutor(size_t index) const {
+  std::call_once(executors_started_, [this] {
+    // A partition is processed by at most one thread at a time.
+    const size_t num_threads = std::max<size_t>(
+        1, std::min<size_t>(std::thread::hardware_concurrency(),
+                            num_partitions_));
+    if (shard_per_core_) {
+      // Executor i owns the partitions p with p % num_executors == i. If the
+      // number of executors is a multiple of the number of NUMA nodes, these
+      // partitions are all assigned to node i % num_numa_nodes_.
+      const size_t num_executors = std::max(
+          num_numa_nodes_, num_threads - num_threads % num_numa_nodes_);
+      for (size_t i = 0; i != num_executors; ++i) {
+        const auto cpus = internal::Numa::getCpus(i % num_numa_nodes_);
+        executors_.emplace_back(new ThreadPool(1));
+        ThreadPool* executor = executors_.back().get();
+        executor->pinToCpus(
+            cpus.empty() ? i : cpus[(i / num_numa_nodes_) % cpus.size()]);
+        executor->submit([executor] { current_executor = executor; });
+      }
+    } else {
+      executors_.emplace_back(new ThreadPool(num_threads));
+    }
+    queues_.resize(num_partitions_);
+    for (auto& queue : queues_) {
+      queue.reset(new internal::TaskQueue());
+    }
+  });
+  return executors_[index % executors_.size()].get();
+}
+
+void Map::pushAsync(const Slice& key, std::function<void()> task) const {
+  if (!shard_per_core_) {
+    // Shards are owned by their executor and need no locking.
+    internal::requireMultiThreading("Asynchronous operations");
+  }
+  const size_t index = getPartitionIndex(key);
+  ThreadPool* executor = getExecutor(index);
+  queues_[index]->push(std::move(task), executor);
+}
+
+void Map::runOnShard(size_t index, std::function<void(Shard*)> task) const {
+  MT_REQUIRE_TRUE(shard_per_core_);
+  Shard* shard = shards_[index].get();
+  ThreadPool* executor = getExecutor(index);
+  if (current_executor == executor) {
+    // Called by the owner, e.g. from an asynchronous operation.
+    task(shard);
+    return;
+  }
+  const bool is_other_executor =
+      std::any_of(executors_.begin(), executors_.end(),
+                  [](const std::unique_ptr<ThreadPool>& executor) {
+                    return executor.get() == current_executor;
+                  });
+  // Waiting for another executor could deadlock if it waits for this one.
+  mt::Check::isFalse(is_other_executor,
+                     "Map: callables invoked in shard-per-core mode must only "
+                     "access keys of the same partition");
+  const auto promise = std::make_shared<std::promise<void> >();
+  auto future = promise->get_future();
+  queues_[index]->push(
+      [shard, &task, promise] {
+        try {
+          task(shard);
+          promise->set_value();
+        } catch (...) {
+          promise->set_exception(std::current_exception());
+        }
+      },
+      executor);
+  future.get();
+}
+
+std::unique_ptr<Cursor> Map::newShardCursor(size_t index,
+                                            Predicate select) const {
+  const std::shared_ptr<Cursor> cursor =
+      callOnShard<std::unique_ptr<Cursor> >(
+          index, [&select](Shard* shard) { return shard->newCursor(select); });
+  return std::unique_ptr<Cursor>(
+      new ShardCursor(cursor, [this, index, cursor] {
+        return callOnShard<bool>(
+            index, [&cursor](Shard*) { return cursor->next(); });
+      }));
 }
 
 }  // namespace multimap
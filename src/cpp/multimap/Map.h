@@ -22,10 +22,19 @@
 #ifndef MULTIMAP_MAP_H_
 #define MULTIMAP_MAP_H_
 
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>  // NOLINT
+#include <mutex>  // NOLINT
 #include <utility>
 #include <vector>
 #include "multimap/internal/Locks.h"
 #include "multimap/internal/Partition.h"
+#include "multimap/internal/TaskQueue.h"
+#include "multimap/Cursor.h"
+#include "multimap/ThreadPool.h"
+#include "multimap/WriteBatch.h"
 
 namespace multimap {
 
@@ -50,15 +59,84 @@ class Map {
 
   Map(const boost::filesystem::path& directory, const Options& options);
 
+  ~Map();
+  // Waits until all pending asynchronous operations have completed.
+
   void put(const Slice& key, const Slice& value);
 
   template <typename InputIter>
   void put(const Slice& key, InputIter begin, InputIter end) {
-    getPartition(key)->put(key, begin, end);
+    const size_t index = getPartitionIndex(key);
+    if (shard_per_core_) {
+      runOnShard(index, [&](Shard* shard) { shard->put(key, begin, end); });
+    } else {
+      partitions_[index]->put(key, begin, end);
+    }
   }
 
+  void write(const WriteBatch& batch);
+  // Applies all operations of `batch`. The operations are grouped by
+  // partition and key, so that each partition is locked only once per batch.
+  // Operations on the same key are applied in the order they were added.
+  // The batch as a whole is not atomic with respect to concurrent readers.
+
   std::unique_ptr<Iterator> get(const Slice& key) const;
 
+  bool contains(const Slice& key) const;
+
+  size_t count(const Slice& key) const;
+
+  void getMany(const std::vector<Slice>& keys, BinaryProcedure process) const;
+  // Looks up a batch of keys and calls `process` for each of them in order,
+  // with an empty iterator if a key is not present. Keys are grouped by
+  // partition, so that each partition is locked only once per batch.
+  // The lists are read from snapshots taken before the first call.
+  // A snapshot contains the values present when it was taken. Values that
+  // are removed afterwards may or may not be yielded by it.
+
+  std::vector<std::unique_ptr<Iterator> > getChunks(const Slice& key,
+                                                    size_t num_chunks) const;
+  // Divides a snapshot of the list associated with `key` into at most
+  // `num_chunks` consecutive chunks of roughly the same number of blocks and
+  // returns an iterator for each of them. The iterators can be consumed by
+  // different threads in parallel; visited one after another they yield the
+  // values in list order. The map must outlive the returned iterators.
+  // available() of each iterator is an upper bound for its own chunk, so the
+  // sum over all chunks may exceed the number of values in the list.
+
+  std::future<void> putAsync(const Slice& key, const Slice& value);
+
+  std::future<std::unique_ptr<Iterator> > getAsync(const Slice& key) const;
+
+  void getAsync(const Slice& key, BinaryProcedure process) const;
+
+  void getAsync(const Slice& key, BinaryProcedure process,
+                std::function<void(std::exception_ptr)> fail) const;
+
+  std::future<size_t> removeAsync(const Slice& key);
+  // The asynchronous operations copy their arguments and return immediately.
+  // They are executed by an internal thread pool that is started on first
+  // use. Operations on the same partition are executed in submission order
+  // and in batches, so that an operation observes the effects of all
+  // operations on the same key that were submitted before it.
+  // Exceptions are stored in the returned future. getAsync() yields an
+  // iterator over copies of the values, which are read by the pool thread,
+  // so that iterating them neither accesses the map nor waits for I/O. The
+  // callback variants call `process` from a pool thread with an iterator
+  // over a snapshot of the list. Exceptions thrown by the lookup or by
+  // `process` are passed to `fail`, also on a pool thread, or are logged if
+  // no `fail` is given.
+  // If the map was opened with `Options::shard_per_core`, each partition is
+  // owned by one of several single-threaded executors that are pinned to
+  // different CPUs. All operations, including the synchronous ones, are then
+  // executed by the owner of the partition, so that its data is only touched
+  // by that CPU and needs no locking. In combination with
+  // `Options::numa_aware` each executor is pinned to a CPU of the NUMA node
+  // its partitions are assigned to. In this mode get() returns an iterator
+  // over a snapshot of the list, and callables that are invoked by an
+  // executor, such as predicates or the callback of getAsync(), must only
+  // access keys of the same partition.
+
   size_t remove(const Slice& key);
 
   bool removeFirstEqual(const Slice& key, const Slice& value);
@@ -69,10 +147,15 @@ class Map {
 
   size_t removeFirstMatch(Predicate predicate);
 
+  size_t removeFirstMatch(Predicate predicate, ThreadPool* pool);
+
   size_t removeAllMatches(const Slice& key, Predicate predicate);
 
   std::pair<size_t, size_t> removeAllMatches(Predicate predicate);
 
+  std::pair<size_t, size_t> removeAllMatches(Predicate predicate,
+                                             ThreadPool* pool);
+
   bool replaceFirstEqual(const Slice& key, const Slice& old_value,
                          const Slice& new_value);
 
@@ -85,10 +168,47 @@ class Map {
 
   void forEachKey(Procedure process) const;
 
+  void forEachKey(Procedure process, ThreadPool* pool) const;
+
+  void forEachKey(Procedure process, ThreadPool* pool,
+                  const std::atomic<bool>* cancelled) const;
+
   void forEachValue(const Slice& key, Procedure process) const;
 
+  void forEachValue(const Slice& key, Procedure process,
+                    ThreadPool* pool) const;
+  // Visits the values of a single list in parallel using getChunks(), so
+  // that `process` may be invoked concurrently and must be thread-safe.
+  // The order in which the values are visited is unspecified.
+
   void forEachEntry(BinaryProcedure process) const;
 
+  void forEachEntry(BinaryProcedure process, ThreadPool* pool) const;
+
+  void forEachEntry(BinaryProcedure process, ThreadPool* pool,
+                    const std::atomic<bool>* cancelled) const;
+  // The overloads taking a thread pool scan the partitions in parallel.
+  // Callables may therefore be invoked concurrently from different threads
+  // and must be thread-safe. Setting `cancelled` to true, e.g. from within a
+  // callable, stops the scan after the keys currently being processed.
+  // forEachEntry() reads each list from a snapshot and therefore does not
+  // block concurrent writers, even when the scan takes a long time.
+
+  std::vector<Split> getSplits(size_t num_splits) const;
+  // Returns at least `num_splits` disjoint splits that together cover the
+  // entire map. Each partition is divided into the same number of key ranges.
+
+  std::unique_ptr<Cursor> newCursor(const Split& split) const;
+  // Returns a cursor over the entries of `split`. The set of keys is
+  // determined on creation, whereas each list is read from a snapshot taken
+  // when visited. The map must outlive the cursor.
+
+  int getNumaNode(const Slice& key) const;
+  // Returns the NUMA node the partition of `key` is assigned to, or -1 if
+  // the map was not opened with `Options::numa_aware` or the system has only
+  // one node. Callers can use this to route requests to threads that run on
+  // the same node, see internal::Numa::getCpus().
+
   std::vector<Stats> getStats() const;
 
   Stats getTotalStats() const;
@@ -121,12 +241,44 @@ class Map {
                        const Options& options);
 
  private:
+  typedef internal::BasicPartition<internal::NullLockPolicy> Shard;
+  // A partition that is owned by an executor in shard-per-core mode.
+
+  size_t getPartitionIndex(const Slice& key) const;
+
   internal::Partition* getPartition(const Slice& key);
 
   const internal::Partition* getPartition(const Slice& key) const;
 
+  ThreadPool* getExecutor(size_t index) const;
+
+  void pushAsync(const Slice& key, std::function<void()> task) const;
+
+  void runOnShard(size_t index, std::function<void(Shard*)> task) const;
+  // Executes `task` on the executor that owns the partition at `index` and
+  // waits for its completion. Exceptions are rethrown in the calling thread.
+
+  template <typename Result>
+  Result callOnShard(size_t index,
+                     std::function<Result(Shard*)> function) const {
+    Result result;
+    runOnShard(index, [&](Shard* shard) { result = function(shard); });
+    return result;
+  }
+
+  std::unique_ptr<Cursor> newShardCursor(size_t index,
+                                         Predicate select) const;
+
+  size_t num_partitions_ = 0;
   std::vector<std::unique_ptr<internal::Partition> > partitions_;
+  std::vector<std::unique_ptr<Shard> > shards_;
   internal::DirectoryLock dlock_;
+
+  mutable std::vector<std::unique_ptr<ThreadPool> > executors_;
+  mutable std::vector<std::unique_ptr<internal::TaskQueue> > queues_;
+  mutable std::once_flag executors_started_;
+  size_t num_numa_nodes_ = 1;
+  bool shard_per_core_ = false;
 };
 
 }  // namespace multimap
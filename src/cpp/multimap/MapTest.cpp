@@ -15,9 +15,18 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <deque>
+#include <future>  // NOLINT
+#include <mutex>  // NOLINT
+#include <set>
+#include <string>
+#include <thread>  // NOLINT
 #include <type_traits>
 #include <boost/filesystem/operations.hpp>  // NOLINT
 #include "gmock/gmock.h"
+#include "multimap/internal/Numa.h"
 #include "multimap/Map.h"
 
 namespace multimap {
@@ -192,7 +201,7 @@ TEST_P(MapTestWithParam, GetTotalStatsReturnsCorrectValuesAfterRemovingKeys) {
     num_values_removed += result.second;
 
     stats_backup = map->getTotalStats();
-    ASSERT_THAT(stats_backup.num_keys_total, Eq(GetParam()));
+    ASSERT_THAT(stats_backup.num_keys_total, Eq(GetParam() - num_keys_removed));
     ASSERT_THAT(stats_backup.num_keys_valid, Eq(GetParam() - num_keys_removed));
 
     const auto exp_num_values_total = GetParam() * GetParam();
@@ -239,10 +248,587 @@ TEST_P(MapTestWithParam, GetTotalStatsReturnsCorrectValuesAfterRemovingValues) {
   ASSERT_THAT(stats.num_values_valid, Eq(stats_backup.num_values_valid));
 }
 
+TEST_P(MapTestWithParam, ParallelForEachKeyVisitsAllKeys) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  ThreadPool pool(4);
+  std::mutex mutex;
+  std::set<std::string> keys;
+  map->forEachKey(
+      [&](const Slice& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        keys.insert(key.toString());
+      },
+      &pool);
+  ASSERT_THAT(keys.size(), Eq(GetParam()));
+
+  std::atomic<size_t> num_values(0);
+  map->forEachEntry(
+      [&](const Slice&, Iterator* iter) { num_values += iter->available(); },
+      &pool);
+  ASSERT_THAT(num_values.load(), Eq(GetParam()));
+}
+
+TEST_P(MapTestWithParam, ParallelForEachValueVisitsAllValuesOfKey) {
+  auto map = openOrCreateMap(directory);
+  for (auto v = 0; v != GetParam(); ++v) {
+    map->put("key", std::to_string(v));
+  }
+  ThreadPool pool(4);
+  std::atomic<size_t> sum(0);
+  map->forEachValue(
+      "key", [&](const Slice& value) { sum += std::stoi(value.toString()); },
+      &pool);
+  ASSERT_THAT(sum.load(), Eq(GetParam() * (GetParam() - 1) / 2));
+
+  int expected = 0;
+  for (const auto& chunk : map->getChunks("key", pool.size())) {
+    while (chunk->hasNext()) {
+      ASSERT_THAT(chunk->next(), Eq(std::to_string(expected++)));
+    }
+  }
+  ASSERT_THAT(expected, Eq(GetParam()));
+}
+
+TEST_P(MapTestWithParam, ParallelForEachEntryStopsWhenCancelled) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  ThreadPool pool(4);
+  std::atomic<bool> cancelled(false);
+  std::atomic<int> num_keys(0);
+  map->forEachEntry(
+      [&](const Slice&, Iterator*) {
+        ++num_keys;
+        cancelled = true;
+      },
+      &pool, &cancelled);
+  // Each thread processes at most one key after the flag has been set.
+  ASSERT_LE(num_keys.load(), std::min<int>(GetParam(), pool.size() + 1));
+}
+
+TEST_P(MapTestWithParam, ParallelRemoveFirstMatchRemovesOneKey) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  ThreadPool pool(4);
+  const auto expected = GetParam() ? 2 : 0;
+  ASSERT_THAT(map->removeFirstMatch(TRUE_PREDICATE, &pool), Eq(expected));
+  ASSERT_THAT(map->getTotalStats().num_values_valid,
+              Eq(GetParam() * 2 - expected));
+}
+
+TEST_P(MapTestWithParam, ParallelRemoveAllMatchesRemovesAllMatchingKeys) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  ThreadPool pool(4);
+  const auto result = map->removeAllMatches(IS_ODD, &pool);
+  ASSERT_THAT(result.first, Eq(GetParam() / 2));
+  ASSERT_THAT(result.second, Eq(GetParam() / 2));
+  ASSERT_THAT(map->getTotalStats().num_keys_valid,
+              Eq(GetParam() - GetParam() / 2));
+}
+
+TEST_P(MapTestWithParam, CursorsOverSplitsVisitEachEntryOnce) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  map->remove(std::to_string(0));
+
+  const auto splits = map->getSplits(100);
+  ASSERT_GE(splits.size(), 100);
+  std::multiset<std::string> keys;
+  for (const auto& split : splits) {
+    auto cursor = map->newCursor(split);
+    while (cursor->next()) {
+      keys.insert(cursor->key().toString());
+      ASSERT_THAT(cursor->values()->available(), Eq(2));
+      ASSERT_THAT(cursor->values()->next(), Eq(cursor->key()));
+    }
+    ASSERT_FALSE(cursor->next());
+  }
+  ASSERT_THAT(keys.size(), Eq(GetParam() ? GetParam() - 1 : 0));
+  for (auto k = 1; k < GetParam(); ++k) {
+    ASSERT_THAT(keys.count(std::to_string(k)), Eq(1));
+  }
+}
+
+TEST_P(MapTestWithParam, ContainsAndCountReturnCorrectValues) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    for (auto v = 0; v <= k % 3; ++v) {
+      map->put(std::to_string(k), std::to_string(v));
+    }
+  }
+  map->remove(std::to_string(0));
+  for (auto k = 1; k < GetParam(); ++k) {
+    ASSERT_TRUE(map->contains(std::to_string(k)));
+    ASSERT_THAT(map->count(std::to_string(k)), Eq(k % 3 + 1));
+  }
+  ASSERT_FALSE(map->contains(std::to_string(0)));
+  ASSERT_FALSE(map->contains(std::to_string(GetParam())));
+  ASSERT_THAT(map->count(std::to_string(GetParam())), Eq(0));
+}
+
+TEST_P(MapTestWithParam, GetManyVisitsEachKeyInOrder) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    for (auto v = 0; v <= k % 3; ++v) {
+      map->put(std::to_string(k), std::to_string(v));
+    }
+  }
+  std::vector<std::string> strings;
+  for (auto k = GetParam(); k >= 0; --k) {
+    strings.push_back(std::to_string(k));  // The first key does not exist.
+  }
+  const std::vector<Slice> keys(strings.begin(), strings.end());
+  size_t i = 0;
+  map->getMany(keys, [&](const Slice& key, Iterator* iter) {
+    ASSERT_THAT(key, Eq(keys[i]));
+    const int k = std::stoi(key.toString());
+    ASSERT_THAT(iter->available(), Eq(k == GetParam() ? 0 : k % 3 + 1));
+    for (auto v = 0; iter->hasNext(); ++v) {
+      ASSERT_THAT(iter->next(), Eq(std::to_string(v)));
+    }
+    ++i;
+  });
+  ASSERT_THAT(i, Eq(keys.size()));
+}
+
+TEST_P(MapTestWithParam, AsyncOperationsOnSameKeyAreAppliedInOrder) {
+  auto map = openOrCreateMap(directory);
+  std::vector<std::future<void> > puts;
+  for (auto k = 0; k != GetParam(); ++k) {
+    for (auto v = 0; v <= k % 3; ++v) {
+      puts.push_back(map->putAsync(std::to_string(k), std::to_string(v)));
+    }
+  }
+  std::vector<std::future<std::unique_ptr<Iterator> > > gets;
+  std::vector<std::future<size_t> > removes;
+  for (auto k = 0; k != GetParam(); ++k) {
+    gets.push_back(map->getAsync(std::to_string(k)));
+    removes.push_back(map->removeAsync(std::to_string(k)));
+  }
+  for (auto& future : puts) {
+    future.get();
+  }
+  for (auto k = 0; k != GetParam(); ++k) {
+    const auto iter = gets[k].get();
+    ASSERT_THAT(iter->available(), Eq(k % 3 + 1));
+    for (auto v = 0; iter->hasNext(); ++v) {
+      ASSERT_THAT(iter->next(), Eq(std::to_string(v)));
+    }
+    ASSERT_THAT(removes[k].get(), Eq(k % 3 + 1));
+    ASSERT_FALSE(map->contains(std::to_string(k)));
+  }
+}
+
+TEST_P(MapTestWithParam, GetAsyncWithCallbackVisitsEachKey) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  std::mutex mutex;
+  std::set<std::string> keys;
+  for (auto k = 0; k <= GetParam(); ++k) {
+    map->getAsync(std::to_string(k), [&](const Slice& key, Iterator* iter) {
+      if (key == std::to_string(GetParam())) {
+        ASSERT_FALSE(iter->hasNext());  // Does not exist.
+      } else {
+        ASSERT_THAT(iter->next(), Eq(key));
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      keys.insert(key.toString());
+    });
+  }
+  map.reset();  // Waits for pending operations.
+  ASSERT_THAT(keys.size(), Eq(GetParam() + 1));
+}
+
+TEST_F(MapTestFixture, GetAsyncReturnsIteratorIndependentOfStore) {
+  // Most values are flushed to the store, whose mapping goes away with the
+  // map, so that the iterator must not point into it.
+  const int num_values = 10000;
+  auto map = openOrCreateMap(directory);
+  for (int v = 0; v != num_values; ++v) {
+    map->put("key", std::to_string(v));
+  }
+  auto future = map->getAsync("key");
+  const auto iter = future.get();
+  map.reset();
+  ASSERT_THAT(iter->available(), Eq(num_values));
+  for (int v = 0; v != num_values; ++v) {
+    ASSERT_THAT(iter->next(), Eq(std::to_string(v)));
+  }
+  ASSERT_FALSE(iter->hasNext());
+}
+
+TEST_F(MapTestFixture, GetAsyncWithCallbackPassesExceptionsToHandler) {
+  auto map = openOrCreateMap(directory);
+  map->put("key", "value");
+  std::promise<std::string> error;
+  map->getAsync("key",
+                [](const Slice&, Iterator*) {
+                  throw std::runtime_error("failed");
+                },
+                [&error](std::exception_ptr exception) {
+                  try {
+                    std::rethrow_exception(exception);
+                  } catch (const std::runtime_error& e) {
+                    error.set_value(e.what());
+                  }
+                });
+  ASSERT_THAT(error.get_future().get(), Eq("failed"));
+}
+
+TEST_P(MapTestWithParam, WriteAppliesBatchOfPutsAndRemoves) {
+  auto map = openOrCreateMap(directory);
+  for (auto k = 0; k != GetParam(); ++k) {
+    map->put(std::to_string(k), "old");
+  }
+  WriteBatch batch;
+  for (auto k = 0; k != GetParam(); ++k) {
+    if (k % 2 == 0) batch.remove(std::to_string(k));
+    for (auto v = 0; v <= k % 3; ++v) {
+      batch.put(std::to_string(k), std::to_string(v));
+    }
+    if (k % 5 == 0) batch.remove(std::to_string(k));
+  }
+  map->write(batch);
+  for (auto k = 0; k != GetParam(); ++k) {
+    auto iter = map->get(std::to_string(k));
+    if (k % 5 == 0) {
+      ASSERT_FALSE(iter->hasNext());
+      continue;
+    }
+    ASSERT_THAT(iter->available(), Eq(k % 3 + 1 + k % 2));
+    if (k % 2 == 1) {
+      ASSERT_THAT(iter->next(), Eq("old"));
+    }
+    for (auto v = 0; iter->hasNext(); ++v) {
+      ASSERT_THAT(iter->next(), Eq(std::to_string(v)));
+    }
+  }
+}
+
 INSTANTIATE_TEST_CASE_P(Parameterized, MapTestWithParam,
                         testing::Values(0, 1, 2, 10, 100, 1000));
 
 // INSTANTIATE_TEST_CASE_P(ParameterizedLongRunning, MapTestWithParam,
 //                         testing::Values(10000, 100000));
 
+TEST_F(MapTestFixture, NumaAwareMapAssignsPartitionsToNodes) {
+  Options options;
+  options.create_if_missing = true;
+  options.numa_aware = true;
+  options.shard_per_core = true;
+  Map map(directory, options);
+  const int num_nodes = internal::Numa::getNumNodes();
+  for (int k = 0; k != 100; ++k) {
+    const int node = map.getNumaNode(std::to_string(k));
+    if (num_nodes == 1) {
+      ASSERT_THAT(node, Eq(-1));
+    } else {
+      ASSERT_GE(node, 0);
+      ASSERT_LT(node, num_nodes);
+    }
+    map.putAsync(std::to_string(k), std::to_string(k)).get();
+    ASSERT_TRUE(map.contains(std::to_string(k)));
+  }
+}
+
+TEST_F(MapTestFixture, AsyncOperationsInShardPerCoreMode) {
+  Options options;
+  options.create_if_missing = true;
+  options.shard_per_core = true;
+  Map map(directory, options);
+  std::vector<std::future<void> > puts;
+  for (int k = 0; k != 1000; ++k) {
+    puts.push_back(map.putAsync(std::to_string(k), std::to_string(k)));
+  }
+  std::vector<std::future<size_t> > removes;
+  for (int k = 0; k < 1000; k += 2) {
+    removes.push_back(map.removeAsync(std::to_string(k)));
+  }
+  for (auto& future : puts) {
+    future.get();
+  }
+  for (auto& future : removes) {
+    ASSERT_THAT(future.get(), Eq(1));
+  }
+  for (int k = 0; k != 1000; ++k) {
+    ASSERT_THAT(map.getAsync(std::to_string(k)).get()->available(),
+                Eq(k % 2));
+  }
+}
+
+TEST_F(MapTestFixture, SynchronousOperationsInShardPerCoreMode) {
+  Options options;
+  options.create_if_missing = true;
+  options.shard_per_core = true;
+  {
+    Map map(directory, options);
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t) {
+      threads.emplace_back([&map, t] {
+        for (int k = t; k < 1000; k += 4) {
+          map.put(std::to_string(k), "a");
+          map.put(std::to_string(k), "b");
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (int k = 0; k < 1000; k += 2) {
+      ASSERT_THAT(map.remove(std::to_string(k)), Eq(2));
+    }
+    ASSERT_TRUE(map.replaceFirstEqual("1", "a", "c"));
+    ASSERT_THAT(map.count("1"), Eq(2));
+    ASSERT_FALSE(map.contains("0"));
+
+    // The iterators are snapshots that are read by the calling thread.
+    const auto iter = map.get("1");
+    map.put("1", "d");
+    ASSERT_THAT(iter->available(), Eq(2));
+    ASSERT_THAT(map.get("1")->available(), Eq(3));
+
+    size_t num_keys = 0;
+    map.forEachKey([&num_keys](const Slice&) { ++num_keys; });
+    ASSERT_THAT(num_keys, Eq(500));
+    size_t num_values = 0;
+    map.forEachEntry([&](const Slice& key, Iterator* iter) {
+      // The callback runs in the calling thread and may use the map.
+      ASSERT_THAT(map.count(key), Eq(iter->available()));
+      num_values += iter->available();
+    });
+    ASSERT_THAT(num_values, Eq(1001));
+    ASSERT_THAT(map.getTotalStats().num_values_valid, Eq(1001));
+
+    // Callables run by the owner of a partition may use keys of that
+    // partition.
+    std::promise<size_t> count;
+    map.getAsync("1", [&map, &count](const Slice& key, Iterator*) {
+      count.set_value(map.count(key));
+    });
+    ASSERT_THAT(count.get_future().get(), Eq(3));
+  }
+  options.shard_per_core = false;
+  Map map(directory, options);
+  ASSERT_THAT(map.getTotalStats().num_values_valid, Eq(1001));
+}
+
+#ifdef MULTIMAP_SINGLE_THREADED
+
+TEST_F(MapTestFixture, ParallelAndAsynchronousOperationsThrow) {
+  auto map = openOrCreateMap(directory);
+  ThreadPool pool(2);
+  const auto process = [](const Slice&) {};
+  ASSERT_THROW(map->forEachKey(process, &pool), std::runtime_error);
+  ASSERT_THROW(map->forEachValue("k", process, &pool), std::runtime_error);
+  ASSERT_THROW(map->putAsync("k", "v"), std::runtime_error);
+  ASSERT_THROW(map->removeAsync("k"), std::runtime_error);
+  map->forEachKey(process);
+}
+
+#endif  // MULTIMAP_SINGLE_THREADED
+
+#ifdef MULTIMAP_RUN_LARGE_TESTS
+
+TEST_F(MapTestFixture, GetManyLatencyForDifferentBatchSizes) {
+  const int num_keys = 1000000;
+  auto map = openOrCreateMap(directory);
+  for (int k = 0; k != num_keys; ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  std::vector<std::string> strings;
+  for (int k = 0; k != 1024; ++k) {
+    strings.push_back(std::to_string((k * 7919) % num_keys));
+  }
+  const std::vector<Slice> all_keys(strings.begin(), strings.end());
+  const int num_rounds = 100;
+  for (size_t batch_size = 1; batch_size <= 1024; batch_size *= 2) {
+    const std::vector<Slice> keys(all_keys.begin(),
+                                  all_keys.begin() + batch_size);
+    size_t num_values = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r != num_rounds; ++r) {
+      for (const Slice& key : keys) {
+        num_values += map->get(key)->available();
+      }
+    }
+    const auto get_duration = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r != num_rounds; ++r) {
+      map->getMany(keys, [&num_values](const Slice&, Iterator* iter) {
+        num_values -= iter->available();
+      });
+    }
+    const auto get_many_duration = std::chrono::steady_clock::now() - start;
+    ASSERT_THAT(num_values, Eq(0));
+    const auto micros = [num_rounds](std::chrono::nanoseconds duration) {
+      return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+                 .count() / static_cast<double>(num_rounds);
+    };
+    mt::log() << "Batch size " << batch_size << ": get() "
+              << micros(get_duration) << " us, getMany() "
+              << micros(get_many_duration) << " us\n";
+  }
+}
+
+TEST_F(MapTestFixture, CountAndForEachValueLatencyComparedToGet) {
+  const int num_keys = 1000000;
+  auto map = openOrCreateMap(directory);
+  for (int k = 0; k != num_keys; ++k) {
+    map->put(std::to_string(k), std::to_string(k));
+  }
+  const auto micros_since = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start).count();
+  };
+  size_t num_values = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k != num_keys; ++k) {
+    num_values += map->get(std::to_string(k))->available();
+  }
+  mt::log() << "get()->available() " << micros_since(start) << " us\n";
+  start = std::chrono::steady_clock::now();
+  for (int k = 0; k != num_keys; ++k) {
+    num_values -= map->count(std::to_string(k));
+  }
+  mt::log() << "count() " << micros_since(start) << " us\n";
+  ASSERT_THAT(num_values, Eq(0));
+
+  start = std::chrono::steady_clock::now();
+  for (int k = 0; k != num_keys; ++k) {
+    auto iter = map->get(std::to_string(k));
+    while (iter->hasNext()) {
+      num_values += iter->next().size();
+    }
+  }
+  mt::log() << "get() and iterate " << micros_since(start) << " us\n";
+  start = std::chrono::steady_clock::now();
+  for (int k = 0; k != num_keys; ++k) {
+    map->forEachValue(std::to_string(k), [&num_values](const Slice& value) {
+      num_values -= value.size();
+    });
+  }
+  mt::log() << "forEachValue() " << micros_since(start) << " us\n";
+  ASSERT_THAT(num_values, Eq(0));
+}
+
+TEST_F(MapTestFixture, ThroughputAndTailLatencyOfLockingAndShardedModes) {
+  // Each client thread alternately puts and gets random keys. In locking
+  // mode the calls are made directly, in shard-per-core mode they are sent
+  // to the partition owners with up to 64 requests in flight per client.
+  typedef std::chrono::steady_clock Clock;
+  const int num_ops_per_thread = 100000;
+  const size_t max_in_flight = 64;
+  for (const bool sharded : {false, true}) {
+    for (const int num_threads : {1, 4, 16, 64}) {
+      boost::filesystem::remove_all(directory);
+      boost::filesystem::create_directory(directory);
+      Options options;
+      options.create_if_missing = true;
+      options.shard_per_core = sharded;
+      Map map(directory, options);
+      std::vector<std::vector<int64_t> > latencies(num_threads);
+      std::vector<std::thread> threads;
+      const auto start = Clock::now();
+      for (int t = 0; t != num_threads; ++t) {
+        threads.emplace_back([&, t] {
+          std::deque<std::pair<std::future<void>, Clock::time_point> > puts;
+          const auto record = [&](Clock::time_point begin) {
+            latencies[t].push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - begin).count());
+          };
+          for (int i = 0; i != num_ops_per_thread; ++i) {
+            const std::string key = std::to_string((i * 7919 + t) % 100000);
+            const auto begin = Clock::now();
+            if (!sharded) {
+              if (i % 2) {
+                map.put(key, key);
+              } else {
+                map.get(key)->available();
+              }
+              record(begin);
+              continue;
+            }
+            if (i % 2) {
+              puts.emplace_back(map.putAsync(key, key), begin);
+            } else {
+              map.getAsync(key, [](const Slice&, Iterator* iter) {
+                iter->available();
+              });
+            }
+            if (puts.size() == max_in_flight) {
+              puts.front().first.get();
+              record(puts.front().second);
+              puts.pop_front();
+            }
+          }
+          for (auto& put : puts) {
+            put.first.get();
+            record(put.second);
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      const double seconds =
+          std::chrono::duration<double>(Clock::now() - start).count();
+      std::vector<int64_t> all;
+      for (const auto& thread_latencies : latencies) {
+        all.insert(all.end(), thread_latencies.begin(),
+                   thread_latencies.end());
+      }
+      std::sort(all.begin(), all.end());
+      mt::log() << (sharded ? "Sharded" : "Locking") << " with "
+                << num_threads << " threads: "
+                << num_threads * num_ops_per_thread / seconds
+                << " ops/s, p50 " << all[all.size() / 2] / 1000.0
+                << " us, p99 " << all[all.size() * 99 / 100] / 1000.0
+                << " us, p99.9 " << all[all.size() * 999 / 1000] / 1000.0
+                << " us\n";
+    }
+  }
+}
+
+TEST_F(MapTestFixture, SingleThreadedImportThroughput) {
+  // Compare the results of builds with and without MULTIMAP_SINGLE_THREADED.
+  const int num_keys = 1000000;
+  const int num_values_per_key = 5;
+  auto map = openOrCreateMap(directory);
+  const auto start = std::chrono::steady_clock::now();
+  for (int v = 0; v != num_values_per_key; ++v) {
+    for (int k = 0; k != num_keys; ++k) {
+      map->put(std::to_string(k), std::to_string(v));
+    }
+  }
+  const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start).count();
+#ifdef MULTIMAP_SINGLE_THREADED
+  const char* mode = "without locking";
+#else
+  const char* mode = "with locking";
+#endif
+  mt::log() << "Imported " << num_keys * num_values_per_key << " values "
+            << mode << " in " << millis << " ms\n";
+  ASSERT_THAT(map->getTotalStats().num_values_total,
+              Eq(num_keys * num_values_per_key));
+}
+
+#endif  // MULTIMAP_RUN_LARGE_TESTS
+
 }  // namespace multimap
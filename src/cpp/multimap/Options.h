@@ -29,11 +29,25 @@ namespace multimap {
 struct Options {
   size_t block_size = 512;
   size_t num_partitions = 23;
+  size_t max_build_memory = 1 << 30;
+  size_t fingerprint_bits = 0;
+  size_t inline_list_bytes = 0;
+  size_t min_compressed_list_size = 512;
+  size_t max_list_cache_memory = 1 << 20;
+  size_t key_index_block_size = 4096;
+  size_t min_indexed_list_size = 1024;
 
   bool create_if_missing = false;
   bool error_if_exists = false;
   bool readonly = false;
   bool verbose = true;
+  bool shard_per_core = false;
+  bool numa_aware = false;
+  bool huge_pages = false;
+  bool compact_offsets = false;
+  bool compress_lists = false;
+  bool sorted_keys = false;
+  bool index_lists = false;
 
   Compare compare;
   Filter filter;
@@ -18,9 +18,11 @@
 #include "multimap/Stats.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <string>
 #include <vector>
 #include "multimap/thirdparty/mt/assert.h"
+#include "multimap/thirdparty/mt/check.h"
 #include "multimap/thirdparty/mt/common.h"
 #include "multimap/thirdparty/mt/fileio.h"
 
@@ -32,7 +34,8 @@ const std::vector<std::string>& Stats::names() {
       "key_size_min",   "list_size_avg",    "list_size_max",
       "list_size_min",  "num_blocks",       "num_keys_total",
       "num_keys_valid", "num_values_total", "num_values_valid",
-      "num_partitions"};
+      "num_partitions", "num_bytes_reclaimed", "num_values_combined",
+      "build_time_ms",  "build_memory_max"};
   return names;
 }
 
@@ -61,6 +64,11 @@ Stats Stats::total(const std::vector<Stats>& stats) {
     total.num_keys_valid += stat.num_keys_valid;
     total.num_values_total += stat.num_values_total;
     total.num_values_valid += stat.num_values_valid;
+    total.num_bytes_reclaimed += stat.num_bytes_reclaimed;
+    total.num_values_combined += stat.num_values_combined;
+    total.build_time_ms += stat.build_time_ms;
+    total.build_memory_max =
+        std::max(total.build_memory_max, stat.build_memory_max);
   }
   if (total.num_keys_valid != 0) {
     double key_size_avg = 0;
@@ -98,6 +106,13 @@ Stats Stats::max(const std::vector<Stats>& stats) {
         std::max(max.num_values_total, stat.num_values_total);
     max.num_values_valid =
         std::max(max.num_values_valid, stat.num_values_valid);
+    max.num_bytes_reclaimed =
+        std::max(max.num_bytes_reclaimed, stat.num_bytes_reclaimed);
+    max.num_values_combined =
+        std::max(max.num_values_combined, stat.num_values_combined);
+    max.build_time_ms = std::max(max.build_time_ms, stat.build_time_ms);
+    max.build_memory_max =
+        std::max(max.build_memory_max, stat.build_memory_max);
   }
   return max;
 }
@@ -105,7 +120,12 @@ Stats Stats::max(const std::vector<Stats>& stats) {
 Stats Stats::readFromFile(const boost::filesystem::path& file_path) {
   Stats stats;
   mt::InputStream istream = mt::newFileInputStream(file_path);
-  mt::readAll(istream.get(), &stats, sizeof stats);
+  // Files written by version 0.6.0 end with `num_partitions`.
+  // Fields that have been appended later on remain zero in that case.
+  const size_t min_size = offsetof(Stats, num_bytes_reclaimed);
+  istream->read(reinterpret_cast<char*>(&stats), sizeof stats);
+  mt::Check::isGreaterEqual(static_cast<size_t>(istream->gcount()), min_size,
+                            "Stats: file is truncated: %s", file_path.c_str());
   return stats;
 }
 
@@ -115,10 +135,12 @@ void Stats::writeToFile(const boost::filesystem::path& file_path) const {
 }
 
 std::vector<uint64_t> Stats::toVector() const {
-  return {block_size,     key_size_avg,   key_size_max,     key_size_min,
-          list_size_avg,  list_size_max,  list_size_min,    num_blocks,
-          num_keys_total, num_keys_valid, num_values_total, num_values_valid,
-          num_partitions};
+  return {block_size,     key_size_avg,        key_size_max,
+          key_size_min,   list_size_avg,       list_size_max,
+          list_size_min,  num_blocks,          num_keys_total,
+          num_keys_valid, num_values_total,    num_values_valid,
+          num_partitions, num_bytes_reclaimed, num_values_combined,
+          build_time_ms,  build_memory_max};
 }
 
 }  // namespace multimap
@@ -45,6 +45,10 @@ struct Stats {
   uint64_t num_values_total = 0;
   uint64_t num_values_valid = 0;
   uint64_t num_partitions = 0;
+  uint64_t num_bytes_reclaimed = 0;
+  uint64_t num_values_combined = 0;
+  uint64_t build_time_ms = 0;
+  uint64_t build_memory_max = 0;
 
   static const std::vector<std::string>& names();
 
@@ -61,7 +65,7 @@ struct Stats {
   Stats() = default;
 };
 
-MT_STATIC_ASSERT_SIZEOF(Stats, 104, 104);
+MT_STATIC_ASSERT_SIZEOF(Stats, 136, 136);
 
 }  // namespace multimap
 
@@ -0,0 +1,153 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "multimap/ThreadPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include "multimap/thirdparty/mt/assert.h"
+
+namespace multimap {
+
+namespace {
+
+struct ParallelForState {
+  std::function<void(size_t)> task;
+  size_t num_tasks = 0;
+  std::atomic<size_t> next_index;
+  std::atomic<bool> failed;
+  std::exception_ptr exception;
+  size_t num_completed = 0;
+  std::condition_variable cond;
+  std::mutex mutex;
+
+  ParallelForState() : next_index(0), failed(false) {}
+
+  void work() {
+    // Runs until all indices have been claimed.
+    size_t index;
+    while ((index = next_index++) < num_tasks) {
+      if (!failed) {
+        try {
+          task(index);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!exception) exception = std::current_exception();
+          failed = true;
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (++num_completed == num_tasks) cond.notify_all();
+    }
+  }
+};
+
+}  // namespace
+
+ThreadPool::ThreadPool() : ThreadPool(std::thread::hardware_concurrency()) {}
+
+ThreadPool::ThreadPool(size_t num_threads) {
+  if (num_threads == 0) num_threads = 1;
+  for (size_t i = 0; i != num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::run, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  cond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  MT_REQUIRE_TRUE(task);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MT_ASSERT_FALSE(stopped_);
+    tasks_.push_back(std::move(task));
+  }
+  cond_.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t num_tasks,
+                             std::function<void(size_t)> task) {
+  if (num_tasks == 0) return;
+
+  // The state is shared with the helper tasks, which may be executed after
+  // this function has returned in case the calling thread did all the work.
+  const auto state = std::make_shared<ParallelForState>();
+  state->task = std::move(task);
+  state->num_tasks = num_tasks;
+  const size_t num_helpers = std::min(num_tasks - 1, threads_.size());
+  for (size_t i = 0; i != num_helpers; ++i) {
+    submit([state] { state->work(); });
+  }
+  state->work();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cond.wait(lock, [&state] {
+    return state->num_completed == state->num_tasks;
+  });
+  if (state->exception) {
+    std::rethrow_exception(state->exception);
+  }
+}
+
+bool ThreadPool::pinToCpus(size_t first_cpu) {
+#ifdef __linux__
+  const size_t num_cpus = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i != threads_.size(); ++i) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET((first_cpu + i) % num_cpus, &cpu_set);
+    if (pthread_setaffinity_np(threads_[i].native_handle(), sizeof cpu_set,
+                               &cpu_set) != 0) {
+      return false;
+    }
+  }
+  return true;
+#else
+  (void)first_cpu;
+  return false;
+#endif
+}
+
+void ThreadPool::run() {
+  std::function<void()> task;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return stopped_ || !tasks_.empty(); });
+      if (tasks_.empty()) break;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+}  // namespace multimap
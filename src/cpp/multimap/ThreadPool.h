@@ -0,0 +1,80 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// -----------------------------------------------------------------------------
+// Documentation:  https://multimap.io/cppreference/#threadpoolhpp
+// -----------------------------------------------------------------------------
+
+#ifndef MULTIMAP_THREADPOOL_H_
+#define MULTIMAP_THREADPOOL_H_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace multimap {
+
+class ThreadPool {
+  // A fixed number of worker threads that execute submitted tasks in FIFO
+  // order. A thread pool can be passed to the parallel scan functions of Map
+  // and ImmutableMap and may be shared by any number of such calls.
+
+ public:
+  ThreadPool();
+  // Creates a pool with one thread per hardware thread.
+
+  explicit ThreadPool(size_t num_threads);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool();
+  // Waits until all submitted tasks have been executed.
+
+  void submit(std::function<void()> task);
+  // Schedules `task` for execution by one of the worker threads.
+  // The task must not throw.
+
+  void parallelFor(size_t num_tasks, std::function<void(size_t)> task);
+  // Calls `task(i)` for each i in [0, num_tasks) and returns when all calls
+  // have completed. The calls are distributed among the worker threads and
+  // the calling thread, which also makes nested invocations deadlock-free.
+  // If a call throws, pending calls are skipped and the first exception is
+  // rethrown in the calling thread.
+
+  bool pinToCpus(size_t first_cpu);
+  // Binds the i-th worker thread to CPU (first_cpu + i) modulo the number of
+  // CPUs. Returns false if thread affinity is not supported by the platform.
+
+  size_t size() const { return threads_.size(); }
+
+ private:
+  void run();
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()> > tasks_;
+  std::condition_variable cond_;
+  std::mutex mutex_;
+  bool stopped_ = false;
+};
+
+}  // namespace multimap
+
+#endif  // MULTIMAP_THREADPOOL_H_
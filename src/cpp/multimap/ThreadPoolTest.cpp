@@ -0,0 +1,97 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "gmock/gmock.h"
+#include "multimap/ThreadPool.h"
+
+namespace multimap {
+
+using testing::Each;
+using testing::Eq;
+
+TEST(ThreadPoolTest, IsDefaultConstructible) {
+  ASSERT_TRUE(std::is_default_constructible<ThreadPool>::value);
+}
+
+TEST(ThreadPoolTest, IsNotCopyConstructibleOrAssignable) {
+  ASSERT_FALSE(std::is_copy_constructible<ThreadPool>::value);
+  ASSERT_FALSE(std::is_copy_assignable<ThreadPool>::value);
+}
+
+TEST(ThreadPoolTest, ConstructedWithZeroThreadsHasOneThread) {
+  ASSERT_THAT(ThreadPool(0).size(), Eq(1));
+  ASSERT_THAT(ThreadPool(4).size(), Eq(4));
+}
+
+TEST(ThreadPoolTest, DestructorWaitsForSubmittedTasks) {
+  std::atomic<int> counter(0);
+  {
+    ThreadPool pool(2);
+    for (int i = 0; i != 100; ++i) {
+      pool.submit([&counter] { ++counter; });
+    }
+  }
+  ASSERT_THAT(counter.load(), Eq(100));
+}
+
+TEST(ThreadPoolTest, ParallelForCallsEachIndexOnce) {
+  ThreadPool pool(3);
+  std::vector<std::atomic<int> > calls(1000);
+  for (auto& count : calls) {
+    count = 0;
+  }
+  pool.parallelFor(calls.size(), [&calls](size_t i) { ++calls[i]; });
+  for (const auto& count : calls) {
+    ASSERT_THAT(count.load(), Eq(1));
+  }
+}
+
+TEST(ThreadPoolTest, ParallelForCanBeNested) {
+  ThreadPool pool(2);
+  std::atomic<int> counter(0);
+  pool.parallelFor(10, [&](size_t) {
+    pool.parallelFor(10, [&](size_t) { ++counter; });
+  });
+  ASSERT_THAT(counter.load(), Eq(100));
+}
+
+TEST(ThreadPoolTest, ParallelForRethrowsException) {
+  ThreadPool pool(2);
+  ASSERT_THROW(pool.parallelFor(100,
+                                [](size_t i) {
+                                  if (i == 42) throw std::runtime_error("");
+                                }),
+               std::runtime_error);
+}
+
+TEST(ThreadPoolTest, PinnedThreadsExecuteSubmittedTasks) {
+  std::atomic<int> counter(0);
+  {
+    ThreadPool pool(2);
+    pool.pinToCpus(0);  // May fail if the process is restricted to some CPUs.
+    for (int i = 0; i != 100; ++i) {
+      pool.submit([&counter] { ++counter; });
+    }
+  }
+  ASSERT_THAT(counter.load(), Eq(100));
+}
+
+}  // namespace multimap
@@ -0,0 +1,49 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "multimap/WriteBatch.h"
+
+namespace multimap {
+
+namespace {
+
+Slice makeCopy(const Slice& slice, Arena* arena) {
+  return slice.empty() ? Slice() : slice.makeCopy(arena);
+}
+
+}  // namespace
+
+void WriteBatch::put(const Slice& key, const Slice& value) {
+  Operation operation;
+  operation.key = makeCopy(key, &arena_);
+  operation.value = makeCopy(value, &arena_);
+  operations_.push_back(operation);
+}
+
+void WriteBatch::remove(const Slice& key) {
+  Operation operation;
+  operation.key = makeCopy(key, &arena_);
+  operation.is_remove = true;
+  operations_.push_back(operation);
+}
+
+void WriteBatch::clear() {
+  operations_.clear();
+  arena_.deallocateAll();
+}
+
+}  // namespace multimap
@@ -0,0 +1,71 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// -----------------------------------------------------------------------------
+// Documentation:  https://multimap.io/cppreference/#writebatchhpp
+// -----------------------------------------------------------------------------
+
+#ifndef MULTIMAP_WRITEBATCH_H_
+#define MULTIMAP_WRITEBATCH_H_
+
+#include <vector>
+#include "multimap/Arena.h"
+#include "multimap/Slice.h"
+
+namespace multimap {
+
+class WriteBatch {
+  // Collects puts and removes for many keys that are applied to a map at
+  // once via Map::write(). Keys and values are copied into the batch, so
+  // that the caller's buffers can be reused immediately.
+
+ public:
+  struct Operation {
+    Slice key;
+    Slice value;
+    bool is_remove = false;
+  };
+
+  WriteBatch() = default;
+
+  WriteBatch(const WriteBatch&) = delete;
+  WriteBatch& operator=(const WriteBatch&) = delete;
+
+  void put(const Slice& key, const Slice& value);
+
+  void remove(const Slice& key);
+  // Removes all values associated with `key`, including those that were
+  // put by earlier operations of the same batch.
+
+  const std::vector<Operation>& operations() const { return operations_; }
+  // Returns the operations in the order they were added.
+
+  size_t size() const { return operations_.size(); }
+
+  bool empty() const { return operations_.empty(); }
+
+  void clear();
+  // Removes all operations, so that the batch can be reused.
+
+ private:
+  std::vector<Operation> operations_;
+  Arena arena_;
+};
+
+}  // namespace multimap
+
+#endif  // MULTIMAP_WRITEBATCH_H_
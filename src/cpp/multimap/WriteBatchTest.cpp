@@ -0,0 +1,62 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <string>
+#include <type_traits>
+#include "gmock/gmock.h"
+#include "multimap/WriteBatch.h"
+
+namespace multimap {
+
+using testing::Eq;
+
+TEST(WriteBatchTest, IsDefaultConstructible) {
+  ASSERT_TRUE(std::is_default_constructible<WriteBatch>::value);
+}
+
+TEST(WriteBatchTest, IsNotCopyConstructibleOrAssignable) {
+  ASSERT_FALSE(std::is_copy_constructible<WriteBatch>::value);
+  ASSERT_FALSE(std::is_copy_assignable<WriteBatch>::value);
+}
+
+TEST(WriteBatchTest, KeepsCopiesOfOperationsInOrder) {
+  WriteBatch batch;
+  std::string key = "k1";
+  std::string value = "v1";
+  batch.put(key, value);
+  key = "k2";
+  batch.remove(key);
+  batch.put(key, "");
+  key = "xx";
+  value = "xx";
+
+  ASSERT_THAT(batch.size(), Eq(3));
+  const auto& operations = batch.operations();
+  ASSERT_THAT(operations[0].key, Eq("k1"));
+  ASSERT_THAT(operations[0].value, Eq("v1"));
+  ASSERT_FALSE(operations[0].is_remove);
+  ASSERT_THAT(operations[1].key, Eq("k2"));
+  ASSERT_TRUE(operations[1].is_remove);
+  ASSERT_THAT(operations[2].key, Eq("k2"));
+  ASSERT_TRUE(operations[2].value.empty());
+  ASSERT_FALSE(operations[2].is_remove);
+
+  batch.clear();
+  ASSERT_TRUE(batch.empty());
+}
+
+}  // namespace multimap
@@ -0,0 +1,152 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "multimap/internal/EliasFano.h"
+
+#include <cstdio>
+#include <vector>
+#include "multimap/thirdparty/mt/assert.h"
+#include "multimap/thirdparty/mt/check.h"
+#include "multimap/thirdparty/mt/fileio.h"
+
+namespace multimap {
+namespace internal {
+
+namespace {
+
+const size_t WORD_BITS = 64;
+
+size_t getNumWords(size_t num_bits) {
+  return (num_bits + WORD_BITS - 1) / WORD_BITS;
+}
+
+size_t selectInWord(uint64_t word, size_t rank) {
+  // Returns the position of the one bit with the given rank in `word`.
+  for (size_t i = 0; i != rank; ++i) {
+    word &= word - 1;
+  }
+  return __builtin_ctzll(word);
+}
+
+void readVector(std::FILE* stream, std::vector<uint64_t>* vector) {
+  uint64_t size;
+  mt::freadAll(stream, &size, sizeof size);
+  vector->resize(size);
+  mt::freadAll(stream, vector->data(), size * sizeof(uint64_t));
+}
+
+void writeVector(std::FILE* stream, const std::vector<uint64_t>& vector) {
+  const uint64_t size = vector.size();
+  mt::fwriteAll(stream, &size, sizeof size);
+  mt::fwriteAll(stream, vector.data(), size * sizeof(uint64_t));
+}
+
+}  // namespace
+
+const size_t EliasFano::SAMPLING_RATE;
+
+EliasFano::EliasFano(const uint64_t* values, size_t num_values)
+    : size_(num_values) {
+  if (num_values == 0) return;
+  const uint64_t universe = values[num_values - 1];
+  const uint64_t ratio = universe / num_values;
+  num_lower_bits_ = ratio ? (WORD_BITS - 1 - __builtin_clzll(ratio)) : 0;
+  lower_.resize(getNumWords(num_values * num_lower_bits_) + 1);
+  upper_.resize(getNumWords(num_values + (universe >> num_lower_bits_) + 1));
+
+  const uint64_t lower_mask = (uint64_t(1) << num_lower_bits_) - 1;
+  for (size_t i = 0; i != num_values; ++i) {
+    MT_ASSERT_TRUE(i == 0 || values[i - 1] <= values[i]);
+    if (num_lower_bits_ != 0) {
+      const size_t pos = i * num_lower_bits_;
+      const uint64_t lower = values[i] & lower_mask;
+      lower_[pos / WORD_BITS] |= lower << (pos % WORD_BITS);
+      if (pos % WORD_BITS + num_lower_bits_ > WORD_BITS) {
+        lower_[pos / WORD_BITS + 1] |= lower >> (WORD_BITS - pos % WORD_BITS);
+      }
+    }
+    const size_t pos = (values[i] >> num_lower_bits_) + i;
+    upper_[pos / WORD_BITS] |= uint64_t(1) << (pos % WORD_BITS);
+  }
+  sample();
+}
+
+uint64_t EliasFano::operator[](size_t index) const {
+  MT_REQUIRE_LT(index, size_);
+  const uint64_t upper = select(index) - index;
+  if (num_lower_bits_ == 0) return upper;
+  const size_t pos = index * num_lower_bits_;
+  uint64_t lower = lower_[pos / WORD_BITS] >> (pos % WORD_BITS);
+  if (pos % WORD_BITS + num_lower_bits_ > WORD_BITS) {
+    lower |= lower_[pos / WORD_BITS + 1] << (WORD_BITS - pos % WORD_BITS);
+  }
+  lower &= (uint64_t(1) << num_lower_bits_) - 1;
+  return (upper << num_lower_bits_) | lower;
+}
+
+EliasFano EliasFano::readFromFile(const boost::filesystem::path& file_path) {
+  const mt::AutoCloseFile stream = mt::fopen(file_path, "r");
+  EliasFano elias_fano;
+  mt::freadAll(stream.get(), &elias_fano.size_, sizeof elias_fano.size_);
+  mt::freadAll(stream.get(), &elias_fano.num_lower_bits_,
+               sizeof elias_fano.num_lower_bits_);
+  readVector(stream.get(), &elias_fano.lower_);
+  readVector(stream.get(), &elias_fano.upper_);
+  elias_fano.sample();
+  return elias_fano;
+}
+
+void EliasFano::writeToFile(const boost::filesystem::path& file_path) const {
+  const mt::AutoCloseFile stream = mt::fopen(file_path, "w");
+  mt::fwriteAll(stream.get(), &size_, sizeof size_);
+  mt::fwriteAll(stream.get(), &num_lower_bits_, sizeof num_lower_bits_);
+  writeVector(stream.get(), lower_);
+  writeVector(stream.get(), upper_);
+}
+
+size_t EliasFano::select(size_t rank) const {
+  size_t remaining = rank % SAMPLING_RATE;
+  const size_t sample = samples_[rank / SAMPLING_RATE];
+  size_t index = sample / WORD_BITS;
+  uint64_t word = upper_[index] & (~uint64_t(0) << (sample % WORD_BITS));
+  size_t count = __builtin_popcountll(word);
+  while (remaining >= count) {
+    remaining -= count;
+    word = upper_[++index];
+    count = __builtin_popcountll(word);
+  }
+  return index * WORD_BITS + selectInWord(word, remaining);
+}
+
+void EliasFano::sample() {
+  samples_.clear();
+  size_t rank = 0;
+  for (size_t i = 0; i != upper_.size(); ++i) {
+    uint64_t word = upper_[i];
+    while (word != 0) {
+      if (rank % SAMPLING_RATE == 0) {
+        samples_.push_back(i * WORD_BITS + __builtin_ctzll(word));
+      }
+      word &= word - 1;
+      ++rank;
+    }
+  }
+  mt::Check::isEqual(rank, size_, "Invalid Elias-Fano sequence");
+}
+
+}  // namespace internal
+}  // namespace multimap
@@ -0,0 +1,75 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MULTIMAP_INTERNAL_ELIASFANO_H_
+#define MULTIMAP_INTERNAL_ELIASFANO_H_
+
+#include <cstdint>
+#include <vector>
+#include <boost/filesystem/path.hpp>  // NOLINT
+
+namespace multimap {
+namespace internal {
+
+class EliasFano {
+  // A non-decreasing sequence of integers in Elias-Fano representation, which
+  // takes about 2 + log2(u / n) bits per element, where u is the largest
+  // element and n the number of elements. The lower bits of each element are
+  // stored verbatim, the upper bits are unary coded in a bit vector. Accessing
+  // an element requires a select query on that bit vector, which starts from
+  // a sampled position and usually touches a single word.
+  //
+  // This class is read-only and does not need external locking.
+
+ public:
+  EliasFano() = default;
+
+  EliasFano(const uint64_t* values, size_t num_values);
+  // `values` must be sorted in non-decreasing order.
+
+  uint64_t operator[](size_t index) const;
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  static EliasFano readFromFile(const boost::filesystem::path& file_path);
+
+  void writeToFile(const boost::filesystem::path& file_path) const;
+
+ private:
+  static const size_t SAMPLING_RATE = 256;
+
+  size_t select(size_t rank) const;
+  // Returns the position of the one bit with the given rank in `upper_`.
+
+  void sample();
+
+  uint64_t size_ = 0;
+  uint64_t num_lower_bits_ = 0;
+  std::vector<uint64_t> lower_;
+  std::vector<uint64_t> upper_;
+  std::vector<uint64_t> samples_;
+  // Element i has its upper bits encoded as the one bit at position
+  // (element >> num_lower_bits_) + i in `upper_`. `samples_` holds the
+  // position of every SAMPLING_RATE-th one bit and is not written to file.
+};
+
+}  // namespace internal
+}  // namespace multimap
+
+#endif  // MULTIMAP_INTERNAL_ELIASFANO_H_
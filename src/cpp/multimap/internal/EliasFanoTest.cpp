@@ -0,0 +1,124 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <chrono>  // NOLINT
+#include <random>
+#include <type_traits>
+#include <vector>
+#include <boost/filesystem/operations.hpp>  // NOLINT
+#include "gmock/gmock.h"
+#include "multimap/internal/EliasFano.h"
+#include "multimap/thirdparty/mt/common.h"
+
+namespace multimap {
+namespace internal {
+
+namespace {
+
+std::vector<uint64_t> makeSortedValues(size_t num_values, uint64_t max_gap) {
+  std::vector<uint64_t> values;
+  std::mt19937_64 random;
+  uint64_t value = 0;
+  for (size_t i = 0; i != num_values; ++i) {
+    value += random() % (max_gap + 1);
+    values.push_back(value);
+  }
+  return values;
+}
+
+}  // namespace
+
+TEST(EliasFanoTest, IsDefaultConstructible) {
+  ASSERT_TRUE(std::is_default_constructible<EliasFano>::value);
+}
+
+TEST(EliasFanoTest, IsMoveConstructibleAndAssignable) {
+  ASSERT_TRUE(std::is_move_constructible<EliasFano>::value);
+  ASSERT_TRUE(std::is_move_assignable<EliasFano>::value);
+}
+
+TEST(EliasFanoTest, DefaultConstructedHasProperState) {
+  ASSERT_TRUE(EliasFano().empty());
+  ASSERT_EQ(0, EliasFano().size());
+}
+
+TEST(EliasFanoTest, AccessReturnsValuesForDifferentGaps) {
+  for (uint64_t max_gap : {0ul, 1ul, 7ul, 1000ul, 1ul << 40}) {
+    for (size_t num_values : {1, 2, 255, 256, 257, 10000}) {
+      const auto values = makeSortedValues(num_values, max_gap);
+      const EliasFano elias_fano(values.data(), values.size());
+      ASSERT_EQ(num_values, elias_fano.size());
+      for (size_t i = 0; i != values.size(); ++i) {
+        ASSERT_EQ(values[i], elias_fano[i]);
+      }
+    }
+  }
+}
+
+TEST(EliasFanoTest, AccessReturnsRepeatedAndLargeValues) {
+  const uint64_t values[] = {0, 0, 5, 5, 5, 1ul << 32, 1ul << 32, -1ul};
+  const EliasFano elias_fano(values, sizeof values / sizeof values[0]);
+  for (size_t i = 0; i != elias_fano.size(); ++i) {
+    ASSERT_EQ(values[i], elias_fano[i]);
+  }
+}
+
+TEST(EliasFanoTest, WriteToFileAndReadBack) {
+  const std::string file_path = "/tmp/multimap.EliasFanoTest";
+  const auto values = makeSortedValues(10000, 100);
+  EliasFano(values.data(), values.size()).writeToFile(file_path);
+  const EliasFano elias_fano = EliasFano::readFromFile(file_path);
+  ASSERT_EQ(values.size(), elias_fano.size());
+  for (size_t i = 0; i != values.size(); ++i) {
+    ASSERT_EQ(values[i], elias_fano[i]);
+  }
+  ASSERT_TRUE(boost::filesystem::remove(file_path));
+}
+
+#ifdef MULTIMAP_RUN_LARGE_TESTS
+
+TEST(EliasFanoTest, SizeAndRandomAccessTimeOfTenMillionOffsets) {
+  const std::string file_path = "/tmp/multimap.EliasFanoTest";
+  const auto values = makeSortedValues(mt::MiB(10), 200);
+  EliasFano(values.data(), values.size()).writeToFile(file_path);
+  const EliasFano elias_fano = EliasFano::readFromFile(file_path);
+  mt::log() << "Bits per value: "
+            << boost::filesystem::file_size(file_path) * 8.0 / values.size()
+            << '\n';
+  ASSERT_TRUE(boost::filesystem::remove(file_path));
+
+  std::vector<size_t> indexes;
+  std::mt19937 random;
+  for (size_t i = 0; i != values.size(); ++i) {
+    indexes.push_back(random() % values.size());
+  }
+  uint64_t sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t index : indexes) {
+    sum += elias_fano[index];
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_NE(0, sum);
+  mt::log() << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   elapsed).count() / indexes.size()
+            << " ns per random access\n";
+}
+
+#endif
+
+}  // namespace internal
+}  // namespace multimap
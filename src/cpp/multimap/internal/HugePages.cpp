@@ -0,0 +1,73 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "multimap/internal/HugePages.h"
+
+#include <sys/mman.h>
+#include <cstdint>
+#include "multimap/thirdparty/mt/assert.h"
+#include "multimap/thirdparty/mt/common.h"
+
+namespace multimap {
+namespace internal {
+
+size_t HugePages::getSize() { return mt::MiB(2); }
+
+mt::AutoUnmapMemory HugePages::allocate(size_t size) {
+  MT_REQUIRE_NOT_ZERO(size);
+  const size_t huge_page_size = getSize();
+  size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+
+  // Map one more huge page than needed and unmap the unaligned parts.
+  auto memory = mt::mmap(size + huge_page_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  const auto mapped = memory.release();
+  const auto begin = reinterpret_cast<uintptr_t>(mapped.first);
+  const auto end = begin + mapped.second;
+  const auto aligned_begin =
+      (begin + huge_page_size - 1) / huge_page_size * huge_page_size;
+  const auto aligned_end = aligned_begin + size;
+  if (aligned_begin != begin) {
+    ::munmap(reinterpret_cast<void*>(begin), aligned_begin - begin);
+  }
+  if (aligned_end != end) {
+    ::munmap(reinterpret_cast<void*>(aligned_end), end - aligned_end);
+  }
+  memory = mt::AutoUnmapMemory(reinterpret_cast<uint8_t*>(aligned_begin), size);
+  advise(memory.data(), memory.size());
+  return memory;
+}
+
+bool HugePages::advise(void* data, size_t size) {
+#ifdef MADV_HUGEPAGE
+  const size_t huge_page_size = getSize();
+  const auto begin = reinterpret_cast<uintptr_t>(data);
+  const auto aligned_begin =
+      (begin + huge_page_size - 1) / huge_page_size * huge_page_size;
+  const auto aligned_end = (begin + size) / huge_page_size * huge_page_size;
+  if (aligned_begin >= aligned_end) return false;
+  return ::madvise(reinterpret_cast<void*>(aligned_begin),
+                   aligned_end - aligned_begin, MADV_HUGEPAGE) == 0;
+#else
+  (void)data;
+  (void)size;
+  return false;
+#endif
+}
+
+}  // namespace internal
+}  // namespace multimap
@@ -0,0 +1,50 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MULTIMAP_INTERNAL_HUGEPAGES_H_
+#define MULTIMAP_INTERNAL_HUGEPAGES_H_
+
+#include <cstddef>
+#include "multimap/thirdparty/mt/memory.h"
+
+namespace multimap {
+namespace internal {
+
+struct HugePages {
+  // Helpers to back memory with transparent huge pages, which reduces TLB
+  // misses when accessing large data structures at random. The kernel treats
+  // the requests as hints: if transparent huge pages are disabled or not
+  // supported by the platform, the memory is backed by regular pages.
+
+  static size_t getSize();
+  // Returns the size of a huge page, which is 2 MiB on x86-64.
+
+  static mt::AutoUnmapMemory allocate(size_t size);
+  // Returns an anonymous read-write mapping of at least `size` bytes that is
+  // aligned to and a multiple of the huge page size.
+
+  static bool advise(void* data, size_t size);
+  // Advises the kernel to back the range with huge pages. Only whole huge
+  // pages within the range are affected. Returns false if not supported.
+
+  HugePages() = delete;
+};
+
+}  // namespace internal
+}  // namespace multimap
+
+#endif  // MULTIMAP_INTERNAL_HUGEPAGES_H_
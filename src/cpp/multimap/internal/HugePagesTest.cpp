@@ -0,0 +1,42 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include "gmock/gmock.h"
+#include "multimap/internal/HugePages.h"
+#include "multimap/thirdparty/mt/common.h"
+
+namespace multimap {
+namespace internal {
+
+using testing::Eq;
+
+TEST(HugePagesTest, AllocatedMemoryIsAlignedToHugePages) {
+  const size_t huge_page_size = HugePages::getSize();
+  for (size_t size : {size_t(1), huge_page_size, huge_page_size + 1}) {
+    const auto memory = HugePages::allocate(size);
+    ASSERT_THAT(reinterpret_cast<uintptr_t>(memory.data()) % huge_page_size,
+                Eq(0));
+    ASSERT_THAT(memory.size() % huge_page_size, Eq(0));
+    ASSERT_GE(memory.size(), size);
+    memory.data()[0] = 1;
+    memory.data()[memory.size() - 1] = 1;
+  }
+}
+
+}  // namespace internal
+}  // namespace multimap
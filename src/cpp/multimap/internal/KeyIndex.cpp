@@ -0,0 +1,148 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "multimap/internal/KeyIndex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <vector>
+#include "multimap/thirdparty/mt/assert.h"
+#include "multimap/thirdparty/mt/check.h"
+#include "multimap/thirdparty/mt/fileio.h"
+#include "multimap/thirdparty/mt/varint.h"
+
+namespace multimap {
+namespace internal {
+
+namespace {
+
+void appendVarint(uint32_t value, Bytes* output) {
+  byte buffer[mt::MAX_VARINT32_BYTES];
+  const size_t num_bytes =
+      mt::writeVarint32ToBuffer(value, buffer, std::end(buffer));
+  output->insert(output->end(), buffer, buffer + num_bytes);
+}
+
+const byte* readEntry(const byte* pos, Bytes* key, uint32_t* value) {
+  // Replaces the suffix of `key` and returns the beginning of the next entry.
+  uint32_t shared_size;
+  uint32_t suffix_size;
+  pos += mt::readVarint32FromBuffer(pos, &shared_size);
+  pos += mt::readVarint32FromBuffer(pos, &suffix_size);
+  key->resize(shared_size);
+  key->insert(key->end(), pos, pos + suffix_size);
+  pos += suffix_size;
+  pos += mt::readVarint32FromBuffer(pos, value);
+  return pos;
+}
+
+Slice getRestartKey(const byte* pos) {
+  // The shared size of a restart entry is zero and takes a single byte.
+  uint32_t key_size;
+  pos += 1;
+  pos += mt::readVarint32FromBuffer(pos, &key_size);
+  return Slice(pos, key_size);
+}
+
+template <typename T>
+void readVector(std::FILE* stream, std::vector<T>* vector) {
+  uint64_t size;
+  mt::freadAll(stream, &size, sizeof size);
+  vector->resize(size);
+  mt::freadAll(stream, vector->data(), size * sizeof(T));
+}
+
+template <typename T>
+void writeVector(std::FILE* stream, const std::vector<T>& vector) {
+  const uint64_t size = vector.size();
+  mt::fwriteAll(stream, &size, sizeof size);
+  mt::fwriteAll(stream, vector.data(), size * sizeof(T));
+}
+
+}  // namespace
+
+const size_t KeyIndex::RESTART_INTERVAL;
+
+void KeyIndex::append(const Slice& key, uint32_t value) {
+  MT_REQUIRE_TRUE(size_ == 0 || Slice(last_key_) < key);
+  size_t shared_size = 0;
+  if (size_ % RESTART_INTERVAL == 0) {
+    MT_REQUIRE_LE(entries_.size(), std::numeric_limits<uint32_t>::max());
+    restarts_.push_back(entries_.size());
+  } else {
+    const size_t max_shared_size = std::min(last_key_.size(), key.size());
+    while (shared_size != max_shared_size &&
+           last_key_[shared_size] == key.data()[shared_size]) {
+      ++shared_size;
+    }
+  }
+  appendVarint(shared_size, &entries_);
+  appendVarint(key.size() - shared_size, &entries_);
+  entries_.insert(entries_.end(), key.begin() + shared_size, key.end());
+  appendVarint(value, &entries_);
+  last_key_.assign(key.begin(), key.end());
+  ++size_;
+}
+
+bool KeyIndex::findFloor(const Slice& key, uint32_t* value) const {
+  // Finds the last restart point whose key is not greater than `key`.
+  const auto restart = std::upper_bound(
+      restarts_.begin(), restarts_.end(), key,
+      [this](const Slice& key, uint32_t restart) {
+        return key < getRestartKey(entries_.data() + restart);
+      });
+  if (restart == restarts_.begin()) return false;
+
+  const byte* pos = entries_.data() + *(restart - 1);
+  const byte* end = (restart != restarts_.end())
+                        ? entries_.data() + *restart
+                        : entries_.data() + entries_.size();
+  Bytes current_key;
+  uint32_t current_value;
+  pos = readEntry(pos, &current_key, &current_value);
+  *value = current_value;
+  while (pos != end) {
+    pos = readEntry(pos, &current_key, &current_value);
+    if (key < Slice(current_key)) break;
+    *value = current_value;
+  }
+  return true;
+}
+
+KeyIndex KeyIndex::readFromFile(const boost::filesystem::path& file_path) {
+  const mt::AutoCloseFile stream = mt::fopen(file_path, "r");
+  KeyIndex index;
+  mt::freadAll(stream.get(), &index.size_, sizeof index.size_);
+  readVector(stream.get(), &index.entries_);
+  readVector(stream.get(), &index.restarts_);
+  mt::Check::isEqual(
+      (index.size_ + RESTART_INTERVAL - 1) / RESTART_INTERVAL,
+      index.restarts_.size(), "Invalid key index: %s", file_path.c_str());
+  return index;
+}
+
+void KeyIndex::writeToFile(const boost::filesystem::path& file_path) const {
+  const mt::AutoCloseFile stream = mt::fopen(file_path, "w");
+  mt::fwriteAll(stream.get(), &size_, sizeof size_);
+  writeVector(stream.get(), entries_);
+  writeVector(stream.get(), restarts_);
+}
+
+}  // namespace internal
+}  // namespace multimap
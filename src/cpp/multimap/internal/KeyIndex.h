@@ -0,0 +1,74 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MULTIMAP_INTERNAL_KEYINDEX_H_
+#define MULTIMAP_INTERNAL_KEYINDEX_H_
+
+#include <cstdint>
+#include <vector>
+#include <boost/filesystem/path.hpp>  // NOLINT
+#include "multimap/Bytes.h"
+#include "multimap/Slice.h"
+
+namespace multimap {
+namespace internal {
+
+class KeyIndex {
+  // A sequence of strictly increasing keys, each mapped to a 32-bit value.
+  // The keys are front coded: each key is stored as the length of the prefix
+  // it shares with the previous key, followed by the remaining suffix. Every
+  // RESTART_INTERVAL-th key is stored in full, so that a lookup is a binary
+  // search over these restart points followed by a short linear scan.
+  //
+  // This class is read-only after construction and does not need external
+  // locking for lookups.
+
+ public:
+  KeyIndex() = default;
+
+  void append(const Slice& key, uint32_t value);
+  // `key` must be greater than all keys appended before.
+
+  bool findFloor(const Slice& key, uint32_t* value) const;
+  // Stores the value of the greatest key that is less than or equal to `key`.
+  // Returns false if there is no such key.
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  static KeyIndex readFromFile(const boost::filesystem::path& file_path);
+
+  void writeToFile(const boost::filesystem::path& file_path) const;
+
+ private:
+  static const size_t RESTART_INTERVAL = 16;
+
+  uint64_t size_ = 0;
+  Bytes entries_;
+  std::vector<uint32_t> restarts_;
+  Bytes last_key_;
+  // Each entry is encoded as [shared size][suffix size][suffix][value], where
+  // the sizes and the value are varints. `restarts_` holds the position of
+  // every RESTART_INTERVAL-th entry in `entries_`, whose shared size is zero.
+  // `last_key_` is only used by append() and is not written to file.
+};
+
+}  // namespace internal
+}  // namespace multimap
+
+#endif  // MULTIMAP_INTERNAL_KEYINDEX_H_
@@ -0,0 +1,113 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/filesystem/operations.hpp>  // NOLINT
+#include "gmock/gmock.h"
+#include "multimap/internal/KeyIndex.h"
+
+namespace multimap {
+namespace internal {
+
+namespace {
+
+std::string makeKey(size_t i) {
+  // Returns keys with long shared prefixes that sort like their numbers.
+  char buffer[32];
+  std::snprintf(buffer, sizeof buffer, "key-%08zu", i);
+  return buffer;
+}
+
+KeyIndex makeIndex(size_t num_keys) {
+  // Maps the key of every even number to that number.
+  KeyIndex index;
+  for (size_t i = 0; i != num_keys; ++i) {
+    index.append(makeKey(i * 2), i * 2);
+  }
+  return index;
+}
+
+}  // namespace
+
+TEST(KeyIndexTest, IsDefaultConstructible) {
+  ASSERT_TRUE(std::is_default_constructible<KeyIndex>::value);
+}
+
+TEST(KeyIndexTest, IsMoveConstructibleAndAssignable) {
+  ASSERT_TRUE(std::is_move_constructible<KeyIndex>::value);
+  ASSERT_TRUE(std::is_move_assignable<KeyIndex>::value);
+}
+
+TEST(KeyIndexTest, DefaultConstructedHasProperState) {
+  uint32_t value;
+  ASSERT_TRUE(KeyIndex().empty());
+  ASSERT_EQ(0, KeyIndex().size());
+  ASSERT_FALSE(KeyIndex().findFloor("key", &value));
+}
+
+TEST(KeyIndexTest, FindFloorReturnsGreatestKeyNotGreaterThanGiven) {
+  for (size_t num_keys : {1, 2, 15, 16, 17, 1000}) {
+    const KeyIndex index = makeIndex(num_keys);
+    ASSERT_EQ(num_keys, index.size());
+    uint32_t value;
+    ASSERT_FALSE(index.findFloor("", &value));
+    ASSERT_FALSE(index.findFloor("key", &value));
+    for (size_t i = 0; i != num_keys * 2; ++i) {
+      ASSERT_TRUE(index.findFloor(makeKey(i), &value));
+      ASSERT_EQ(i - i % 2, value);
+    }
+    ASSERT_TRUE(index.findFloor("kez", &value));
+    ASSERT_EQ((num_keys - 1) * 2, value);
+  }
+}
+
+TEST(KeyIndexTest, FindFloorHandlesKeysThatArePrefixesOfEachOther) {
+  KeyIndex index;
+  const std::vector<std::string> keys = {"", "a", "aa", "aaa", "ab", "b"};
+  for (size_t i = 0; i != keys.size(); ++i) {
+    index.append(keys[i], i);
+  }
+  uint32_t value;
+  for (size_t i = 0; i != keys.size(); ++i) {
+    ASSERT_TRUE(index.findFloor(keys[i], &value));
+    ASSERT_EQ(i, value);
+  }
+  ASSERT_TRUE(index.findFloor("aab", &value));
+  ASSERT_EQ(3, value);
+  ASSERT_TRUE(index.findFloor("c", &value));
+  ASSERT_EQ(5, value);
+}
+
+TEST(KeyIndexTest, WriteToFileAndReadBack) {
+  const std::string file_path = "/tmp/multimap.KeyIndexTest";
+  makeIndex(1000).writeToFile(file_path);
+  const KeyIndex index = KeyIndex::readFromFile(file_path);
+  ASSERT_EQ(1000, index.size());
+  uint32_t value;
+  for (size_t i = 0; i != 2000; ++i) {
+    ASSERT_TRUE(index.findFloor(makeKey(i), &value));
+    ASSERT_EQ(i - i % 2, value);
+  }
+  ASSERT_TRUE(boost::filesystem::remove(file_path));
+}
+
+}  // namespace internal
+}  // namespace multimap
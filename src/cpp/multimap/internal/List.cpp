@@ -19,7 +19,11 @@
 
 #include <sys/mman.h>
 #include <algorithm>
+#include <atomic>
+#include <exception>
 #include <limits>
+#include <memory>
+#include <mutex>  // NOLINT
 #include <vector>
 #include "multimap/thirdparty/mt/check.h"
 #include "multimap/thirdparty/mt/fileio.h"
@@ -30,13 +34,17 @@ namespace internal {
 
 namespace {
 
-class Stream {
+class PrefetchedBlocks {
+  // Provides the blocks of a list fetched from the store all at once, which
+  // allows to advise the kernel to read them ahead.
+
  public:
-  Stream() = default;
+  PrefetchedBlocks() = default;
 
-  Stream(const Store::Blocks& blocks, const Store::Block& tail)
+  PrefetchedBlocks(const StoreBase::Blocks& blocks,
+                   const StoreBase::Block& tail)
       : blocks_(blocks), tail_(tail) {
-    for (const Store::Block& block : blocks_) {
+    for (const StoreBase::Block& block : blocks_) {
       byte* page = mt::getPageBegin(block.data);
       int result = posix_madvise(page, mt::getPageSize(), POSIX_MADV_WILLNEED);
       mt::Check::isZero(result, "posix_madvise() failed");
@@ -45,53 +53,125 @@ class Stream {
     tail_.offset = 0;
   }
 
+  bool hasNext() const { return !blocks_.empty() || !tail_.empty(); }
+
+  StoreBase::Block next() {
+    StoreBase::Block block;
+    if (blocks_.empty()) {
+      block = tail_;
+      tail_.clear();
+    } else {
+      block = blocks_.back();
+      blocks_.pop_back();
+    }
+    MT_ASSERT_FALSE(block.empty());
+    return block;
+  }
+
+ private:
+  StoreBase::Blocks blocks_;
+  StoreBase::Block tail_;
+};
+
+template <typename Store>
+class LazyBlocks {
+  // Provides the blocks of a list fetched from the store one at a time,
+  // which does not allocate any memory.
+
+ public:
+  LazyBlocks(const UintVector& block_ids, const Store& store,
+             const StoreBase::Block& tail)
+      : block_ids_(block_ids), store_(&store), tail_(tail) {
+    tail_.offset = 0;
+  }
+
+  bool hasNext() const { return block_ids_.hasNext() || !tail_.empty(); }
+
+  StoreBase::Block next() {
+    StoreBase::Block block;
+    if (block_ids_.hasNext()) {
+      block = store_->get(block_ids_.next());
+    } else {
+      block = tail_;
+      tail_.clear();
+    }
+    MT_ASSERT_FALSE(block.empty());
+    return block;
+  }
+
+ private:
+  UintVector::Reader block_ids_;
+  const Store* store_;
+  StoreBase::Block tail_;
+};
+
+template <typename Blocks>
+class Stream {
+ public:
+  Stream() = default;
+
+  explicit Stream(Blocks blocks) : blocks_(std::move(blocks)) {}
+
   Slice next() {
+    Slice value;
+    bool removed = false;
+    do {
+      const bool success = nextEntry(&value, &removed);
+      MT_ASSERT_TRUE(success);
+    } while (removed);
+    return value;
+  }
+
+  bool nextEntry(Slice* value, bool* removed) {
+    // Reads the next value including its removed-flag. Returns false if the
+    // end of the stream has been reached, which is detected by a zero size
+    // field in the last block. The data of removed values is not copied.
     if (block_.empty()) {
+      if (!hasNextBlock()) return false;
       block_ = fetchNextBlock();
     }
 
-    Slice value;
-    size_t nbytes = 0;
+    // Read value's size and removed-flag.
     uint32_t size = 0;
-    bool removed = false;
-    do {
-      // Read value's size and removed-flag.
+    last_value_begin_ = block_.cur();
+    size_t nbytes =
+        readVarint32AndFlag(block_.cur(), block_.end(), &size, removed);
+    if (nbytes == 0 || size == 0) {
+      if (!hasNextBlock()) return false;
+      block_ = fetchNextBlock();
       last_value_begin_ = block_.cur();
-      nbytes = readVarint32AndFlag(block_.cur(), block_.end(), &size, &removed);
-      if (nbytes == 0 || size == 0) {
-        block_ = fetchNextBlock();
-        last_value_begin_ = block_.cur();
-        nbytes =
-            readVarint32AndFlag(block_.cur(), block_.end(), &size, &removed);
-        MT_ASSERT_NOT_ZERO(nbytes);
-        MT_ASSERT_NOT_ZERO(size);
-      }
-      block_.offset += nbytes;
-
-      // Read value's data.
-      if (size <= block_.remaining()) {
-        value = Slice(block_.cur(), size);
-        block_.offset += size;
-      } else {
-        nbytes = 0;
-        split_value_.resize(size);
-        while (nbytes != size) {
-          const size_t count = mt::min(size - nbytes, block_.remaining());
-          if (count == 0) {
-            block_ = fetchNextBlock();
-            continue;
-          }
-          MT_ASSERT_NOT_ZERO(count);
-          if (!removed) {
-            std::memcpy(split_value_.data() + nbytes, block_.cur(), count);
-          }
-          block_.offset += count;
-          nbytes += count;
+      nbytes = readVarint32AndFlag(block_.cur(), block_.end(), &size, removed);
+      MT_ASSERT_NOT_ZERO(nbytes);
+      MT_ASSERT_NOT_ZERO(size);
+    }
+    block_.offset += nbytes;
+
+    // Read value's data.
+    if (size <= block_.remaining()) {
+      *value = Slice(block_.cur(), size);
+      block_.offset += size;
+    } else {
+      // Two buffers are used alternately, so that a value that has been split
+      // across blocks remains valid while the next one is being read ahead.
+      Bytes& split_value = split_values_[num_split_values_++ % 2];
+      nbytes = 0;
+      split_value.resize(size);
+      while (nbytes != size) {
+        const size_t count = mt::min(size - nbytes, block_.remaining());
+        if (count == 0) {
+          block_ = fetchNextBlock();
+          continue;
         }
-        value = Slice(split_value_);
+        MT_ASSERT_NOT_ZERO(count);
+        if (!*removed) {
+          std::memcpy(split_value.data() + nbytes, block_.cur(), count);
+        }
+        block_.offset += count;
+        nbytes += count;
       }
-    } while (removed);
-    return value;
+      *value = Slice(split_value);
+    }
+    return true;
   }
 
   void markLastExtractedValueAsRemoved() {
@@ -100,33 +180,152 @@ class Stream {
   }
 
  private:
-  Store::Block fetchNextBlock() {
-    Store::Block block;
-    if (blocks_.empty()) {
-      block = tail_;
-      tail_.clear();
-    } else {
-      block = blocks_.back();
-      blocks_.pop_back();
+  bool hasNextBlock() const { return blocks_.hasNext(); }
+
+  StoreBase::Block fetchNextBlock() { return blocks_.next(); }
+
+  byte* last_value_begin_ = nullptr;
+  Blocks blocks_;
+  StoreBase::Block block_;
+  Bytes split_values_[2];
+  size_t num_split_values_ = 0;
+};
+
+class SnapshotIterator : public Iterator {
+  // Iterates a copy of the list's state without holding its lock. The blocks
+  // in the store are immutable except for the removed-flags, which are read
+  // when the values are reached. Hence values in the store that are removed
+  // in the meantime are skipped, whereas the copied tail is not affected.
+
+ public:
+  SnapshotIterator(PrefetchedBlocks blocks, std::shared_ptr<const Bytes> tail,
+                   size_t available)
+      : tail_(std::move(tail)),
+        stream_(std::move(blocks)),
+        available_(available) {}
+
+  size_t available() const override { return available_; }
+  // This is an upper bound, because the number of values that have been
+  // removed after the creation of the iterator is not known in advance.
+
+  bool hasNext() const override {
+    bool removed = true;
+    while (value_.empty() && removed) {
+      if (!stream_.nextEntry(&value_, &removed)) {
+        value_.clear();
+        available_ = 0;
+        break;
+      }
+      if (removed) value_.clear();
     }
-    MT_ASSERT_FALSE(block.empty());
-    return block;
+    return !value_.empty();
   }
 
-  byte* last_value_begin_ = nullptr;
-  Store::Blocks blocks_;
-  Store::Block block_;
-  Store::Block tail_;
-  Bytes split_value_;
+  Slice next() override {
+    Slice value = peekNext();
+    value_.clear();
+    if (available_ != 0) available_--;
+    return value;
+  }
+
+  Slice peekNext() override {
+    MT_REQUIRE_TRUE(hasNext());
+    return value_;
+  }
+
+ private:
+  std::shared_ptr<const Bytes> tail_;
+  mutable Slice value_;
+  mutable Stream<PrefetchedBlocks> stream_;
+  mutable size_t available_ = 0;
+};
+
+StoreBase::Block makeBlock(const Bytes& bytes, size_t offset) {
+  // Returns a block that begins at the given offset of `bytes`, or an empty
+  // block if `bytes` is empty.
+  StoreBase::Block block;
+  if (!bytes.empty()) {
+    block.data = const_cast<byte*>(bytes.data()) + offset;
+    block.size = bytes.size() - offset;
+  }
+  return block;
+}
+
+struct ChunkStart {
+  size_t block;
+  size_t offset;
 };
 
+bool isBeginOfValue(const StoreBase::Block& block, size_t offset) {
+  // The rest of a block may be zero or hold an incomplete header, if the
+  // header of the next value did not fit.
+  uint32_t size = 0;
+  bool removed = false;
+  return offset < block.size &&
+         readVarint32AndFlag(block.data + offset, block.end(), &size,
+                             &removed) != 0 &&
+         size != 0;
+}
+
+std::vector<ChunkStart> findChunkStarts(const StoreBase::Blocks& blocks,
+                                        size_t num_chunks) {
+  // Reads the headers of the values, skipping their data, in order to find
+  // the first value that begins in or after the first block of each chunk.
+  std::vector<ChunkStart> starts;
+  size_t next_chunk = 0;
+  size_t block = 0;
+  size_t offset = 0;
+  while (block < blocks.size() && next_chunk != num_chunks) {
+    const StoreBase::Block& current = blocks[block];
+    uint32_t size = 0;
+    bool removed = false;
+    const size_t nbytes = readVarint32AndFlag(current.data + offset,
+                                              current.end(), &size, &removed);
+    if (nbytes == 0 || size == 0) {
+      ++block;
+      offset = 0;
+      continue;
+    }
+    if (block >= next_chunk * blocks.size() / num_chunks) {
+      starts.push_back(ChunkStart{block, offset});
+      while (next_chunk != num_chunks &&
+             block >= next_chunk * blocks.size() / num_chunks) {
+        ++next_chunk;
+      }
+    }
+    offset += nbytes;
+    const size_t remaining = current.size - offset;
+    if (size <= remaining) {
+      offset += size;
+    } else {
+      const size_t rest = size - remaining;
+      block += 1 + rest / current.size;
+      offset = rest % current.size;
+    }
+  }
+  return starts;
+}
+
 }  // namespace
 
+struct AppendCombiner::PendingAppend {
+  const void* list = nullptr;
+  Slice value;
+  bool done = false;
+  bool combined = false;
+  std::exception_ptr error;
+};
+
+template <typename LockPolicy>
 class ExclusiveIterator : public Iterator {
  public:
+  typedef BasicList<LockPolicy> List;
+  typedef typename List::Store Store;
+
   ExclusiveIterator(List* list, Store* store)
       : list_(list), store_(store), lock_(list->mutex_) {
-    stream_ = Stream(store_->get(list_->block_ids_.unpack()), list_->block_);
+    stream_ = Stream<PrefetchedBlocks>(PrefetchedBlocks(
+        store_->get(list_->block_ids_.unpack()), list_->block_));
     available_ = list_->stats_.num_values_valid();
   }
 
@@ -156,18 +355,23 @@ class ExclusiveIterator : public Iterator {
 
  private:
   Slice value_;
-  Stream stream_;
+  Stream<PrefetchedBlocks> stream_;
   size_t available_ = 0;
   List* list_ = nullptr;
   Store* store_ = nullptr;
-  WriterLockGuard<SharedMutex> lock_;
+  WriterLockGuard<typename List::Mutex> lock_;
 };
 
+template <typename LockPolicy>
 class SharedIterator : public Iterator {
  public:
+  typedef BasicList<LockPolicy> List;
+  typedef typename List::Store Store;
+
   SharedIterator(const List& list, const Store& store)
       : list_(&list), store_(&store), lock_(list.mutex_) {
-    stream_ = Stream(store_->get(list_->block_ids_.unpack()), list_->block_);
+    stream_ = Stream<PrefetchedBlocks>(PrefetchedBlocks(
+        store_->get(list_->block_ids_.unpack()), list_->block_));
     available_ = list_->stats_.num_values_valid();
   }
 
@@ -192,35 +396,212 @@ class SharedIterator : public Iterator {
 
  private:
   Slice value_;
-  Stream stream_;
+  Stream<PrefetchedBlocks> stream_;
   size_t available_ = 0;
   const List* list_ = nullptr;
   const Store* store_ = nullptr;
-  ReaderLockGuard<SharedMutex> lock_;
+  ReaderLockGuard<typename List::Mutex> lock_;
 };
 
-size_t List::Limits::maxValueSize() {
+template <typename LockPolicy>
+size_t BasicList<LockPolicy>::Limits::maxValueSize() {
   return std::numeric_limits<uint32_t>::max();
 }
 
-void List::append(const Slice& value, Store* store, Arena* arena) {
-  WriterLockGuard<SharedMutex> lock(mutex_);
-  appendUnlocked(value, store, arena);
+template <typename LockPolicy>
+bool BasicList<LockPolicy>::append(const Slice& value, Store* store,
+                                   Arena* arena, AppendCombiner* combiner) {
+  MT_REQUIRE_LE(value.size(), Limits::maxValueSize());
+  if (combiner == nullptr) {
+    WriterLockGuard<Mutex> lock(mutex_);
+    appendUnlocked(value, store, arena);
+    return false;
+  }
+  typedef AppendCombiner::PendingAppend PendingAppend;
+  AppendCombiner::Slot& slot = combiner->getSlot(this, sizeof(BasicList));
+
+  // Applies all published appends to this list in a single pass. This
+  // requires the writer lock. All appends to a list use the same store and
+  // arena, hence those of the combining thread can be used.
+  const auto combine = [this, &slot, store, arena](const PendingAppend* own) {
+    if (slot.num_pending == 0) return;
+    std::vector<PendingAppend*> batch;
+    {
+      std::lock_guard<std::mutex> guard(slot.mutex);
+      auto pending = slot.pending.begin();
+      while (pending != slot.pending.end()) {
+        if ((*pending)->list == this) {
+          batch.push_back(*pending);
+          pending = slot.pending.erase(pending);
+        } else {
+          ++pending;
+        }
+      }
+      slot.num_pending -= batch.size();
+    }
+    for (PendingAppend* request : batch) {
+      try {
+        appendUnlocked(request->value, store, arena);
+      } catch (...) {
+        request->error = std::current_exception();
+      }
+    }
+    {
+      std::lock_guard<std::mutex> guard(slot.mutex);
+      for (PendingAppend* request : batch) {
+        request->combined = (request != own);
+        request->done = true;
+      }
+    }
+  };
+
+  {
+    WriterLock<Mutex> lock(mutex_, TRY_TO_LOCK);
+    if (lock.owns_lock()) {
+      appendUnlocked(value, store, arena);
+      combine(nullptr);
+      return false;
+    }
+  }
+
+  PendingAppend request;
+  request.list = this;
+  request.value = value;
+  {
+    std::lock_guard<std::mutex> guard(slot.mutex);
+    slot.pending.push_back(&request);
+    ++slot.num_pending;
+  }
+  {
+    // Blocks until the current lock holder is done. If that is an appender,
+    // the request has been applied on its way out. Otherwise, e.g. if it is
+    // an iterator, this thread applies all pending appends itself.
+    WriterLockGuard<Mutex> lock(mutex_);
+    combine(&request);
+  }
+  MT_ASSERT_TRUE(request.done);
+  if (request.error) {
+    std::rethrow_exception(request.error);
+  }
+  return request.combined;
 }
 
-std::unique_ptr<Iterator> List::newIterator(const Store& store) const {
-  return std::unique_ptr<Iterator>(new SharedIterator(*this, store));
+template <typename LockPolicy>
+std::unique_ptr<Iterator> BasicList<LockPolicy>::newIterator(
+    const Store& store) const {
+  return std::unique_ptr<Iterator>(
+      new SharedIterator<LockPolicy>(*this, store));
 }
 
-void List::forEachValue(Procedure process, const Store& store) const {
-  SharedIterator iter(*this, store);
-  while (iter.hasNext()) {
-    process(iter.next());
+template <typename LockPolicy>
+std::unique_ptr<Iterator> BasicList<LockPolicy>::newSnapshotIterator(
+    const Store& store) const {
+  StoreBase::BlockIds block_ids;
+  auto tail = std::make_shared<Bytes>();
+  size_t num_values_valid = 0;
+  {
+    ReaderLockGuard<Mutex> lock(mutex_);
+    block_ids = block_ids_.unpack();
+    copyTailUnlocked(tail.get());
+    num_values_valid = stats_.num_values_valid();
+  }
+  PrefetchedBlocks blocks(store.get(block_ids), makeBlock(*tail, 0));
+  return std::unique_ptr<Iterator>(
+      new SnapshotIterator(std::move(blocks), tail, num_values_valid));
+}
+
+template <typename LockPolicy>
+std::vector<std::unique_ptr<Iterator> >
+BasicList<LockPolicy>::newChunkIterators(
+    size_t num_chunks, const Store& store) const {
+  MT_REQUIRE_NOT_ZERO(num_chunks);
+  StoreBase::BlockIds block_ids;
+  auto tail = std::make_shared<Bytes>();
+  size_t num_values_valid = 0;
+  {
+    ReaderLockGuard<Mutex> lock(mutex_);
+    block_ids = block_ids_.unpack();
+    copyTailUnlocked(tail.get());
+    num_values_valid = stats_.num_values_valid();
+  }
+  StoreBase::Blocks blocks = store.get(block_ids);
+  if (!tail->empty()) blocks.push_back(makeBlock(*tail, 0));
+  if (blocks.empty()) return std::vector<std::unique_ptr<Iterator> >();
+
+  // A value may span several blocks, so that the beginning of a block is not
+  // necessarily the beginning of a value. A chunk therefore begins at the
+  // first value of a block whose offset the store has recorded when the
+  // preceding block of the list was put. Only if there is no such block,
+  // e.g. in small lists or in lists written by an older version, the headers
+  // of the values are read in a first pass, skipping their data.
+  std::vector<ChunkStart> starts(1);
+  for (size_t i = 1; i != num_chunks; ++i) {
+    size_t block = mt::max(i * blocks.size() / num_chunks,
+                           starts.back().block + 1);
+    for (; block < blocks.size(); ++block) {
+      const uint32_t offset = store.getNextOffset(block_ids[block - 1]);
+      if (offset != StoreBase::NO_OFFSET &&
+          isBeginOfValue(blocks[block], offset)) {
+        starts.push_back(ChunkStart{block, offset});
+        break;
+      }
+    }
+    if (block >= blocks.size()) break;
+  }
+  if (starts.size() == 1) {
+    starts = findChunkStarts(blocks, num_chunks);
+  }
+
+  std::vector<std::unique_ptr<Iterator> > iters;
+  for (size_t i = 0; i != starts.size(); ++i) {
+    // The last values of a chunk may extend into the block in which the next
+    // chunk begins, which is cut off at the beginning of the next chunk.
+    const ChunkStart begin = starts[i];
+    const ChunkStart end = (i + 1 != starts.size())
+                               ? starts[i + 1]
+                               : ChunkStart{blocks.size(), 0};
+    StoreBase::Blocks chunk_blocks(
+        blocks.begin() + begin.block,
+        blocks.begin() + end.block + (end.offset != 0));
+    if (end.offset != 0) chunk_blocks.back().size = end.offset;
+    chunk_blocks.front().data += begin.offset;
+    chunk_blocks.front().size -= begin.offset;
+    StoreBase::Block chunk_tail;
+    if (!tail->empty() && begin.block + chunk_blocks.size() == blocks.size()) {
+      // The tail is passed separately, since it is not part of the store.
+      chunk_tail = chunk_blocks.back();
+      chunk_blocks.pop_back();
+    }
+    // Each value takes at least two bytes, a header and a non-empty data
+    // part, which bounds the number of values in the chunk.
+    size_t num_bytes = chunk_tail.size;
+    for (const auto& block : chunk_blocks) {
+      num_bytes += block.size;
+    }
+    const size_t available = mt::min(num_values_valid, num_bytes / 2);
+    iters.emplace_back(new SnapshotIterator(
+        PrefetchedBlocks(chunk_blocks, chunk_tail), tail, available));
   }
+  return iters;
 }
 
-bool List::removeFirstMatch(Predicate predicate, Store* store) {
-  ExclusiveIterator iter(this, store);
+template <typename LockPolicy>
+void BasicList<LockPolicy>::forEachValue(Procedure process,
+                                         const Store& store) const {
+  // Unlike the iterators, this function fetches one block at a time and
+  // allocates memory only for values that span multiple blocks.
+  ReaderLockGuard<Mutex> lock(mutex_);
+  Stream<LazyBlocks<Store> > stream(
+      LazyBlocks<Store>(block_ids_, store, block_));
+  for (size_t i = stats_.num_values_valid(); i != 0; --i) {
+    process(stream.next());
+  }
+}
+
+template <typename LockPolicy>
+bool BasicList<LockPolicy>::removeFirstMatch(Predicate predicate,
+                                             Store* store) {
+  ExclusiveIterator<LockPolicy> iter(this, store);
   while (iter.hasNext()) {
     if (predicate(iter.next())) {
       iter.remove();
@@ -230,9 +611,11 @@ bool List::removeFirstMatch(Predicate predicate, Store* store) {
   return false;
 }
 
-size_t List::removeAllMatches(Predicate predicate, Store* store) {
+template <typename LockPolicy>
+size_t BasicList<LockPolicy>::removeAllMatches(Predicate predicate,
+                                               Store* store) {
   size_t num_removed = 0;
-  ExclusiveIterator iter(this, store);
+  ExclusiveIterator<LockPolicy> iter(this, store);
   while (iter.hasNext()) {
     if (predicate(iter.next())) {
       iter.remove();
@@ -242,9 +625,11 @@ size_t List::removeAllMatches(Predicate predicate, Store* store) {
   return num_removed;
 }
 
-bool List::replaceFirstMatch(Function map, Store* store, Arena* arena) {
+template <typename LockPolicy>
+bool BasicList<LockPolicy>::replaceFirstMatch(Function map, Store* store,
+                                              Arena* arena) {
   Bytes new_value;
-  ExclusiveIterator iter(this, store);
+  ExclusiveIterator<LockPolicy> iter(this, store);
   while (iter.hasNext()) {
     map(iter.next(), &new_value);
     if (!new_value.empty()) {
@@ -257,11 +642,13 @@ bool List::replaceFirstMatch(Function map, Store* store, Arena* arena) {
   return false;
 }
 
-size_t List::replaceAllMatches(Function map, Store* store, Arena* arena) {
+template <typename LockPolicy>
+size_t BasicList<LockPolicy>::replaceAllMatches(Function map, Store* store,
+                                                Arena* arena) {
   Bytes new_value;
   Arena new_values_arena;
   std::vector<Slice> new_values;
-  ExclusiveIterator iter(this, store);
+  ExclusiveIterator<LockPolicy> iter(this, store);
   while (iter.hasNext()) {
     map(iter.next(), &new_value);
     if (!new_value.empty()) {
@@ -277,7 +664,19 @@ size_t List::replaceAllMatches(Function map, Store* store, Arena* arena) {
   return new_values.size();
 }
 
-void List::appendUnlocked(const Slice& value, Store* store, Arena* arena) {
+template <typename LockPolicy>
+void BasicList<LockPolicy>::copyTailUnlocked(Bytes* tail) const {
+  tail->clear();
+  if (block_.offset != 0) {
+    // Bytes behind the offset may contain stale data from before clear().
+    tail->resize(block_.size, 0);
+    std::memcpy(tail->data(), block_.data, block_.offset);
+  }
+}
+
+template <typename LockPolicy>
+void BasicList<LockPolicy>::appendUnlocked(const Slice& value, Store* store,
+                                           Arena* arena) {
   MT_REQUIRE_LE(value.size(), Limits::maxValueSize());
   MT_REQUIRE_LT(stats_.num_values_total, std::numeric_limits<uint32_t>::max());
 
@@ -304,7 +703,9 @@ void List::appendUnlocked(const Slice& value, Store* store, Arena* arena) {
   while (nbytes != value.size()) {
     const size_t count = mt::min(value.size() - nbytes, block_.remaining());
     if (count == 0) {
-      flushUnlocked(store);
+      // The next value begins behind the rest of this one.
+      const size_t rest = value.size() - nbytes;
+      flushBlockUnlocked(store, (rest < block_.size) ? rest : Store::NO_OFFSET);
       continue;
     }
     MT_ASSERT_NOT_ZERO(count);
@@ -315,34 +716,58 @@ void List::appendUnlocked(const Slice& value, Store* store, Arena* arena) {
   stats_.num_values_total++;
 }
 
-bool List::tryGetStats(Stats* stats) const {
-  ReaderLock<SharedMutex> lock(mutex_, TRY_TO_LOCK);
+template <typename LockPolicy>
+bool BasicList<LockPolicy>::tryGetStats(Stats* stats) const {
+  ReaderLock<Mutex> lock(mutex_, TRY_TO_LOCK);
   return lock ? (*stats = stats_, true) : false;
 }
 
-List::Stats List::getStatsUnlocked() const { return stats_; }
+template <typename LockPolicy>
+typename BasicList<LockPolicy>::Stats BasicList<LockPolicy>::getStatsUnlocked()
+    const {
+  return stats_;
+}
 
-bool List::tryFlush(Store* store, Stats* stats) {
-  WriterLock<SharedMutex> lock(mutex_, TRY_TO_LOCK);
+template <typename LockPolicy>
+bool BasicList<LockPolicy>::tryFlush(Store* store, Stats* stats) {
+  WriterLock<Mutex> lock(mutex_, TRY_TO_LOCK);
   return lock ? (flushUnlocked(store, stats), true) : false;
 }
 
-void List::flushUnlocked(Store* store, Stats* stats) {
+template <typename LockPolicy>
+void BasicList<LockPolicy>::flushUnlocked(Store* store, Stats* stats) {
+  flushBlockUnlocked(store, 0);
+  if (stats) *stats = stats_;
+}
+
+template <typename LockPolicy>
+void BasicList<LockPolicy>::flushBlockUnlocked(Store* store,
+                                               uint32_t next_offset) {
   if (block_.offset != 0) {
-    block_ids_.add(store->put(block_));
+    block_ids_.add(store->put(block_, next_offset));
     std::memset(block_.data, 0, block_.size);
     block_.offset = 0;
   }
-  if (stats) *stats = stats_;
 }
 
-bool List::empty() const {
-  ReaderLockGuard<SharedMutex> lock(mutex_);
+template <typename LockPolicy>
+size_t BasicList<LockPolicy>::size() const {
+  ReaderLockGuard<Mutex> lock(mutex_);
+  return stats_.num_values_valid();
+}
+
+template <typename LockPolicy>
+bool BasicList<LockPolicy>::empty() const {
+  ReaderLockGuard<Mutex> lock(mutex_);
   return stats_.num_values_valid() == 0;
 }
 
-size_t List::clear() {
-  WriterLockGuard<SharedMutex> lock(mutex_);
+template <typename LockPolicy>
+size_t BasicList<LockPolicy>::clear(std::atomic<bool>* claimed) {
+  WriterLockGuard<Mutex> lock(mutex_);
+  if (claimed) {
+    if (stats_.num_values_valid() == 0 || claimed->exchange(true)) return 0;
+  }
   block_.offset = 0;
   block_ids_ = UintVector();
   const size_t num_removed = stats_.num_values_valid();
@@ -350,8 +775,25 @@ size_t List::clear() {
   return num_removed;
 }
 
-List List::readFromStream(std::istream* stream) {
-  List list;
+template <typename LockPolicy>
+bool BasicList<LockPolicy>::tryRelease(Arena* arena, Stats* stats,
+                                       size_t* num_bytes_released) {
+  WriterLock<Mutex> lock(mutex_, TRY_TO_LOCK);
+  if (!lock || stats_.num_values_valid() != 0) return false;
+  *num_bytes_released = 0;
+  if (block_.data) {
+    arena->deallocate(block_.data, block_.size);
+    *num_bytes_released = block_.size;
+    block_.clear();
+  }
+  *stats = stats_;
+  return true;
+}
+
+template <typename LockPolicy>
+BasicList<LockPolicy> BasicList<LockPolicy>::readFromStream(
+    std::istream* stream) {
+  BasicList list;
   mt::readAll(stream, &list.stats_.num_values_total,
               sizeof list.stats_.num_values_total);
   mt::readAll(stream, &list.stats_.num_values_removed,
@@ -360,8 +802,9 @@ List List::readFromStream(std::istream* stream) {
   return list;
 }
 
-void List::writeToStream(std::ostream* stream) const {
-  ReaderLockGuard<SharedMutex> lock(mutex_);
+template <typename LockPolicy>
+void BasicList<LockPolicy>::writeToStream(std::ostream* stream) const {
+  ReaderLockGuard<Mutex> lock(mutex_);
   mt::writeAll(stream, &stats_.num_values_total,
                sizeof stats_.num_values_total);
   mt::writeAll(stream, &stats_.num_values_removed,
@@ -413,5 +856,8 @@ void setFlag(byte* buffer, bool flag) {
   flag ? (*buffer |= 0x40) : (*buffer &= 0xBF);
 }
 
+template class BasicList<ConcurrentLockPolicy>;
+template class BasicList<NullLockPolicy>;
+
 }  // namespace internal
 }  // namespace multimap
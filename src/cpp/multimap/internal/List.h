@@ -18,8 +18,12 @@
 #ifndef MULTIMAP_INTERNAL_LIST_H_
 #define MULTIMAP_INTERNAL_LIST_H_
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
 #include "multimap/internal/Locks.h"
-#include "multimap/internal/SharedMutex.h"
 #include "multimap/internal/Store.h"
 #include "multimap/internal/UintVector.h"
 #include "multimap/thirdparty/mt/assert.h"
@@ -31,8 +35,44 @@
 namespace multimap {
 namespace internal {
 
-class List {
+class AppendCombiner {
+  // Appends that find the writer lock of a list taken are published here, so
+  // that the next thread that holds the lock as an appender applies them on
+  // behalf of the waiting threads (flat combining). An instance is shared by
+  // the lists of one partition, which are mapped to its slots by address.
+
+ public:
+  AppendCombiner() = default;
+
+  AppendCombiner(const AppendCombiner&) = delete;
+  AppendCombiner& operator=(const AppendCombiner&) = delete;
+
+ private:
+  struct PendingAppend;
+
+  struct Slot {
+    std::mutex mutex;
+    std::vector<PendingAppend*> pending;
+    std::atomic<size_t> num_pending{0};
+  };
+
+  static const size_t NUM_SLOTS = 64;
+
+  Slot& getSlot(const void* list, size_t list_size) {
+    const auto address = reinterpret_cast<uintptr_t>(list);
+    return slots_[(address / list_size) % NUM_SLOTS];
+  }
+
+  template <typename> friend class BasicList;
+
+  Slot slots_[NUM_SLOTS];
+};
+
+template <typename LockPolicy>
+class BasicList {
  public:
+  typedef BasicStore<LockPolicy> Store;
+
   struct Limits {
     static size_t maxValueSize();
 
@@ -49,13 +89,19 @@ class List {
     }
   };
 
-  List() = default;
+  BasicList() = default;
 
-  void append(const Slice& value, Store* store, Arena* arena);
+  bool append(const Slice& value, Store* store, Arena* arena,
+              AppendCombiner* combiner = nullptr);
+  // Appends `value` to the list. If the list is locked and a `combiner` is
+  // given, the value is published there and the caller blocks on the lock.
+  // Whichever thread gets the lock next applies all pending appends in one
+  // pass. Returns true if the value was appended by another thread on behalf
+  // of the caller. All appends to a list must use the same combiner.
 
   template <typename InputIter>
   void append(InputIter begin, InputIter end, Store* store, Arena* arena) {
-    WriterLockGuard<SharedMutex> lock(mutex_);
+    WriterLockGuard<Mutex> lock(mutex_);
     while (begin != end) {
       appendUnlocked(*begin, store, arena);
       ++begin;
@@ -64,6 +110,26 @@ class List {
 
   std::unique_ptr<Iterator> newIterator(const Store& store) const;
 
+  std::unique_ptr<Iterator> newSnapshotIterator(const Store& store) const;
+  // Returns an iterator over the values the list contains at the time of the
+  // call. Unlike newIterator(), the list is locked only for the duration of
+  // this call, so that writers are not blocked while iterating. Values that
+  // are removed later on by removeFirstMatch() or removeAllMatches() are
+  // skipped when reached only if they had already been flushed to the store.
+  // Values in the write buffer, which is copied, and values dropped by a
+  // later clear() are still yielded.
+
+  std::vector<std::unique_ptr<Iterator> > newChunkIterators(
+      size_t num_chunks, const Store& store) const;
+  // Divides a snapshot of the list into at most `num_chunks` ranges of blocks
+  // and returns one snapshot iterator per non-empty range. The iterators
+  // yield the values in list order when visited one after another and can be
+  // used from different threads. The chunks begin at blocks for which the
+  // store knows where their first value begins; only lists without such
+  // blocks are divided by a pass over the value headers. available() of a
+  // chunk returns an upper bound derived from the chunk's number of bytes,
+  // which is at most the number of values in the entire list.
+
   void forEachValue(Procedure process, const Store& store) const;
 
   bool removeFirstMatch(Predicate predicate, Store* store);
@@ -82,26 +148,47 @@ class List {
 
   void flushUnlocked(Store* store, Stats* stats = nullptr);
 
+  size_t size() const;
+  // Returns the number of values that have not been removed.
+
   bool empty() const;
 
-  size_t clear();
+  size_t clear(std::atomic<bool>* claimed = nullptr);
+  // If `claimed` is given, the list is only cleared if it is not empty and
+  // the flag can be flipped from false to true while holding the list lock.
+  // Hence the caller that claims the flag always removes at least one value.
 
-  static List readFromStream(std::istream* stream);
+  bool tryRelease(Arena* arena, Stats* stats, size_t* num_bytes_released);
+  // Gives the list's write buffer back to `arena` if the list is empty and
+  // not locked. On success the final stats of the list are stored in `stats`
+  // and the list may be destroyed. This function is used to purge empty lists.
+
+  static BasicList readFromStream(std::istream* stream);
 
   void writeToStream(std::ostream* stream) const;
 
  private:
   void appendUnlocked(const Slice& value, Store* store, Arena* arena);
 
-  friend class ExclusiveIterator;
-  friend class SharedIterator;
+  void flushBlockUnlocked(Store* store, uint32_t next_offset);
+  // `next_offset` is where the first value begins in the next block, which
+  // is recorded by the store, see StoreBase::OFFSET_INTERVAL.
+
+  void copyTailUnlocked(Bytes* tail) const;
+
+  template <typename> friend class ExclusiveIterator;
+  template <typename> friend class SharedIterator;
 
-  mutable SharedMutex mutex_;
+  typedef typename LockPolicy::ListMutex Mutex;
+
+  mutable Mutex mutex_;
   UintVector block_ids_;
-  Store::Block block_;
+  StoreBase::Block block_;
   Stats stats_;
 };
 
+typedef BasicList<DefaultLockPolicy> List;
+
 MT_STATIC_ASSERT_SIZEOF(List, 36, 48);
 
 // The following functions are only public for unit testing.
@@ -15,6 +15,7 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <atomic>
 #include <limits>
 #include <string>
 #include <thread>  // NOLINT
@@ -258,6 +259,95 @@ TEST_P(ListTestWithParam, ForEachValueVisitsEachValue) {
   ASSERT_EQ(GetParam(), counter);
 }
 
+TEST_P(ListTestWithParam, ForEachValueVisitsEachLargeValue) {
+  List list;
+  SequenceGenerator generator;
+  const auto value_size = getStore()->getBlockSize() * 2.3;
+  for (int i = 0; i < GetParam(); i++) {
+    list.append(generator.nextof(value_size), getStore(), getArena());
+  }
+  list.removeFirstMatch([](const Slice&) { return true; }, getStore());
+
+  int counter = 0;
+  generator.reset();
+  generator.nextof(value_size);
+  list.forEachValue([&](const Slice& value) {
+    ASSERT_EQ(generator.nextof(value_size), value);
+    counter++;
+  }, *getStore());
+  ASSERT_EQ(GetParam() ? GetParam() - 1 : 0, counter);
+  ASSERT_EQ(counter, list.size());
+}
+
+TEST_P(ListTestWithParam, ChunkIteratorsVisitEachValueInOrder) {
+  List list;
+  for (int i = 0; i < GetParam(); i++) {
+    list.append(std::to_string(i), getStore(), getArena());
+  }
+
+  for (size_t num_chunks : {1, 3, 16}) {
+    const auto chunks = list.newChunkIterators(num_chunks, *getStore());
+    ASSERT_LE(chunks.size(), num_chunks);
+    int counter = 0;
+    for (const auto& chunk : chunks) {
+      ASSERT_NE(0, chunk->available());
+      while (chunk->hasNext()) {
+        ASSERT_EQ(std::to_string(counter), chunk->next());
+        counter++;
+      }
+    }
+    ASSERT_EQ(GetParam(), counter);
+  }
+}
+
+TEST_P(ListTestWithParam, ChunkIteratorsVisitEachLargeValueInOrder) {
+  List list;
+  SequenceGenerator generator;
+  const auto value_size = getStore()->getBlockSize() * 2.3;
+  for (int i = 0; i < GetParam(); i++) {
+    list.append(generator.nextof(value_size), getStore(), getArena());
+  }
+  list.removeFirstMatch([](const Slice&) { return true; }, getStore());
+
+  int counter = 0;
+  generator.reset();
+  generator.nextof(value_size);
+  for (const auto& chunk : list.newChunkIterators(7, *getStore())) {
+    while (chunk->hasNext()) {
+      ASSERT_EQ(generator.nextof(value_size), chunk->next());
+      counter++;
+    }
+  }
+  ASSERT_EQ(GetParam() ? GetParam() - 1 : 0, counter);
+}
+
+TEST_P(ListTestWithParam, ChunkIteratorsReturnUpperBoundForTheirOwnChunk) {
+  List list;
+  for (int i = 0; i < GetParam(); i++) {
+    list.append("x", getStore(), getArena());
+  }
+
+  // Values of one byte take two bytes in a block, so that the bounds of the
+  // chunks add up to the size of the list plus the padding of the blocks,
+  // which is at most one byte per block and the unused part of the tail.
+  const auto chunks = list.newChunkIterators(16, *getStore());
+  size_t num_available = 0;
+  for (const auto& chunk : chunks) {
+    const size_t available = chunk->available();
+    ASSERT_LE(available, list.size());
+    num_available += available;
+    size_t num_values = 0;
+    while (chunk->hasNext()) {
+      chunk->next();
+      num_values++;
+    }
+    ASSERT_LE(num_values, available);
+  }
+  const size_t block_size = getStore()->getBlockSize();
+  const size_t num_blocks = 2 * list.size() / block_size + 1;
+  ASSERT_LE(num_available, list.size() + num_blocks + block_size / 2);
+}
+
 INSTANTIATE_TEST_CASE_P(Parameterized, ListTestWithParam,
                         testing::Values(0, 1, 2, 10, 100, 1000, 1000000));
 
@@ -466,6 +556,115 @@ TEST_F(ListTestFixture, ClearRemovesAllValues) {
   ASSERT_FALSE(list.empty());
 }
 
+TEST_F(ListTestFixture, SnapshotIteratorDoesNotSeeValuesAppendedLater) {
+  List list;
+  SequenceGenerator generator;
+  const auto value_size = getStore()->getBlockSize() * 2.3;
+  for (int i = 0; i < 100; i++) {
+    list.append(generator.nextof(value_size), getStore(), getArena());
+  }
+  auto iter = list.newSnapshotIterator(*getStore());
+  for (int i = 0; i < 100; i++) {
+    list.append(generator.nextof(value_size), getStore(), getArena());
+    // Appending does not block while the snapshot iterator is alive.
+  }
+  generator.reset();
+  ASSERT_EQ(100, iter->available());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(iter->hasNext());
+    ASSERT_EQ(generator.nextof(value_size), iter->next());
+  }
+  ASSERT_FALSE(iter->hasNext());
+  ASSERT_EQ(0, iter->available());
+}
+
+TEST_F(ListTestFixture, SnapshotIteratorSkipsValuesRemovedLater) {
+  List list;
+  const int num_values = 1000;
+  for (int i = 0; i < num_values; i++) {
+    list.append(std::to_string(i), getStore(), getArena());
+  }
+  list.tryFlush(getStore());
+  auto iter = list.newSnapshotIterator(*getStore());
+  const auto is_odd = [](const Slice& value) {
+    return std::stoi(value.toString()) % 2;
+  };
+  ASSERT_EQ(num_values / 2, list.removeAllMatches(is_odd, getStore()));
+  for (int i = 0; i < num_values; i += 2) {
+    ASSERT_TRUE(iter->hasNext());
+    ASSERT_EQ(std::to_string(i), iter->next());
+  }
+  ASSERT_FALSE(iter->hasNext());
+}
+
+TEST_F(ListTestFixture, SnapshotIteratorYieldsUnflushedValuesRemovedLater) {
+  List list;
+  const int num_values = 10;
+  for (int i = 0; i < num_values; i++) {
+    list.append(std::to_string(i), getStore(), getArena());
+  }
+  auto iter = list.newSnapshotIterator(*getStore());
+  const auto is_odd = [](const Slice& value) {
+    return std::stoi(value.toString()) % 2;
+  };
+  ASSERT_EQ(num_values / 2, list.removeAllMatches(is_odd, getStore()));
+  for (int i = 0; i < num_values; i++) {
+    ASSERT_TRUE(iter->hasNext());
+    ASSERT_EQ(std::to_string(i), iter->next());
+  }
+  ASSERT_FALSE(iter->hasNext());
+}
+
+TEST_F(ListTestFixture, SnapshotIteratorYieldsValuesClearedLater) {
+  List list;
+  const int num_values = 1000;
+  for (int i = 0; i < num_values; i++) {
+    list.append(std::to_string(i), getStore(), getArena());
+  }
+  list.tryFlush(getStore());
+  auto iter = list.newSnapshotIterator(*getStore());
+  ASSERT_EQ(num_values, list.clear());
+  for (int i = 0; i < num_values; i++) {
+    ASSERT_TRUE(iter->hasNext());
+    ASSERT_EQ(std::to_string(i), iter->next());
+  }
+  ASSERT_FALSE(iter->hasNext());
+}
+
+TEST_F(ListTestFixture, ClearWithClaimedFlagOnlyClaimsNonEmptyList) {
+  List list;
+  std::atomic<bool> claimed(false);
+  ASSERT_EQ(0, list.clear(&claimed));
+  ASSERT_FALSE(claimed);
+
+  list.append("a", getStore(), getArena());
+  ASSERT_EQ(1, list.clear(&claimed));
+  ASSERT_TRUE(claimed);
+
+  // Once claimed, the list is left untouched.
+  list.append("b", getStore(), getArena());
+  ASSERT_EQ(0, list.clear(&claimed));
+  ASSERT_EQ(1, list.size());
+}
+
+TEST_F(ListTestFixture, SnapshotIteratorAfterClearSeesOnlyNewValues) {
+  List list;
+  for (int i = 0; i < 1000; i++) {
+    list.append(std::to_string(i), getStore(), getArena());
+  }
+  list.clear();
+  for (int i = 0; i < 10; i++) {
+    list.append(std::to_string(i), getStore(), getArena());
+  }
+  auto iter = list.newSnapshotIterator(*getStore());
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(iter->hasNext());
+    ASSERT_EQ(std::to_string(i), iter->next());
+  }
+  ASSERT_FALSE(iter->hasNext());
+  ASSERT_FALSE(List().newSnapshotIterator(*getStore())->hasNext());
+}
+
 // -----------------------------------------------------------------------------
 // Serialization
 // -----------------------------------------------------------------------------
@@ -652,6 +851,88 @@ TEST_F(ListTestFixture, WriterBlocksWriter) {
   writer2.join();
 }
 
+TEST_F(ListTestFixture, ConcurrentAppendsAreAppliedInOrderPerThread) {
+  List list;
+  const int num_threads = 8;
+  const int num_values_per_thread = 10000;
+  std::atomic<int> num_values_combined(0);
+  AppendCombiner combiner;
+  std::vector<std::thread> threads;
+  for (int t = 0; t != num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i != num_values_per_thread; ++i) {
+        const std::string value = std::to_string(t) + ':' + std::to_string(i);
+        num_values_combined +=
+            list.append(value, getStore(), getArena(), &combiner);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_THAT(list.size(), Eq(num_threads * num_values_per_thread));
+  ASSERT_LE(num_values_combined.load(), num_threads * num_values_per_thread);
+
+  std::vector<int> next_value(num_threads, 0);
+  list.forEachValue([&](const Slice& value) {
+    const std::string str = value.toString();
+    const size_t colon = str.find(':');
+    const int t = std::stoi(str.substr(0, colon));
+    ASSERT_THAT(std::stoi(str.substr(colon + 1)), Eq(next_value[t]++));
+  }, *getStore());
+}
+
+TEST_F(ListTestFixture, AppendsWaitingForWriterAreAllApplied) {
+  List list;
+  list.append("value", getStore(), getArena());
+
+  // Writer
+  std::thread writer([&] {  // NOLINT
+    list.removeFirstMatch([](const Slice& /* value */) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      return false;
+    }, getStore());
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  // Appenders
+  std::vector<std::thread> appenders;
+  for (int i = 0; i != 4; ++i) {
+    appenders.emplace_back([&] {
+      list.append("value", getStore(), getArena());
+    });
+  }
+  for (auto& appender : appenders) {
+    appender.join();
+  }
+  writer.join();
+  ASSERT_THAT(list.size(), Eq(5));
+}
+
+TEST_F(ListTestFixture, AppendsWaitingForReaderAreAppliedWhenItIsReleased) {
+  List list;
+  list.append("value", getStore(), getArena());
+  auto iter = list.newIterator(*getStore());  // Holds a reader lock.
+
+  std::atomic<int> num_appended(0);
+  std::vector<std::thread> appenders;
+  for (int i = 0; i != 4; ++i) {
+    appenders.emplace_back([&] {
+      list.append("value", getStore(), getArena());
+      ++num_appended;
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_THAT(num_appended.load(), Eq(0));
+
+  iter.reset();
+  for (auto& appender : appenders) {
+    appender.join();
+  }
+  ASSERT_THAT(list.size(), Eq(5));
+}
+
 // -----------------------------------------------------------------------------
 // Varint encoding
 // -----------------------------------------------------------------------------
@@ -0,0 +1,97 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MULTIMAP_INTERNAL_LOCKPOLICY_H_
+#define MULTIMAP_INTERNAL_LOCKPOLICY_H_
+
+#include <mutex>  // NOLINT
+#include <boost/thread/shared_mutex.hpp>  // NOLINT
+#include "multimap/internal/SharedMutex.h"
+#include "multimap/thirdparty/mt/check.h"
+
+namespace multimap {
+namespace internal {
+
+struct NullMutex {
+  // Satisfies the requirements of a shared mutex, but does nothing.
+
+  void lock() {}
+
+  bool try_lock() { return true; }
+
+  void unlock() {}
+
+  void lock_shared() {}
+
+  bool try_lock_shared() { return true; }
+
+  void unlock_shared() {}
+};
+
+// A lock policy provides the mutex types of the classes that are
+// parameterized by it, i.e. Store, List and Partition.
+
+struct ConcurrentLockPolicy {
+  typedef std::mutex Mutex;
+  typedef boost::shared_mutex ReaderWriterMutex;
+  typedef SharedMutex ListMutex;
+};
+
+struct NullLockPolicy {
+  // For data that is only ever accessed by one thread at a time, such as the
+  // partitions of a map in shard-per-core mode, see Options::shard_per_core.
+
+  typedef NullMutex Mutex;
+  typedef NullMutex ReaderWriterMutex;
+  typedef NullMutex ListMutex;
+};
+
+#ifdef MULTIMAP_SINGLE_THREADED
+
+// All mutexes that protect the data of a map are replaced by no-op mutexes.
+// The library must then be used from a single thread only, which also rules
+// out the parallel scans and the asynchronous operations. Calling them throws
+// an exception, see requireMultiThreading(), unless a map is opened with
+// `Options::shard_per_core`, whose partitions are owned by single threads
+// anyway. The macro must be defined consistently for the library and the
+// code that includes it.
+
+typedef NullLockPolicy DefaultLockPolicy;
+
+const bool SINGLE_THREADED = true;
+
+#else
+
+typedef ConcurrentLockPolicy DefaultLockPolicy;
+
+const bool SINGLE_THREADED = false;
+
+#endif
+
+inline void requireMultiThreading(const char* feature) {
+  mt::Check::isFalse(SINGLE_THREADED,
+                     "%s cannot be used if MULTIMAP_SINGLE_THREADED is defined",
+                     feature);
+}
+
+typedef DefaultLockPolicy::Mutex Mutex;
+typedef DefaultLockPolicy::ReaderWriterMutex ReaderWriterMutex;
+
+}  // namespace internal
+}  // namespace multimap
+
+#endif  // MULTIMAP_INTERNAL_LOCKPOLICY_H_
@@ -24,6 +24,7 @@
 #include <boost/thread/shared_lock_guard.hpp>  // NOLINT
 #include "multimap/thirdparty/mt/fileio.h"
 #include "multimap/internal/Descriptor.h"
+#include "multimap/internal/LockPolicy.h"
 
 namespace multimap {
 namespace internal {
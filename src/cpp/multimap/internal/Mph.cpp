@@ -17,6 +17,10 @@
 
 #include "multimap/internal/Mph.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include <vector>
 #include "multimap/thirdparty/mt/assert.h"
 #include "multimap/thirdparty/mt/check.h"
@@ -44,6 +48,126 @@ struct default_delete<cmph_config_t> {
 namespace multimap {
 namespace internal {
 
+namespace {
+
+const char NATIVE_MAGIC[8] = {'M', 'M', 'P', 'H', 'F', '0', '0', '1'};
+// CMPH files begin with the name of the algorithm, e.g. "bdz".
+
+const uint64_t SEED = 0x9e3779b97f4a7c15;
+
+const uint64_t BUCKET_SALT = 0x5851f42d4c957f2d;
+const uint64_t POSITION_SALT = 0x14057b7ef767814f;
+const uint64_t PILOT_SALT = 0xda942042e4dd58b5;
+// Derive independent hashes for different purposes from the same key hash.
+
+const uint32_t PARTITION_SIZE = 2048;
+// The average number of keys per partition. A partition's slots and pilots
+// should fit into the cache while it is built.
+
+const uint32_t SKEWED_FRACTION = 2576980377;  // 0.6 * 2^32
+// As in PTHash, 60% of the keys are assigned to 30% of the buckets, which
+// creates a few large buckets that are placed while most slots are free.
+
+uint64_t mix(uint64_t x) {
+  // The finalizer of MurmurHash3.
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccd;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53;
+  x ^= x >> 33;
+  return x;
+}
+
+uint32_t reduce(uint64_t hash, uint32_t n) {
+  // Maps the upper half of `hash` to [0, n) without a division.
+  return ((hash >> 32) * n) >> 32;
+}
+
+uint32_t getNumSlots(uint32_t num_keys) {
+  // A load factor of about 0.97 leaves some free slots for the last buckets.
+  return num_keys + (num_keys + 31) / 32;
+}
+
+uint32_t getNumBuckets(uint32_t num_keys) {
+  return (num_keys + 4) / 5;  // 5 keys per bucket on average.
+}
+
+uint32_t getBucket(uint64_t hash, uint32_t num_buckets) {
+  const uint64_t bucket_hash = mix(hash ^ BUCKET_SALT);
+  const uint32_t num_dense_buckets = std::max(1u, num_buckets * 3 / 10);
+  if (static_cast<uint32_t>(bucket_hash) < SKEWED_FRACTION ||
+      num_dense_buckets == num_buckets) {
+    return reduce(bucket_hash, num_dense_buckets);
+  }
+  return num_dense_buckets +
+         reduce(bucket_hash, num_buckets - num_dense_buckets);
+}
+
+uint32_t getSlot(uint64_t position_hash, uint32_t pilot, uint32_t num_slots) {
+  // Mixing after combining with the pilot ensures that keys whose upper bits
+  // are equal do not collide for every pilot.
+  return reduce(mix(position_hash ^ (pilot * PILOT_SALT)), num_slots);
+}
+
+void buildPartition(const uint64_t* hashes, uint32_t num_keys,
+                    uint32_t num_slots, uint32_t num_buckets, uint32_t* pilots,
+                    uint32_t* remap) {
+  if (num_keys == 0) return;
+
+  // Groups the keys by bucket.
+  std::vector<std::pair<uint32_t, uint64_t> > keys(num_keys);
+  for (uint32_t i = 0; i != num_keys; ++i) {
+    keys[i].first = getBucket(hashes[i], num_buckets);
+    keys[i].second = mix(hashes[i] ^ POSITION_SALT);
+  }
+  std::sort(keys.begin(), keys.end());
+  const auto duplicate = std::adjacent_find(keys.begin(), keys.end());
+  mt::Check::isTrue(duplicate == keys.end(), "Hashes of keys are not unique");
+
+  // Places the buckets in order of decreasing size.
+  std::vector<std::pair<uint32_t, uint32_t> > buckets;  // [begin, end)
+  for (uint32_t begin = 0, end = 0; begin != num_keys; begin = end) {
+    while (end != num_keys && keys[end].first == keys[begin].first) ++end;
+    buckets.emplace_back(begin, end);
+  }
+  std::stable_sort(buckets.begin(), buckets.end(),
+                   [](const std::pair<uint32_t, uint32_t>& a,
+                      const std::pair<uint32_t, uint32_t>& b) {
+                     return (a.second - a.first) > (b.second - b.first);
+                   });
+
+  std::vector<bool> taken(num_slots);
+  std::vector<uint32_t> slots;
+  for (const auto& bucket : buckets) {
+    uint32_t pilot = 0;
+    for (;; ++pilot) {
+      slots.clear();
+      for (uint32_t i = bucket.first; i != bucket.second; ++i) {
+        const uint32_t slot = getSlot(keys[i].second, pilot, num_slots);
+        if (taken[slot]) break;
+        taken[slot] = true;
+        slots.push_back(slot);
+      }
+      if (slots.size() == bucket.second - bucket.first) break;
+      for (uint32_t slot : slots) {
+        taken[slot] = false;
+      }
+    }
+    pilots[keys[bucket.first].first] = pilot;
+  }
+
+  // Slots behind the keys are mapped to the free slots in front of them.
+  uint32_t free_slot = 0;
+  for (uint32_t slot = num_keys; slot != num_slots; ++slot) {
+    if (taken[slot]) {
+      while (taken[free_slot]) ++free_slot;
+      remap[slot - num_keys] = free_slot++;
+    }
+  }
+}
+
+}  // namespace
+
 Mph Mph::build(const byte** keys, uint32_t nkeys) {
   std::unique_ptr<cmph_io_adapter_t> source(
       cmph_io_byte_vector_adapter(const_cast<byte**>(keys), nkeys));
@@ -71,20 +195,146 @@ Mph Mph::build(const boost::filesystem::path& keys_file_path) {
   return build(keys.data(), keys.size());
 }
 
+Mph Mph::build(const uint64_t* hashes, uint32_t num_hashes,
+               ThreadPool* pool) {
+  Mph mph;
+  mph.seed_ = SEED;
+  const uint32_t num_partitions =
+      std::max(1u, (num_hashes + PARTITION_SIZE - 1) / PARTITION_SIZE);
+
+  // Sorts the hashes into partitions.
+  std::vector<uint64_t> sorted_hashes(num_hashes);
+  std::vector<uint32_t> offsets(num_partitions + 1);
+  for (uint32_t i = 0; i != num_hashes; ++i) {
+    ++offsets[reduce(mix(hashes[i] ^ mph.seed_), num_partitions) + 1];
+  }
+  for (uint32_t i = 0; i != num_partitions; ++i) {
+    offsets[i + 1] += offsets[i];
+  }
+  for (uint32_t i = 0; i != num_hashes; ++i) {
+    const uint64_t hash = mix(hashes[i] ^ mph.seed_);
+    sorted_hashes[offsets[reduce(hash, num_partitions)]++] = hash;
+  }
+
+  uint64_t num_slots = 0;
+  uint64_t num_buckets = 0;
+  mph.partitions_.resize(num_partitions + 1);
+  for (uint32_t i = 0; i != num_partitions; ++i) {
+    const uint32_t begin = (i == 0) ? 0 : offsets[i - 1];
+    const uint32_t num_keys = offsets[i] - begin;
+    mph.partitions_[i] = {begin, static_cast<uint32_t>(num_slots),
+                          static_cast<uint32_t>(num_buckets)};
+    num_slots += getNumSlots(num_keys);
+    num_buckets += getNumBuckets(num_keys);
+  }
+  mt::Check::isLessEqual(num_slots, std::numeric_limits<uint32_t>::max(),
+                         "Too many keys");
+  mph.partitions_.back() = {num_hashes, static_cast<uint32_t>(num_slots),
+                            static_cast<uint32_t>(num_buckets)};
+  mph.pilots_.resize(num_buckets);
+  mph.remap_.resize(num_slots - num_hashes);
+
+  const auto build_partition = [&mph, &sorted_hashes](size_t i) {
+    const Partition& partition = mph.partitions_[i];
+    const Partition& next_partition = mph.partitions_[i + 1];
+    buildPartition(
+        sorted_hashes.data() + partition.key_offset,
+        next_partition.key_offset - partition.key_offset,
+        next_partition.slot_offset - partition.slot_offset,
+        next_partition.bucket_offset - partition.bucket_offset,
+        mph.pilots_.data() + partition.bucket_offset,
+        mph.remap_.data() + (partition.slot_offset - partition.key_offset));
+  };
+  if (pool) {
+    pool->parallelFor(num_partitions, build_partition);
+  } else {
+    for (uint32_t i = 0; i != num_partitions; ++i) {
+      build_partition(i);
+    }
+  }
+  return mph;
+}
+
+uint64_t Mph::hash(const Slice& key) {
+  return XXH64(key.data(), key.size(), 0);
+}
+
 uint32_t Mph::operator()(const Slice& key) const {
-  return cmph_search(cmph_.get(), reinterpret_cast<const char*>(key.begin()),
-                     key.size());
+  if (cmph_) {
+    return cmph_search(cmph_.get(),
+                       reinterpret_cast<const char*>(key.begin()), key.size());
+  }
+  return (*this)(hash(key));
+}
+
+uint32_t Mph::operator()(uint64_t hash) const {
+  MT_ASSERT_FALSE(cmph_);
+  hash = mix(hash ^ seed_);
+  const uint32_t num_partitions = partitions_.size() - 1;
+  const Partition* partition = &partitions_[reduce(hash, num_partitions)];
+  const uint32_t num_keys = partition[1].key_offset - partition->key_offset;
+  if (num_keys == 0) return 0;
+  const uint32_t num_buckets =
+      partition[1].bucket_offset - partition->bucket_offset;
+  const uint32_t num_slots = partition[1].slot_offset - partition->slot_offset;
+  const uint32_t pilot =
+      pilots_[partition->bucket_offset + getBucket(hash, num_buckets)];
+  const uint32_t slot =
+      getSlot(mix(hash ^ POSITION_SALT), pilot, num_slots);
+  if (slot < num_keys) return partition->key_offset + slot;
+  return partition->key_offset +
+         remap_[partition->slot_offset - partition->key_offset + slot -
+                num_keys];
+}
+
+uint32_t Mph::size() const {
+  return cmph_ ? cmph_size(cmph_.get()) : partitions_.back().key_offset;
 }
 
 Mph Mph::readFromFile(const boost::filesystem::path& file_path) {
   const mt::AutoCloseFile stream = mt::fopen(file_path, "r");
-  return Mph(std::unique_ptr<cmph_t, CmphDeleter>(cmph_load(stream.get())));
+  char magic[sizeof NATIVE_MAGIC];
+  if (!mt::freadAllMaybe(stream.get(), magic, sizeof magic) ||
+      std::memcmp(magic, NATIVE_MAGIC, sizeof magic) != 0) {
+    std::rewind(stream.get());
+    return Mph(std::unique_ptr<cmph_t, CmphDeleter>(cmph_load(stream.get())));
+  }
+  Mph mph;
+  uint64_t size;
+  mt::freadAll(stream.get(), &mph.seed_, sizeof mph.seed_);
+  mt::freadAll(stream.get(), &size, sizeof size);
+  mph.partitions_.resize(size);
+  mt::freadAll(stream.get(), mph.partitions_.data(), size * sizeof(Partition));
+  mt::freadAll(stream.get(), &size, sizeof size);
+  mph.pilots_.resize(size);
+  mt::freadAll(stream.get(), mph.pilots_.data(), size * sizeof(uint32_t));
+  mt::freadAll(stream.get(), &size, sizeof size);
+  mph.remap_.resize(size);
+  mt::freadAll(stream.get(), mph.remap_.data(), size * sizeof(uint32_t));
+  mt::Check::isFalse(mph.partitions_.empty(), "Invalid file %s",
+                     file_path.c_str());
+  return mph;
 }
 
 void Mph::writeToFile(const boost::filesystem::path& file_path) const {
   const mt::AutoCloseFile stream = mt::fopen(file_path, "w");
-  mt::Check::notZero(cmph_dump(cmph_.get(), stream.get()),
-                     "cmph_dump() failed");
+  if (cmph_) {
+    mt::Check::notZero(cmph_dump(cmph_.get(), stream.get()),
+                       "cmph_dump() failed");
+    return;
+  }
+  uint64_t size;
+  mt::fwriteAll(stream.get(), NATIVE_MAGIC, sizeof NATIVE_MAGIC);
+  mt::fwriteAll(stream.get(), &seed_, sizeof seed_);
+  size = partitions_.size();
+  mt::fwriteAll(stream.get(), &size, sizeof size);
+  mt::fwriteAll(stream.get(), partitions_.data(), size * sizeof(Partition));
+  size = pilots_.size();
+  mt::fwriteAll(stream.get(), &size, sizeof size);
+  mt::fwriteAll(stream.get(), pilots_.data(), size * sizeof(uint32_t));
+  size = remap_.size();
+  mt::fwriteAll(stream.get(), &size, sizeof size);
+  mt::fwriteAll(stream.get(), remap_.data(), size * sizeof(uint32_t));
 }
 
 Mph::Mph(std::unique_ptr<cmph_t, CmphDeleter> cmph) : cmph_(std::move(cmph)) {}
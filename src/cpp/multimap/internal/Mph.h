@@ -18,15 +18,31 @@
 #ifndef MULTIMAP_INTERNAL_MPH_H_
 #define MULTIMAP_INTERNAL_MPH_H_
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 #include <boost/filesystem/path.hpp>  // NOLINT
 #include "multimap/thirdparty/cmph/cmph.h"
 #include "multimap/Slice.h"
+#include "multimap/ThreadPool.h"
 
 namespace multimap {
 namespace internal {
 
 class Mph {
+  // A minimal perfect hash function, which maps n keys bijectively to
+  // [0, n). There are two implementations:
+  //
+  //   * A native one in the style of PTHash, which is built from the 64-bit
+  //     XXH64 hashes of the keys. The keys are divided into small partitions
+  //     that are built independently, possibly in parallel. Within a
+  //     partition, the keys are assigned to buckets, and each bucket stores a
+  //     pilot value that displaces its keys into free slots. An evaluation
+  //     reads a partition descriptor and a pilot, and rarely a remap entry.
+  //
+  //   * CMPH's BDZ algorithm, which was used before the native one and is
+  //     still supported for existing files.
+  //
   // This class is read-only and does not need external locking.
 
  public:
@@ -34,17 +50,35 @@ class Mph {
   Mph& operator=(Mph&&) = default;
 
   static Mph build(const byte** keys, uint32_t nkeys);
+  // Builds a CMPH function.
   // A key in `keys` points to memory which is encoded like this:
   // [keylen as uint32][1 .. keydata .. keylen]
 
   static Mph build(const boost::filesystem::path& keys_file_path);
+  // Builds a CMPH function.
   // `keys` contains a sequence of keys which are encoded as described above.
 
+  static Mph build(const uint64_t* hashes, uint32_t num_hashes,
+                   ThreadPool* pool = nullptr);
+  // Builds a native function from the hashes of the keys as returned by
+  // hash(), which must be distinct. The partitions are built in parallel if
+  // a thread pool is given.
+
+  static uint64_t hash(const Slice& key);
+  // Returns the hash that the native function is built from. It is the same
+  // hash that selects the partition of a key in an immutable map.
+
   uint32_t operator()(const Slice& key) const;
 
-  uint32_t size() const { return cmph_size(cmph_.get()); }
+  uint32_t operator()(uint64_t hash) const;
+  // Evaluates a native function for a key with the given hash.
+
+  uint32_t size() const;
+
+  bool isNative() const { return !cmph_; }
 
   static Mph readFromFile(const boost::filesystem::path& file_path);
+  // Reads both native and CMPH functions.
 
   void writeToFile(const boost::filesystem::path& file_path) const;
 
@@ -55,9 +89,27 @@ class Mph {
     }
   };
 
+  struct Partition {
+    // Prefix sums over all partitions. The values of the next partition
+    // delimit the ranges of this one.
+    uint32_t key_offset;
+    uint32_t slot_offset;
+    uint32_t bucket_offset;
+  };
+
+  Mph() = default;
+
   explicit Mph(std::unique_ptr<cmph_t, CmphDeleter> cmph);
 
   std::unique_ptr<cmph_t, CmphDeleter> cmph_;
+
+  uint64_t seed_ = 0;
+  std::vector<Partition> partitions_;
+  std::vector<uint32_t> pilots_;
+  std::vector<uint32_t> remap_;
+  // The native function; `partitions_` has one more element than there are
+  // partitions, and `remap_` maps each slot behind the keys of a partition
+  // to a free slot in front of them.
 };
 
 }  // namespace internal
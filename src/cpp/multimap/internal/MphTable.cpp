@@ -18,12 +18,21 @@
 #include "multimap/internal/MphTable.h"
 
 #include <algorithm>
+#include <chrono>  // NOLINT
 #include <limits>
+#include <list>
+#include <mutex>  // NOLINT
+#include <queue>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <boost/filesystem/operations.hpp>  // NOLINT
+#include <boost/iostreams/device/array.hpp>  // NOLINT
+#include <boost/iostreams/device/back_inserter.hpp>  // NOLINT
+#include <boost/iostreams/filter/zlib.hpp>  // NOLINT
+#include <boost/iostreams/filtering_stream.hpp>  // NOLINT
+#include "multimap/internal/HugePages.h"
 #include "multimap/thirdparty/mt/assert.h"
 #include "multimap/thirdparty/mt/check.h"
 #include "multimap/thirdparty/mt/memory.h"
@@ -34,13 +43,51 @@ namespace multimap {
 namespace internal {
 
 namespace fs = boost::filesystem;
+namespace io = boost::iostreams;
 
 namespace {
 
+size_t readListHeader(const byte* pos, bool tagged, uint32_t* num_values,
+                      bool* compressed) {
+  // Reads the number of values of a list, which follows the key. If `tagged`
+  // is true, its lowest bit tells whether the values are compressed.
+  const size_t num_bytes = mt::readVarint32FromBuffer(pos, num_values);
+  *compressed = tagged && (*num_values & 1);
+  if (tagged) *num_values >>= 1;
+  return num_bytes;
+}
+
+const byte* decompressValues(const byte* pos, Bytes* values) {
+  // Decompresses the values that follow the header of a compressed list and
+  // returns the end of the compressed data.
+  uint32_t size;
+  uint32_t compressed_size;
+  pos += mt::readVarint32FromBuffer(pos, &size);
+  pos += mt::readVarint32FromBuffer(pos, &compressed_size);
+  values->resize(size);
+  io::filtering_istream istream;
+  istream.push(io::zlib_decompressor());
+  istream.push(
+      io::array_source(reinterpret_cast<const char*>(pos), compressed_size));
+  mt::readAll(&istream, values->data(), size);
+  return pos + compressed_size;
+}
+
+const byte* skipCompressedValues(const byte* pos) {
+  // Returns the end of the compressed values that follow the header of a
+  // compressed list without decompressing them.
+  uint32_t size;
+  uint32_t compressed_size;
+  pos += mt::readVarint32FromBuffer(pos, &size);
+  pos += mt::readVarint32FromBuffer(pos, &compressed_size);
+  return pos + compressed_size;
+}
+
 class ListIter : public Iterator {
  public:
-  ListIter(const byte* buffer, size_t num_values)
-      : pos_(buffer), num_values_(num_values) {}
+  ListIter(const byte* buffer, size_t num_values,
+           std::shared_ptr<const Bytes> owner = nullptr)
+      : pos_(buffer), num_values_(num_values), owner_(std::move(owner)) {}
 
   size_t available() const override { return num_values_; }
 
@@ -61,10 +108,112 @@ class ListIter : public Iterator {
  private:
   const byte* pos_ = nullptr;
   size_t num_values_ = 0;
+  std::shared_ptr<const Bytes> owner_;
+  // Keeps decompressed values alive.
 };
 
-fs::path getPathOfRecordsFile(const fs::path& prefix) {
-  return prefix.string() + ".records";
+class ListsCursor : public Cursor {
+  // Walks the lists file sequentially, taking advantage of the fact that
+  // lists are stored back to back, each one beginning at a block boundary.
+  // Moving to the next list only reads the size fields of the values, or the
+  // compressed size of a compressed list. The values are decoded when first
+  // requested, so that cursors that only need the keys skip their data.
+
+ public:
+  ListsCursor(const byte* lists, size_t begin_block, size_t end_block,
+              size_t block_size, bool tagged)
+      : lists_(lists),
+        pos_(lists + begin_block * block_size),
+        end_(lists + end_block * block_size),
+        block_size_(block_size),
+        tagged_(tagged),
+        iter_(nullptr, 0) {}
+
+  bool next() override {
+    if (pos_ >= end_) return false;
+    key_ = Slice::readFromBuffer(pos_);
+    const byte* pos = key_.end();
+    pos += readListHeader(pos, tagged_, &num_values_, &compressed_);
+    values_begin_ = pos;
+    values_decoded_ = false;
+    if (compressed_) {
+      pos = skipCompressedValues(pos);
+    } else {
+      for (uint32_t i = 0; i != num_values_; ++i) {
+        pos = Slice::readFromBuffer(pos).end();
+      }
+    }
+    const size_t offset = pos - lists_;
+    const size_t remainder = offset % block_size_;
+    pos_ = remainder ? (pos + block_size_ - remainder) : pos;
+    return true;
+  }
+
+  Slice key() const override { return key_; }
+
+  Iterator* values() override {
+    if (!values_decoded_) {
+      if (compressed_) {
+        decompressValues(values_begin_, &values_);
+        iter_ = ListIter(values_.data(), num_values_);
+      } else {
+        iter_ = ListIter(values_begin_, num_values_);
+      }
+      values_decoded_ = true;
+    }
+    return &iter_;
+  }
+
+ private:
+  const byte* lists_;
+  const byte* pos_;
+  const byte* end_;
+  size_t block_size_;
+  bool tagged_;
+  Slice key_;
+  const byte* values_begin_ = nullptr;
+  uint32_t num_values_ = 0;
+  bool compressed_ = false;
+  bool values_decoded_ = false;
+  Bytes values_;
+  ListIter iter_;
+};
+
+class RangeCursor : public Cursor {
+  // Skips the lists whose keys are less than `begin_key` and stops at the
+  // first list whose key is not less than `end_key`, unless the latter is
+  // empty. Relies on the lists being sorted by key.
+
+ public:
+  RangeCursor(ListsCursor&& cursor, const Slice& begin_key,
+              const Slice& end_key)
+      : cursor_(std::move(cursor)),
+        begin_key_(begin_key.makeCopy()),
+        end_key_(end_key.makeCopy()) {}
+
+  bool next() override {
+    while (!done_ && cursor_.next()) {
+      if (cursor_.key() < begin_key_) continue;
+      done_ = !end_key_.empty() && cursor_.key() >= end_key_;
+      return !done_;
+    }
+    done_ = true;
+    return false;
+  }
+
+  Slice key() const override { return cursor_.key(); }
+
+  Iterator* values() override { return cursor_.values(); }
+
+ private:
+  ListsCursor cursor_;
+  Bytes begin_key_;
+  Bytes end_key_;
+  bool done_ = false;
+};
+
+fs::path getPathOfRecordsFile(const fs::path& prefix, size_t index) {
+  return prefix.string() + ".records." + std::to_string(index);
 }
 
 fs::path getPathOfListsFile(const fs::path& prefix) {
@@ -83,148 +232,512 @@ fs::path getPathOfTableFile(const fs::path& prefix) {
   return prefix.string() + ".table";
 }
 
+size_t getThreadIndex() {
+  // Returns a number that is unique for the calling thread. Consecutively
+  // started threads get consecutive numbers.
+  static std::atomic<size_t> next_index(0);
+  thread_local const size_t index = next_index++;
+  return index;
+}
+
+fs::path getPathOfLayoutFile(const fs::path& prefix) {
+  return prefix.string() + ".layout";
+}
+
+fs::path getPathOfOffsetsFile(const fs::path& prefix) {
+  return prefix.string() + ".offsets";
+}
+
+fs::path getPathOfKeysFile(const fs::path& prefix) {
+  return prefix.string() + ".keys";
+}
+
+fs::path getPathOfKeyIndexFile(const fs::path& prefix) {
+  return prefix.string() + ".index";
+}
+
+fs::path getPathOfPositionsFile(const fs::path& prefix) {
+  return prefix.string() + ".positions";
+}
+
+fs::path getPathOfRunFile(const fs::path& prefix, size_t index) {
+  return prefix.string() + ".run." + std::to_string(index);
+}
+
 typedef std::vector<Slice> List;
 typedef std::vector<uint32_t> Table;
+typedef std::pair<Slice, Slice> Record;
 
-struct Multimap : public std::unordered_map<Slice, List> {
-  Arena keys_arena, values_arena;
+class Run {
+  // A sequence of records sorted by key. Records with equal keys keep the
+  // order in which they were put.
+
+ public:
+  virtual ~Run() = default;
+
+  virtual bool next() = 0;
+  // Moves to the next record and returns false if there is none.
+
+  const Slice& key() const { return key_; }
+
+  const Slice& value() const { return value_; }
+
+ protected:
+  Slice key_;
+  Slice value_;
 };
 
-Multimap readRecordsFromFile(const fs::path& file_path) {
-  Multimap map;
-  Bytes key, value;
-  mt::InputStream istream = mt::newFileInputStream(file_path);
-  while (readBytesFromStream(istream.get(), &key) &&
-         readBytesFromStream(istream.get(), &value)) {
-    auto iter = map.find(key);
-    if (iter == map.end()) {
-      const uint32_t key_size = key.size();
-      byte* new_full_key = map.keys_arena.allocate(sizeof key_size + key_size);
-      std::memcpy(new_full_key, &key_size, sizeof key_size);
-      byte* new_key_data = new_full_key + sizeof key_size;
-      std::memcpy(new_key_data, key.data(), key_size);
-      iter = map.emplace(Slice(new_key_data, key_size), List()).first;
-      // New keys are stored in a way that they work as input for CMPH.
-    }
-    byte* new_value_data = map.values_arena.allocate(value.size());
-    std::memcpy(new_value_data, value.data(), value.size());
-    iter->second.emplace_back(new_value_data, value.size());
-  }
-  return map;
-}
-
-Mph buildMphFromKeys(const Multimap& map) {
-  uint32_t key_size;
-  auto iter = map.begin();
-  std::vector<const byte*> keys(map.size());
-  for (size_t i = 0; i != keys.size(); ++i, ++iter) {
-    const byte* full_key_begin = iter->first.begin() - sizeof key_size;
-    keys[i] = full_key_begin;
-  }
-  return Mph::build(keys.data(), keys.size());
-}
-
-Stats writeMap(const fs::path& prefix, const Multimap& map, const Mph& mph,
-               Options options) {
-  const fs::path mph_file_path = getPathOfMphFile(prefix);
-  if (options.verbose) {
-    mt::log() << "Writing " << mph_file_path.string() << std::endl;
+class MemoryRun : public Run {
+ public:
+  MemoryRun(std::vector<Record>&& records, Arena&& arena)
+      : records_(std::move(records)), arena_(std::move(arena)) {}
+
+  bool next() override {
+    if (pos_ == records_.size()) return false;
+    key_ = records_[pos_].first;
+    value_ = records_[pos_].second;
+    ++pos_;
+    return true;
   }
-  mph.writeToFile(mph_file_path);
 
-  Table table(map.size());
-  const Bytes zeros(options.block_size, 0);
-  const fs::path lists_file_path = getPathOfListsFile(prefix);
-  if (options.verbose) {
-    mt::log() << "Writing " << lists_file_path.string() << std::endl;
+ private:
+  std::vector<Record> records_;
+  Arena arena_;
+  size_t pos_ = 0;
+};
+
+class FileRun : public Run {
+  // The run file is removed when the run is destroyed.
+
+ public:
+  explicit FileRun(const fs::path& file_path)
+      : istream_(mt::newFileInputStream(file_path)), file_path_(file_path) {}
+
+  ~FileRun() override {
+    istream_.reset();
+    fs::remove(file_path_);
   }
-  mt::OutputStream lists_ostream = mt::newFileOutputStream(lists_file_path);
 
-  Stats stats;
-  stats.num_keys_total = map.size();
-  stats.num_keys_valid = map.size();
-  for (const std::pair<const Slice, List>& entry : map) {
-    auto offset = lists_ostream->tellp();
-    if (const auto remainder = offset % options.block_size) {
-      const auto padding = options.block_size - remainder;
-      mt::writeAll(lists_ostream.get(), &zeros, padding);
-      offset += padding;
+  bool next() override {
+    if (readBytesFromStream(istream_.get(), &key_bytes_) &&
+        readBytesFromStream(istream_.get(), &value_bytes_)) {
+      key_ = key_bytes_;
+      value_ = value_bytes_;
+      return true;
     }
-    const Slice& key = entry.first;
-    const List& list = entry.second;
-    table[mph(key)] = offset / options.block_size;
+    return false;
+  }
 
-    key.writeToStream(lists_ostream.get());
-    mt::writeVarint32ToStream(list.size(), lists_ostream.get());
-    for (const Slice& value : list) {
-      value.writeToStream(lists_ostream.get());
-    }
-
-    stats.key_size_avg += key.size();
-    stats.key_size_max = mt::max(stats.key_size_max, key.size());
-    stats.key_size_min = stats.key_size_min
-                             ? mt::min(stats.key_size_min, key.size())
-                             : key.size();
-    stats.list_size_avg += list.size();
-    stats.list_size_max = mt::max(stats.list_size_max, list.size());
-    stats.list_size_min = stats.list_size_min
-                              ? mt::min(stats.list_size_min, list.size())
-                              : list.size();
-    stats.num_values_total += list.size();
-    stats.num_values_valid += list.size();
-  }
-  if (stats.num_keys_total) {
-    stats.key_size_avg /= stats.num_keys_total;
-    stats.list_size_avg /= stats.num_keys_total;
-  }
-  auto offset = lists_ostream->tellp();
-  if (const auto remainder = offset % options.block_size) {
-    const auto padding = options.block_size - remainder;
-    mt::writeAll(lists_ostream.get(), &zeros, padding);
-    offset += padding;
-  }
-  stats.block_size = options.block_size;
-  stats.num_blocks = offset / options.block_size;
-
-  const fs::path table_file_path = getPathOfTableFile(prefix);
-  if (options.verbose) {
-    mt::log() << "Writing " << table_file_path.string() << std::endl;
+ private:
+  mt::InputStream istream_;
+  fs::path file_path_;
+  Bytes key_bytes_;
+  Bytes value_bytes_;
+};
+
+class MergedRun : public Run {
+  // Merges several runs into one. Records with equal keys are ordered by the
+  // index of their run, so earlier runs must contain earlier records.
+
+ public:
+  explicit MergedRun(std::vector<std::unique_ptr<Run> >&& runs)
+      : runs_(std::move(runs)), heap_(Greater{&runs_}) {
+    for (size_t i = 0; i != runs_.size(); ++i) {
+      if (runs_[i]->next()) heap_.push(i);
+    }
   }
-  mt::OutputStream table_ostream = mt::newFileOutputStream(table_file_path);
-  mt::writeAll(table_ostream.get(), table.data(),
-               table.size() * sizeof(Table::value_type));
 
-  const fs::path stats_file_path = getPathOfStatsFile(prefix);
-  if (options.verbose) {
-    mt::log() << "Writing " << stats_file_path.string() << std::endl;
+  bool next() override {
+    // The current record stays valid until its run is advanced.
+    if (current_ != runs_.size() && runs_[current_]->next()) {
+      heap_.push(current_);
+    }
+    if (heap_.empty()) {
+      current_ = runs_.size();
+      return false;
+    }
+    current_ = heap_.top();
+    heap_.pop();
+    key_ = runs_[current_]->key();
+    value_ = runs_[current_]->value();
+    return true;
   }
-  stats.writeToFile(stats_file_path);
 
-  return stats;
+ private:
+  struct Greater {
+    bool operator()(size_t a, size_t b) const {
+      const Slice& key_a = (*runs)[a]->key();
+      const Slice& key_b = (*runs)[b]->key();
+      if (key_b < key_a) return true;
+      if (key_a < key_b) return false;
+      return a > b;
+    }
+    const std::vector<std::unique_ptr<Run> >* runs;
+  };
+
+  std::vector<std::unique_ptr<Run> > runs_;
+  std::priority_queue<size_t, std::vector<size_t>, Greater> heap_;
+  size_t current_ = runs_.size();
+};
+
+std::unique_ptr<Run> writeRunToFile(Run* run, const fs::path& file_path,
+                                    bool verbose) {
+  if (verbose) {
+    mt::log() << "Writing " << file_path.string() << std::endl;
+  }
+  {
+    mt::OutputStream ostream = mt::newFileOutputStream(file_path);
+    while (run->next()) {
+      run->key().writeToStream(ostream.get());
+      run->value().writeToStream(ostream.get());
+    }
+  }
+  return std::unique_ptr<Run>(new FileRun(file_path));
 }
 
+const size_t MAX_MERGE_WIDTH = 64;
+// Limits the number of run files that are open at the same time.
+
+std::unique_ptr<Run> sortRecords(const fs::path& prefix,
+                                 const std::vector<fs::path>& records_files,
+                                 size_t max_memory, bool verbose,
+                                 size_t* peak_memory) {
+  // Reads the records files one after another in chunks that fit into
+  // `max_memory`, sorts each chunk by key, and writes it to a run file. The
+  // last chunk stays in memory. Whenever there are too many run files, they
+  // are merged into one. The memory used by the chunks is tracked in
+  // `peak_memory`.
+  std::vector<std::unique_ptr<Run> > runs;
+  std::vector<Record> records;
+  Arena arena;
+  Bytes key, value;
+  size_t num_run_files = 0;
+  const auto get_memory_usage = [&records, &arena]() {
+    // std::stable_sort may allocate a buffer as large as the input.
+    return arena.allocated() + records.capacity() * sizeof(Record) * 2;
+  };
+  const auto sort_records = [&records]() {
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) {
+                       return a.first < b.first;
+                     });
+  };
+  for (const fs::path& records_file_path : records_files) {
+    mt::InputStream istream = mt::newFileInputStream(records_file_path);
+    while (readBytesFromStream(istream.get(), &key) &&
+           readBytesFromStream(istream.get(), &value)) {
+      records.emplace_back(Slice::makeCopy(key, &arena),
+                           Slice::makeCopy(value, &arena));
+      const size_t memory_usage = get_memory_usage();
+      *peak_memory = mt::max(*peak_memory, memory_usage);
+      if (memory_usage < max_memory) continue;
+
+      if (runs.size() == MAX_MERGE_WIDTH) {
+        MergedRun merged_run(std::move(runs));
+        runs.clear();
+        runs.push_back(writeRunToFile(
+            &merged_run, getPathOfRunFile(prefix, num_run_files++), verbose));
+      }
+      sort_records();
+      MemoryRun memory_run(std::move(records), std::move(arena));
+      runs.push_back(writeRunToFile(
+          &memory_run, getPathOfRunFile(prefix, num_run_files++), verbose));
+      records.clear();
+      arena = Arena();
+    }
+    istream.reset();
+    MT_ASSERT_TRUE(fs::remove(records_file_path));
+  }
+  sort_records();
+  runs.emplace_back(new MemoryRun(std::move(records), std::move(arena)));
+  return std::unique_ptr<Run>(new MergedRun(std::move(runs)));
+}
+
+class ListsWriter {
+  // Appends lists to the lists file back to back and collects the statistics.
+  // If `compress` is true, the number of values is tagged, and the values of
+  // lists with at least `min_compressed_size` bytes are compressed if that
+  // makes them smaller. A compressed list is encoded as follows:
+  // [key][num values << 1 | 1][size][compressed size][compressed values]
+
+ public:
+  ListsWriter(const fs::path& file_path, bool compress,
+              size_t min_compressed_size)
+      : ostream_(mt::newFileOutputStream(file_path)),
+        compress_(compress),
+        min_compressed_size_(min_compressed_size) {
+    stats_.block_size = 1;
+  }
+
+  uint64_t write(const Slice& key, const List& list) {
+    // Returns the offset where the list begins.
+    const uint64_t offset = ostream_->tellp();
+    key.writeToStream(ostream_.get());
+    if (compress_) {
+      writeTagged(list);
+    } else {
+      mt::writeVarint32ToStream(list.size(), ostream_.get());
+      for (const Slice& value : list) {
+        value.writeToStream(ostream_.get());
+      }
+    }
+    updateStats(key.size(), list.size());
+    return offset;
+  }
+
+  uint64_t beginList(const Slice& key) {
+    // Starts a list whose values are appended one at a time, so that it does
+    // not have to be held in memory. Returns the offset where the list
+    // begins. The number of values is not known yet and is written as a
+    // varint of maximum length, which endList() overwrites. Such lists are
+    // never compressed.
+    const uint64_t offset = ostream_->tellp();
+    key.writeToStream(ostream_.get());
+    num_values_offset_ = ostream_->tellp();
+    writePaddedVarint32(0);
+    key_size_ = key.size();
+    num_values_ = 0;
+    return offset;
+  }
+
+  void append(const Slice& value) {
+    value.writeToStream(ostream_.get());
+    num_values_++;
+  }
+
+  void endList() {
+    if (compress_) {
+      MT_REQUIRE_LT(num_values_, std::numeric_limits<uint32_t>::max() / 2);
+    }
+    const std::streampos end = ostream_->tellp();
+    ostream_->seekp(num_values_offset_);
+    writePaddedVarint32(compress_ ? num_values_ << 1 : num_values_);
+    ostream_->seekp(end);
+    updateStats(key_size_, num_values_);
+  }
+
+  Stats finish() {
+    if (stats_.num_keys_total) {
+      stats_.key_size_avg /= stats_.num_keys_total;
+      stats_.list_size_avg /= stats_.num_keys_total;
+    }
+    stats_.num_blocks = ostream_->tellp();
+    ostream_.reset();
+    return stats_;
+  }
+
+  size_t getNumCompressedLists() const { return num_compressed_lists_; }
+
+ private:
+  void updateStats(size_t key_size, size_t num_values) {
+    stats_.num_keys_total++;
+    stats_.num_keys_valid++;
+    stats_.key_size_avg += key_size;
+    stats_.key_size_max = mt::max(stats_.key_size_max, key_size);
+    stats_.key_size_min = stats_.key_size_min
+                              ? mt::min(stats_.key_size_min, key_size)
+                              : key_size;
+    stats_.list_size_avg += num_values;
+    stats_.list_size_max = mt::max(stats_.list_size_max, num_values);
+    stats_.list_size_min = stats_.list_size_min
+                               ? mt::min(stats_.list_size_min, num_values)
+                               : num_values;
+    stats_.num_values_total += num_values;
+    stats_.num_values_valid += num_values;
+  }
+
+  void writePaddedVarint32(uint32_t value) {
+    // Readers accept varints that are padded with continuation bytes.
+    byte buffer[mt::MAX_VARINT32_BYTES];
+    for (byte& b : buffer) {
+      b = (value & 0x7f) | 0x80;
+      value >>= 7;
+    }
+    buffer[mt::MAX_VARINT32_BYTES - 1] &= 0x7f;
+    mt::writeAll(ostream_.get(), buffer, sizeof buffer);
+  }
+
+  void writeTagged(const List& list) {
+    MT_REQUIRE_LT(list.size(), std::numeric_limits<uint32_t>::max() / 2);
+    values_.clear();
+    byte size[mt::MAX_VARINT32_BYTES];
+    for (const Slice& value : list) {
+      const size_t num_bytes =
+          mt::writeVarint32ToBuffer(value.size(), size, std::end(size));
+      values_.insert(values_.end(), size, size + num_bytes);
+      values_.insert(values_.end(), value.begin(), value.end());
+    }
+    if (values_.size() >= min_compressed_size_) {
+      compressed_.clear();
+      {
+        io::filtering_ostream ostream;
+        ostream.push(io::zlib_compressor(io::zlib::best_speed));
+        ostream.push(io::back_inserter(compressed_));
+        mt::writeAll(&ostream, values_.data(), values_.size());
+      }
+      if (compressed_.size() < values_.size()) {
+        mt::writeVarint32ToStream(list.size() << 1 | 1, ostream_.get());
+        mt::writeVarint32ToStream(values_.size(), ostream_.get());
+        mt::writeVarint32ToStream(compressed_.size(), ostream_.get());
+        mt::writeAll(ostream_.get(), compressed_.data(), compressed_.size());
+        num_compressed_lists_++;
+        return;
+      }
+    }
+    mt::writeVarint32ToStream(list.size() << 1, ostream_.get());
+    mt::writeAll(ostream_.get(), values_.data(), values_.size());
+  }
+
+  mt::OutputStream ostream_;
+  bool compress_;
+  size_t min_compressed_size_;
+  size_t num_compressed_lists_ = 0;
+  std::streampos num_values_offset_;
+  size_t key_size_ = 0;
+  size_t num_values_ = 0;
+  Bytes values_;
+  std::vector<char> compressed_;
+  Stats stats_;
+};
+
 const byte* getListBegin(const mt::AutoUnmapMemory& lists, size_t block_id,
                          size_t block_size) {
   return lists.data() + block_id * block_size;
 }
 
-uint32_t getTableEntry(const mt::AutoUnmapMemory& table, size_t index) {
-  return *reinterpret_cast<const Table::value_type*>(
-             table.data() + index * sizeof(Table::value_type));
+uint32_t getListId(const byte* slot) {
+  uint32_t list_id;
+  std::memcpy(&list_id, slot, sizeof list_id);
+  return list_id;
+}
+
+uint32_t getFingerprint(uint64_t hash, uint32_t fingerprint_bits) {
+  return hash >> (64 - fingerprint_bits);
+}
+
+uint32_t getFingerprint(const byte* slot, uint32_t fingerprint_bits) {
+  uint32_t fingerprint = 0;
+  std::memcpy(&fingerprint, slot + sizeof(uint32_t), fingerprint_bits / 8);
+  return fingerprint;
+}
+
+const byte* getInlineList(const byte* slot, const MphTable::Layout& layout) {
+  // Returns null if the slot does not contain the list.
+  const byte* pos = slot + sizeof(uint32_t) + layout.fingerprint_bits / 8;
+  return (layout.inline_list_bytes != 0 && *pos != 0) ? pos + 1 : nullptr;
 }
 
-size_t getTableSize(const mt::AutoUnmapMemory& table) {
-  return table.size() / sizeof(Table::value_type);
+void setSlot(byte* slot, uint32_t list_id, uint64_t hash,
+             const byte* inline_list, const MphTable::Layout& layout) {
+  // `inline_list` points to the size byte followed by the list, if any.
+  std::memcpy(slot, &list_id, sizeof list_id);
+  slot += sizeof list_id;
+  if (layout.fingerprint_bits != 0) {
+    const uint32_t fingerprint = getFingerprint(hash, layout.fingerprint_bits);
+    std::memcpy(slot, &fingerprint, layout.fingerprint_bits / 8);
+    slot += layout.fingerprint_bits / 8;
+  }
+  if (layout.inline_list_bytes != 0) {
+    std::memcpy(slot, inline_list, layout.inline_list_bytes + 1);
+  }
+}
+
+size_t writeListToBuffer(const Slice& key, const List& list, bool tagged,
+                         byte* begin, byte* end) {
+  // Uses the encoding of the lists file for uncompressed lists. Returns the
+  // number of bytes written, or zero if there was not sufficient space.
+  byte* pos = begin;
+  size_t num_bytes = key.writeToBuffer(pos, end);
+  if (num_bytes == 0) return 0;
+  pos += num_bytes;
+  const uint32_t num_values = tagged ? list.size() << 1 : list.size();
+  num_bytes = mt::writeVarint32ToBuffer(num_values, pos, end);
+  if (num_bytes == 0) return 0;
+  pos += num_bytes;
+  for (const Slice& value : list) {
+    num_bytes = value.writeToBuffer(pos, end);
+    if (num_bytes == 0) return 0;
+    pos += num_bytes;
+  }
+  return pos - begin;
 }
 
-Table makeCopy(const mt::AutoUnmapMemory& table) {
-  Table copy(getTableSize(table));
-  std::memcpy(copy.data(), table.data(), table.size());
-  return copy;
+size_t getVarint32Size(uint32_t value) {
+  byte buffer[mt::MAX_VARINT32_BYTES];
+  return mt::writeVarint32ToBuffer(value, buffer, std::end(buffer));
+}
+
+uint64_t getValuesSize(const List& list) {
+  // Returns the number of bytes of the encoded values.
+  uint64_t size = 0;
+  for (const Slice& value : list) {
+    size += getVarint32Size(value.size()) + value.size();
+  }
+  return size;
+}
+
+void writePositions(const List& list, std::ostream* ostream) {
+  uint32_t position = 0;
+  for (const Slice& value : list) {
+    mt::writeAll(ostream, &position, sizeof position);
+    position += getVarint32Size(value.size()) + value.size();
+  }
+}
+
+Table getSortedListIds(const mt::AutoUnmapMemory& table, size_t slot_size) {
+  Table list_ids(table.size() / slot_size);
+  for (size_t i = 0; i != list_ids.size(); ++i) {
+    list_ids[i] = getListId(table.data() + i * slot_size);
+  }
+  std::sort(list_ids.begin(), list_ids.end());
+  return list_ids;
 }
 
 }  // namespace
 
+class MphTable::ListCache {
+  // Holds recently used decompressed lists, keyed by the position of their
+  // compressed values, and evicts the least recently used ones when the
+  // total size exceeds the limit. Lists that are returned by get() remain
+  // valid after being evicted.
+
+ public:
+  explicit ListCache(size_t max_memory) : max_memory_(max_memory) {}
+
+  std::shared_ptr<const Bytes> get(const byte* pos) {
+    std::lock_guard<Mutex> lock(mutex_);
+    const auto iter = index_.find(pos);
+    if (iter == index_.end()) return nullptr;
+    entries_.splice(entries_.begin(), entries_, iter->second);
+    return iter->second->second;
+  }
+
+  void put(const byte* pos, std::shared_ptr<const Bytes> values) {
+    const size_t size = values->size();
+    if (size > max_memory_) return;
+    std::lock_guard<Mutex> lock(mutex_);
+    if (index_.count(pos)) return;
+    entries_.emplace_front(pos, std::move(values));
+    index_[pos] = entries_.begin();
+    memory_ += size;
+    while (memory_ > max_memory_) {
+      memory_ -= entries_.back().second->size();
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  typedef std::pair<const byte*, std::shared_ptr<const Bytes> > Entry;
+
+  Mutex mutex_;
+  std::list<Entry> entries_;
+  std::unordered_map<const byte*, std::list<Entry>::iterator> index_;
+  size_t memory_ = 0;
+  size_t max_memory_;
+  // `entries_` is ordered from most to least recently used.
+};
+
 size_t MphTable::Limits::maxKeySize() {
   return std::numeric_limits<uint32_t>::max();
 }
@@ -234,119 +747,682 @@ size_t MphTable::Limits::maxValueSize() {
 }
 
 MphTable::Builder::Builder(const fs::path& prefix, const Options& options)
-    : ostream_(mt::newFileOutputStream(getPathOfRecordsFile(prefix))),
-      prefix_(prefix),
-      options_(options) {}
+    : stripes_(new Stripe[NUM_STRIPES]), prefix_(prefix), options_(options) {
+  mt::Check::isTrue(options.fingerprint_bits % 8 == 0 &&
+                        options.fingerprint_bits <= 32,
+                    "Invalid fingerprint width: %zu", options.fingerprint_bits);
+  mt::Check::isTrue(options.inline_list_bytes <= 255,
+                    "Invalid inline list size: %zu", options.inline_list_bytes);
+}
 
 MphTable::Builder::~Builder() {
-  if (ostream_) {
-    ostream_.reset();
-    fs::remove(getPathOfRecordsFile(prefix_));
+  if (stripes_) {
+    stripes_.reset();
+    for (size_t i = 0; i != NUM_STRIPES; ++i) {
+      fs::remove(getPathOfRecordsFile(prefix_, i));
+    }
   }
 }
 
 void MphTable::Builder::put(const Slice& key, const Slice& value) {
   MT_REQUIRE_LE(key.size(), Limits::maxKeySize());
   MT_REQUIRE_LE(value.size(), Limits::maxValueSize());
-  key.writeToStream(ostream_.get());
-  value.writeToStream(ostream_.get());
+  // A thread always uses the same stripe, which keeps its values in order.
+  const size_t index = getThreadIndex() % NUM_STRIPES;
+  Stripe& stripe = stripes_[index];
+  std::lock_guard<Mutex> lock(stripe.mutex);
+  if (!stripe.ostream) {
+    stripe.ostream =
+        mt::newFileOutputStream(getPathOfRecordsFile(prefix_, index));
+  }
+  key.writeToStream(stripe.ostream.get());
+  value.writeToStream(stripe.ostream.get());
 }
 
 Stats MphTable::Builder::build() {
-  MT_REQUIRE_TRUE(ostream_);
-  ostream_.reset();
-  const fs::path records_file_path = getPathOfRecordsFile(prefix_);
-  const size_t records_file_size = fs::file_size(records_file_path);
-  const size_t max_block_id = std::numeric_limits<Table::value_type>::max();
-  options_.block_size = (records_file_size / max_block_id) + 1;
-  Multimap map = readRecordsFromFile(records_file_path);
-  MT_ASSERT_TRUE(fs::remove(records_file_path));
-
-  if (options_.compare) {
-    for (std::pair<const Slice, List>& entry : map) {
-      std::sort(entry.second.begin(), entry.second.end(), options_.compare);
-    }
-  }
-
-  if (options_.filter) {
-    Arena filtered_values_arena;
-    for (auto it = map.begin(); it != map.end();) {
-      List filtered_values;
-      auto list_iter = makeRangeIterator(it->second.begin(), it->second.end());
-      options_.filter(it->first, &list_iter,
-                      [&filtered_values, &filtered_values_arena](
-                          const Slice& filtered_value) {
-                        if (!filtered_value.empty()) {
-                          filtered_values.push_back(
-                              filtered_value.makeCopy(&filtered_values_arena));
-                        }
-                      });
-      if (filtered_values.empty()) {
-        it = map.erase(it);
-      } else {
-        it->second = filtered_values;
-        ++it;
+  return build(options_.max_build_memory, nullptr);
+}
+
+Stats MphTable::Builder::build(size_t max_memory, ThreadPool* pool) {
+  MT_REQUIRE_TRUE(stripes_);
+  if (pool) requireMultiThreading("Thread pools");
+  const auto start = std::chrono::steady_clock::now();
+  size_t peak_memory = 0;
+  std::vector<fs::path> records_files;
+  for (size_t i = 0; i != NUM_STRIPES; ++i) {
+    if (stripes_[i].ostream) {
+      stripes_[i].ostream.reset();
+      records_files.push_back(getPathOfRecordsFile(prefix_, i));
+    }
+  }
+  stripes_.reset();
+  std::unique_ptr<Run> run = sortRecords(prefix_, records_files, max_memory,
+                                         options_.verbose, &peak_memory);
+
+  const fs::path lists_file_path = getPathOfListsFile(prefix_);
+  if (options_.verbose) {
+    mt::log() << "Writing " << lists_file_path.string() << std::endl;
+  }
+  ListsWriter lists_writer(lists_file_path, options_.compress_lists,
+                           options_.min_compressed_list_size);
+  const fs::path keys_file_path = getPathOfKeysFile(prefix_);
+  mt::OutputStream keys_ostream = mt::newFileOutputStream(keys_file_path);
+  Layout layout;
+  layout.fingerprint_bits = options_.fingerprint_bits;
+  layout.inline_list_bytes = options_.inline_list_bytes;
+  layout.compressed_lists = options_.compress_lists;
+  layout.sorted_keys = options_.sorted_keys;
+  layout.indexed_lists = options_.index_lists;
+  // A filter may reorder or replace the sorted values.
+  layout.sorted_values =
+      options_.index_lists && options_.compare && !options_.filter;
+  const size_t inline_stride =
+      layout.inline_list_bytes != 0 ? layout.inline_list_bytes + 1 : 0;
+  std::vector<uint64_t> offsets;
+  std::vector<uint64_t> hashes;
+  Bytes inline_lists;
+  size_t num_inline_lists = 0;
+  std::vector<Bytes> indexed_keys;
+  std::vector<size_t> indexed_ranks;
+  uint64_t next_indexed_offset = 0;
+  mt::OutputStream positions_ostream;
+  if (layout.indexed_lists) {
+    positions_ostream =
+        mt::newFileOutputStream(getPathOfPositionsFile(prefix_));
+  }
+  std::vector<uint64_t> indexed_lists;
+  std::vector<uint64_t> first_positions;
+  uint64_t num_positions = 0;
+  // The keys file, `offsets`, `hashes`, and `inline_lists` are in the same
+  // order. The latter has a size byte plus `inline_list_bytes` per key, where
+  // the size is zero for lists that do not fit. Lists stored inline are still
+  // written to the lists file, which is what scans and cursors read. The keys
+  // to be indexed are collected with their rank, since the list ids are only
+  // known after all lists have been written.
+
+  Bytes key;
+  List list;
+  Arena list_arena;
+  const auto add_list = [&](uint64_t offset, size_t num_values,
+                            uint64_t values_size) {
+    // Registers the list of `key` that begins at `offset` in the lists file,
+    // and returns true if it is to be indexed. The caller writes its inline
+    // copy, if any, and its positions.
+    offsets.push_back(offset);
+    hashes.push_back(Mph::hash(key));
+    if (layout.sorted_keys && offset >= next_indexed_offset) {
+      indexed_keys.push_back(key);
+      indexed_ranks.push_back(offsets.size() - 1);
+      next_indexed_offset = offset + options_.key_index_block_size;
+    }
+    if (layout.inline_list_bytes != 0) {
+      inline_lists.resize(inline_lists.size() + inline_stride);
+    }
+    const uint32_t key_size = key.size();
+    mt::writeAll(keys_ostream.get(), &key_size, sizeof key_size);
+    mt::writeAll(keys_ostream.get(), key.data(), key.size());
+    // Lists whose values take more than 4 GiB are not indexed.
+    if (layout.indexed_lists && num_values >= options_.min_indexed_list_size &&
+        values_size <= std::numeric_limits<uint32_t>::max()) {
+      indexed_lists.push_back(offset + getVarint32Size(key.size()) +
+                              key.size());
+      return true;
+    }
+    return false;
+  };
+  const auto write_list = [&]() {
+    if (options_.compare) {
+      std::sort(list.begin(), list.end(), options_.compare);
+    }
+    if (options_.filter) {
+      List filtered_list;
+      auto list_iter = makeRangeIterator(list.begin(), list.end());
+      options_.filter(key, &list_iter, [&](const Slice& filtered_value) {
+        if (!filtered_value.empty()) {
+          filtered_list.push_back(filtered_value.makeCopy(&list_arena));
+        }
+      });
+      list.swap(filtered_list);
+    }
+    if (!list.empty()) {
+      const uint64_t offset = lists_writer.write(key, list);
+      if (add_list(offset, list.size(), getValuesSize(list))) {
+        first_positions.push_back(num_positions);
+        num_positions += list.size();
+        writePositions(list, positions_ostream.get());
+      }
+      if (layout.inline_list_bytes != 0) {
+        byte* begin = inline_lists.data() + inline_lists.size() - inline_stride;
+        const size_t size =
+            writeListToBuffer(key, list, layout.compressed_lists, begin + 1,
+                              begin + inline_stride);
+        *begin = size;
+        num_inline_lists += (size != 0);
       }
     }
-    map.values_arena = std::move(filtered_values_arena);
+    list.clear();
+    list_arena.deallocateAll();
+  };
+
+  // A list whose values exceed `max_memory` is streamed to the lists file,
+  // unless it has to be sorted or filtered first, which requires all of its
+  // values in memory. Streamed lists are neither compressed nor inlined. Their
+  // positions are written ahead, and remain unused if the list turns out not
+  // to be indexed.
+  const bool streamable = !options_.compare && !options_.filter;
+  bool streaming = false;
+  uint64_t stream_offset = 0;
+  uint64_t first_stream_position = 0;
+  size_t num_streamed_values = 0;
+  uint64_t streamed_values_size = 0;
+  const auto stream_value = [&](const Slice& value) {
+    if (layout.indexed_lists &&
+        streamed_values_size <= std::numeric_limits<uint32_t>::max()) {
+      const uint32_t position = streamed_values_size;
+      mt::writeAll(positions_ostream.get(), &position, sizeof position);
+      num_positions++;
+    }
+    lists_writer.append(value);
+    num_streamed_values++;
+    streamed_values_size += getVarint32Size(value.size()) + value.size();
+  };
+  const auto begin_stream = [&]() {
+    stream_offset = lists_writer.beginList(key);
+    first_stream_position = num_positions;
+    num_streamed_values = 0;
+    streamed_values_size = 0;
+    for (const Slice& value : list) {
+      stream_value(value);
+    }
+    List().swap(list);
+    list_arena.deallocateAll();
+    streaming = true;
+  };
+  const auto end_list = [&]() {
+    if (!streaming) {
+      write_list();
+      return;
+    }
+    lists_writer.endList();
+    if (add_list(stream_offset, num_streamed_values, streamed_values_size)) {
+      first_positions.push_back(first_stream_position);
+    }
+    streaming = false;
+  };
+
+  // All values of a key arrive in a row, so that only one list at a time
+  // needs to be held in memory.
+  while (run->next()) {
+    if ((streaming || !list.empty()) && run->key() != key) {
+      end_list();
+    }
+    if (streaming) {
+      stream_value(run->value());
+      continue;
+    }
+    if (list.empty()) {
+      key = run->key().makeCopy();
+    }
+    list.push_back(run->value().makeCopy(&list_arena));
+    const size_t list_memory =
+        list_arena.allocated() + list.capacity() * sizeof(Slice);
+    peak_memory = mt::max(peak_memory, list_memory);
+    if (streamable && list_memory > max_memory) {
+      begin_stream();
+    }
+  }
+  if (streaming || !list.empty()) end_list();
+  run.reset();  // Removes the run files.
+  keys_ostream.reset();
+  if (layout.indexed_lists) {
+    // Appends the offsets of the indexed lists and their first positions,
+    // aligned to 8 bytes, followed by the number of indexed lists.
+    const uint32_t padding = 0;
+    if (num_positions % 2 != 0) {
+      mt::writeAll(positions_ostream.get(), &padding, sizeof padding);
+    }
+    const uint64_t num_indexed_lists = indexed_lists.size();
+    mt::writeAll(positions_ostream.get(), indexed_lists.data(),
+                 num_indexed_lists * sizeof(uint64_t));
+    mt::writeAll(positions_ostream.get(), first_positions.data(),
+                 num_indexed_lists * sizeof(uint64_t));
+    mt::writeAll(positions_ostream.get(), &num_indexed_lists,
+                 sizeof num_indexed_lists);
+    positions_ostream.reset();
+    if (options_.verbose) {
+      mt::log() << "Indexed " << num_indexed_lists << " of " << hashes.size()
+                << " lists" << std::endl;
+    }
+  }
+  Stats stats = lists_writer.finish();
+  if (layout.compressed_lists && options_.verbose) {
+    mt::log() << "Compressed " << lists_writer.getNumCompressedLists()
+              << " of " << hashes.size() << " lists" << std::endl;
+  }
+
+  // The hashes are normally distinct, so that the native MPH can be built.
+  // Otherwise the keys are read back from the keys file for CMPH.
+  std::vector<uint64_t> sorted_hashes = hashes;
+  std::sort(sorted_hashes.begin(), sorted_hashes.end());
+  const bool distinct_hashes =
+      std::adjacent_find(sorted_hashes.begin(), sorted_hashes.end()) ==
+      sorted_hashes.end();
+  std::vector<uint64_t>().swap(sorted_hashes);
+
+  // Besides the hashes, there are the MPH's temporary copy of them,
+  // `offsets`, and the table. CMPH needs all keys and a pointer per key.
+  size_t mph_memory =
+      hashes.size() * (sizeof(uint64_t) * 3 + layout.getSlotSize()) +
+      inline_lists.size();
+  if (!distinct_hashes) {
+    mph_memory +=
+        fs::file_size(keys_file_path) + hashes.size() * sizeof(byte*);
+  }
+  peak_memory = mt::max(peak_memory, mph_memory);
+
+  if (!distinct_hashes && options_.verbose) {
+    mt::log() << "Keys with equal hashes, falling back to CMPH" << std::endl;
+  }
+  const Mph mph = distinct_hashes
+                      ? Mph::build(hashes.data(), hashes.size(), pool)
+                      : Mph::build(keys_file_path);
+  const fs::path mph_file_path = getPathOfMphFile(prefix_);
+  if (options_.verbose) {
+    mt::log() << "Writing " << mph_file_path.string() << std::endl;
+  }
+  mph.writeToFile(mph_file_path);
+
+  if (layout.inline_list_bytes != 0 && options_.verbose) {
+    mt::log() << "Storing " << num_inline_lists << " of " << hashes.size()
+              << " lists inline" << std::endl;
+  }
+  // Lists are identified by their offset if it fits into 32 bits, and by
+  // their rank otherwise, which is mapped to the offset via Elias-Fano.
+  const uint64_t max_list_id = std::numeric_limits<uint32_t>::max();
+  layout.compact_offsets = options_.compact_offsets ||
+                           (!offsets.empty() && offsets.back() > max_list_id);
+  const auto get_list_id = [&](size_t i) -> uint32_t {
+    return layout.compact_offsets ? i : offsets[i];
+  };
+  const size_t slot_size = layout.getSlotSize();
+  Bytes table(hashes.size() * slot_size);
+  if (distinct_hashes) {
+    for (size_t i = 0; i != hashes.size(); ++i) {
+      setSlot(table.data() + mph(hashes[i]) * slot_size, get_list_id(i),
+              hashes[i], inline_lists.data() + i * inline_stride, layout);
+    }
+  } else {
+    uint32_t key_size;
+    mt::InputStream keys_istream = mt::newFileInputStream(keys_file_path);
+    for (size_t i = 0; i != hashes.size(); ++i) {
+      mt::readAll(keys_istream.get(), &key_size, sizeof key_size);
+      key.resize(key_size);
+      mt::readAll(keys_istream.get(), key.data(), key_size);
+      setSlot(table.data() + mph(key) * slot_size, get_list_id(i), hashes[i],
+              inline_lists.data() + i * inline_stride, layout);
+    }
+  }
+  MT_ASSERT_TRUE(fs::remove(keys_file_path));
+
+  const fs::path table_file_path = getPathOfTableFile(prefix_);
+  if (options_.verbose) {
+    mt::log() << "Writing " << table_file_path.string() << std::endl;
+  }
+  mt::OutputStream table_ostream = mt::newFileOutputStream(table_file_path);
+  mt::writeAll(table_ostream.get(), table.data(), table.size());
+  layout.writeToFile(getPathOfLayoutFile(prefix_));
+  if (layout.compact_offsets) {
+    const fs::path offsets_file_path = getPathOfOffsetsFile(prefix_);
+    if (options_.verbose) {
+      mt::log() << "Writing " << offsets_file_path.string() << std::endl;
+    }
+    EliasFano(offsets.data(), offsets.size()).writeToFile(offsets_file_path);
+  }
+  if (layout.sorted_keys) {
+    const fs::path key_index_file_path = getPathOfKeyIndexFile(prefix_);
+    if (options_.verbose) {
+      mt::log() << "Writing " << key_index_file_path.string() << std::endl;
+    }
+    KeyIndex key_index;
+    for (size_t i = 0; i != indexed_keys.size(); ++i) {
+      key_index.append(indexed_keys[i], get_list_id(indexed_ranks[i]));
+    }
+    key_index.writeToFile(key_index_file_path);
+  }
+
+  stats.build_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+  stats.build_memory_max = peak_memory;
+  const fs::path stats_file_path = getPathOfStatsFile(prefix_);
+  if (options_.verbose) {
+    mt::log() << "Writing " << stats_file_path.string() << std::endl;
+  }
+  stats.writeToFile(stats_file_path);
+
+  if (options_.verbose) {
+    mt::log() << "Built " << prefix_.string() << " in " << stats.build_time_ms
+              << " ms using about " << (peak_memory >> 20) << " MiB"
+              << std::endl;
   }
+  return stats;
+}
 
-  const Mph mph = buildMphFromKeys(map);
-  return writeMap(prefix_, map, mph, options_);
+size_t MphTable::Layout::getSlotSize() const {
+  return sizeof(uint32_t) + fingerprint_bits / 8 +
+         (inline_list_bytes != 0 ? inline_list_bytes + 1 : 0);
 }
 
-MphTable::MphTable(const fs::path& prefix)
+MphTable::Layout MphTable::Layout::readFromFile(const fs::path& file_path) {
+  Layout layout;
+  if (fs::exists(file_path)) {
+    // Files written before fields were added are shorter.
+    const size_t file_size = fs::file_size(file_path);
+    mt::InputStream istream = mt::newFileInputStream(file_path);
+    mt::readAll(istream.get(), &layout, std::min(file_size, sizeof layout));
+  }
+  return layout;
+}
+
+void MphTable::Layout::writeToFile(const fs::path& file_path) const {
+  mt::OutputStream ostream = mt::newFileOutputStream(file_path);
+  mt::writeAll(ostream.get(), this, sizeof *this);
+}
+
+MphTable::MphTable(const fs::path& prefix) : MphTable(prefix, Options()) {}
+
+MphTable::MphTable(const fs::path& prefix, const Options& options)
     : mph_(Mph::readFromFile(getPathOfMphFile(prefix))),
       table_(mt::mmapFile(getPathOfTableFile(prefix), PROT_READ)),
       lists_(mt::mmapFile(getPathOfListsFile(prefix), PROT_READ)),
-      stats_(Stats::readFromFile(getPathOfStatsFile(prefix))) {}
+      stats_(Stats::readFromFile(getPathOfStatsFile(prefix))),
+      layout_(Layout::readFromFile(getPathOfLayoutFile(prefix))),
+      slot_size_(layout_.getSlotSize()) {
+  if (layout_.compact_offsets) {
+    offsets_ = EliasFano::readFromFile(getPathOfOffsetsFile(prefix));
+  }
+  if (layout_.sorted_keys) {
+    key_index_ = KeyIndex::readFromFile(getPathOfKeyIndexFile(prefix));
+  }
+  if (layout_.indexed_lists) {
+    positions_ = mt::mmapFile(getPathOfPositionsFile(prefix), PROT_READ);
+    const byte* end = positions_.data() + positions_.size();
+    uint64_t num_indexed_lists;
+    std::memcpy(&num_indexed_lists, end - sizeof(uint64_t), sizeof(uint64_t));
+    indexed_lists_.resize(num_indexed_lists);
+    first_positions_.resize(num_indexed_lists);
+    const size_t size = num_indexed_lists * sizeof(uint64_t);
+    const byte* pos = end - sizeof(uint64_t) - size * 2;
+    std::memcpy(indexed_lists_.data(), pos, size);
+    std::memcpy(first_positions_.data(), pos + size, size);
+  }
+  compare_ = options.compare;
+  if (layout_.compressed_lists) {
+    cache_.reset(new ListCache(options.max_list_cache_memory));
+  }
+  if (options.huge_pages) {
+    HugePages::advise(table_.data(), table_.size());
+    HugePages::advise(lists_.data(), lists_.size());
+  }
+}
+
+MphTable::MphTable(MphTable&&) = default;
+
+MphTable& MphTable::operator=(MphTable&&) = default;
+
+MphTable::~MphTable() = default;
 
 std::unique_ptr<Iterator> MphTable::get(const Slice& key) const {
-  const uint32_t hash = mph_(key);
-  MT_ASSERT_LT(hash, getTableSize(table_));  // Do we need this?
-  const uint32_t block_id = getTableEntry(table_, hash);
-  const byte* pos = getListBegin(lists_, block_id, stats_.block_size);
-  const Slice actual_key = Slice::readFromBuffer(pos);
-  if (key == actual_key) {
-    uint32_t num_values;
-    pos = actual_key.end();
-    pos += mt::readVarint32FromBuffer(pos, &num_values);
-    return std::unique_ptr<Iterator>(new ListIter(pos, num_values));
+  if (const byte* pos = findList(key)) {
+    Values values = readValues(pos);
+    return std::unique_ptr<Iterator>(new ListIter(
+        values.begin, values.num_values, std::move(values.owner)));
+  }
+  return Iterator::newEmptyInstance();
+}
+
+std::unique_ptr<Iterator> MphTable::get(const Slice& key,
+                                        size_t first_value) const {
+  if (const byte* pos = findList(key)) {
+    Values values = readValues(pos);
+    if (first_value < values.num_values) {
+      const byte* begin = values.begin;
+      if (values.positions) {
+        begin += values.positions[first_value];
+      } else {
+        for (size_t i = 0; i != first_value; ++i) {
+          begin = Slice::readFromBuffer(begin).end();
+        }
+      }
+      return std::unique_ptr<Iterator>(
+          new ListIter(begin, values.num_values - first_value,
+                       std::move(values.owner)));
+    }
   }
   return Iterator::newEmptyInstance();
 }
 
-void MphTable::forEachKey(Procedure process) const {
-  Table table_copy = makeCopy(table_);
-  std::sort(table_copy.begin(), table_copy.end());
-  for (uint32_t block_id : table_copy) {
-    const byte* pos = getListBegin(lists_, block_id, stats_.block_size);
+bool MphTable::contains(const Slice& key) const {
+  return findList(key) != nullptr;
+}
+
+bool MphTable::contains(const Slice& key, const Slice& value) const {
+  const byte* pos = findList(key);
+  if (!pos) return false;
+  const Values values = readValues(pos);
+  if (values.positions && layout_.sorted_values && compare_) {
+    // Finds the first value that is not less than `value` and checks the
+    // values that are equivalent to it.
+    const auto get_value = [&values](size_t index) {
+      return Slice::readFromBuffer(values.begin + values.positions[index]);
+    };
+    size_t low = 0;
+    size_t high = values.num_values;
+    while (low != high) {
+      const size_t middle = low + (high - low) / 2;
+      if (compare_(get_value(middle), value)) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    for (; low != values.num_values; ++low) {
+      const Slice current = get_value(low);
+      if (current == value) return true;
+      if (compare_(value, current)) break;
+    }
+    return false;
+  }
+  ListIter iter(values.begin, values.num_values);
+  while (iter.hasNext()) {
+    if (iter.next() == value) return true;
+  }
+  return false;
+}
+
+size_t MphTable::count(const Slice& key) const {
+  uint32_t num_values = 0;
+  if (const byte* pos = findList(key)) {
+    bool compressed;
+    readListHeader(pos, layout_.compressed_lists, &num_values, &compressed);
+  }
+  return num_values;
+}
+
+std::vector<std::unique_ptr<Iterator> > MphTable::getChunks(
+    const Slice& key, size_t num_chunks) const {
+  MT_REQUIRE_NOT_ZERO(num_chunks);
+  std::vector<std::unique_ptr<Iterator> > chunks;
+  if (const byte* list = findList(key)) {
+    const Values values = readValues(list);
+    const byte* pos = values.begin;
+    num_chunks = mt::min<size_t>(num_chunks, values.num_values);
+    size_t value_id = 0;
+    for (size_t i = 0; i != num_chunks; ++i) {
+      const size_t end_value_id = (i + 1) * values.num_values / num_chunks;
+      const byte* begin = pos;
+      if (values.positions) {
+        // The last chunk has no successor whose position would be needed.
+        if (end_value_id != values.num_values) {
+          pos = values.begin + values.positions[end_value_id];
+        }
+      } else {
+        for (size_t j = value_id; j != end_value_id; ++j) {
+          pos = Slice::readFromBuffer(pos).end();
+        }
+      }
+      chunks.emplace_back(
+          new ListIter(begin, end_value_id - value_id, values.owner));
+      value_id = end_value_id;
+    }
+  }
+  return chunks;
+}
+
+void MphTable::forEachKey(Procedure process,
+                          const std::atomic<bool>* cancelled) const {
+  for (uint32_t list_id : getSortedListIds(table_, slot_size_)) {
+    if (cancelled && *cancelled) break;
+    const byte* pos = getList(list_id);
     const Slice key = Slice::readFromBuffer(pos);
     process(key);
   }
 }
 
 void MphTable::forEachValue(const Slice& key, Procedure process) const {
-  const auto iter = get(key);
-  while (iter->hasNext()) {
-    process(iter->next());
+  if (const byte* pos = findList(key)) {
+    const Values values = readValues(pos);
+    ListIter iter(values.begin, values.num_values);
+    while (iter.hasNext()) {
+      process(iter.next());
+    }
   }
 }
 
-void MphTable::forEachEntry(BinaryProcedure process) const {
+void MphTable::forEachEntry(BinaryProcedure process,
+                            const std::atomic<bool>* cancelled) const {
+  // Compressed lists are decompressed without the cache, which would only be
+  // thrashed by a scan.
   uint32_t num_values;
-  Table table_copy = makeCopy(table_);
-  std::sort(table_copy.begin(), table_copy.end());
-  for (auto block_id : table_copy) {
-    const byte* pos = getListBegin(lists_, block_id, stats_.block_size);
+  bool compressed;
+  Bytes values;
+  for (uint32_t list_id : getSortedListIds(table_, slot_size_)) {
+    if (cancelled && *cancelled) break;
+    const byte* pos = getList(list_id);
     const Slice key = Slice::readFromBuffer(pos);
     pos = key.end();
-    pos += mt::readVarint32FromBuffer(pos, &num_values);
+    pos += readListHeader(pos, layout_.compressed_lists, &num_values,
+                          &compressed);
+    if (compressed) {
+      decompressValues(pos, &values);
+      pos = values.data();
+    }
     ListIter iter(pos, num_values);
     process(key, &iter);
   }
 }
 
+const byte* MphTable::findList(const Slice& key) const {
+  const uint64_t hash = Mph::hash(key);
+  const uint32_t index = mph_.isNative() ? mph_(hash) : mph_(key);
+  const byte* slot = table_.data() + index * slot_size_;
+  MT_ASSERT_LT(slot, table_.data() + table_.size());
+  if (layout_.fingerprint_bits != 0 &&
+      getFingerprint(slot, layout_.fingerprint_bits) !=
+          getFingerprint(hash, layout_.fingerprint_bits)) {
+    return nullptr;
+  }
+  const byte* pos = getInlineList(slot, layout_);
+  if (!pos) pos = getList(getListId(slot));
+  const Slice actual_key = Slice::readFromBuffer(pos);
+  return (key == actual_key) ? actual_key.end() : nullptr;
+}
+
+MphTable::Values MphTable::readValues(const byte* pos) const {
+  Values values;
+  values.positions = findPositions(pos);
+  bool compressed;
+  pos += readListHeader(pos, layout_.compressed_lists, &values.num_values,
+                        &compressed);
+  if (compressed) {
+    values.owner = cache_->get(pos);
+    if (!values.owner) {
+      auto decompressed = std::make_shared<Bytes>();
+      decompressValues(pos, decompressed.get());
+      values.owner = std::move(decompressed);
+      cache_->put(pos, values.owner);
+    }
+    pos = values.owner->data();
+  }
+  values.begin = pos;
+  return values;
+}
+
+const uint32_t* MphTable::findPositions(const byte* pos) const {
+  // Lists stored inline in the table are never indexed.
+  if (indexed_lists_.empty() || pos < lists_.data() ||
+      pos >= lists_.data() + lists_.size()) {
+    return nullptr;
+  }
+  const uint64_t offset = pos - lists_.data();
+  const auto iter =
+      std::lower_bound(indexed_lists_.begin(), indexed_lists_.end(), offset);
+  if (iter == indexed_lists_.end() || *iter != offset) return nullptr;
+  return reinterpret_cast<const uint32_t*>(positions_.data()) +
+         first_positions_[iter - indexed_lists_.begin()];
+}
+
+std::vector<std::pair<uint64_t, uint64_t> > MphTable::getSplits(
+    size_t num_splits) const {
+  MT_REQUIRE_NOT_ZERO(num_splits);
+  std::vector<std::pair<uint64_t, uint64_t> > splits;
+  const Table list_ids = getSortedListIds(table_, slot_size_);
+  if (list_ids.empty()) return splits;
+  const auto get_block = [&](uint32_t list_id) -> uint64_t {
+    return layout_.compact_offsets ? offsets_[list_id] : list_id;
+  };
+  num_splits = std::min(num_splits, list_ids.size());
+  for (size_t i = 0; i != num_splits; ++i) {
+    const size_t begin = i * list_ids.size() / num_splits;
+    const size_t end = (i + 1) * list_ids.size() / num_splits;
+    splits.emplace_back(get_block(list_ids[begin]),
+                        (i + 1 == num_splits) ? stats_.num_blocks
+                                              : get_block(list_ids[end]));
+  }
+  return splits;
+}
+
+std::unique_ptr<Cursor> MphTable::newCursor(uint64_t begin_block,
+                                            uint64_t end_block) const {
+  MT_REQUIRE_LE(begin_block, end_block);
+  MT_REQUIRE_LE(end_block, stats_.num_blocks);
+  return std::unique_ptr<Cursor>(
+      new ListsCursor(lists_.data(), begin_block, end_block, stats_.block_size,
+                      layout_.compressed_lists));
+}
+
+std::unique_ptr<Cursor> MphTable::newCursor(const Slice& begin_key,
+                                            const Slice& end_key) const {
+  // The scan begins at the indexed list preceding `begin_key`, if any.
+  MT_REQUIRE_TRUE(hasKeyIndex());
+  MT_ASSERT_EQ(stats_.block_size, 1);
+  uint32_t list_id;
+  const uint64_t begin_block =
+      key_index_.findFloor(begin_key, &list_id)
+          ? getList(list_id) - lists_.data()
+          : 0;
+  ListsCursor cursor(lists_.data(), begin_block, stats_.num_blocks,
+                     stats_.block_size, layout_.compressed_lists);
+  return std::unique_ptr<Cursor>(
+      new RangeCursor(std::move(cursor), begin_key, end_key));
+}
+
+const byte* MphTable::getList(uint32_t id) const {
+  // Tables with compact offsets have a block size of one.
+  return layout_.compact_offsets
+             ? lists_.data() + offsets_[id]
+             : getListBegin(lists_, id, stats_.block_size);
+}
+
 Stats MphTable::stats(const fs::path& prefix) {
   return Stats::readFromFile(getPathOfStatsFile(prefix));
 }
@@ -18,14 +18,23 @@
 #ifndef MULTIMAP_INTERNAL_MPHTABLE_H_
 #define MULTIMAP_INTERNAL_MPHTABLE_H_
 
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
 #include <boost/filesystem/path.hpp>
+#include "multimap/internal/EliasFano.h"
+#include "multimap/internal/KeyIndex.h"
+#include "multimap/internal/LockPolicy.h"
 #include "multimap/internal/Mph.h"
 #include "multimap/thirdparty/mt/fileio.h"
 #include "multimap/thirdparty/mt/memory.h"
 #include "multimap/callables.h"
+#include "multimap/Cursor.h"
 #include "multimap/Iterator.h"
 #include "multimap/Options.h"
 #include "multimap/Stats.h"
+#include "multimap/ThreadPool.h"
 
 namespace multimap {
 namespace internal {
@@ -41,6 +50,47 @@ class MphTable {
     Limits() = delete;
   };
 
+  struct Layout {
+    uint32_t fingerprint_bits = 0;
+    uint32_t inline_list_bytes = 0;
+    // Each slot of the table holds a 32-bit list id followed by the
+    // `fingerprint_bits` highest bits of the key's hash, which let most
+    // lookups of absent keys return without touching the lists file.
+    // If `inline_list_bytes` is not zero, a size byte and that many bytes
+    // follow, which contain the key's list if it fits, so that the lookup
+    // does not need to touch the lists file either.
+
+    uint32_t compact_offsets = 0;
+    // If zero, the 32-bit id in a slot is the number of the block where the
+    // list begins. Otherwise, it is the rank of the list in the lists file,
+    // and the exact byte offsets are read from an Elias-Fano encoded file.
+
+    uint32_t compressed_lists = 0;
+    // If not zero, the number of values of a list is shifted left by one,
+    // and the lowest bit tells whether the values are zlib compressed.
+
+    uint32_t sorted_keys = 0;
+    // If not zero, there is a sparse index of the keys, which the lists file
+    // stores in ascending order. It maps the first key of every block of about
+    // `Options::key_index_block_size` bytes to the id of its list.
+
+    uint32_t indexed_lists = 0;
+    uint32_t sorted_values = 0;
+    // If `indexed_lists` is not zero, the position of each value of a list
+    // with at least `Options::min_indexed_list_size` values is stored in a
+    // separate file. If `sorted_values` is not zero as well, the values of
+    // each list were sorted with `Options::compare` during the build, and no
+    // `Options::filter` was applied afterwards.
+
+    size_t getSlotSize() const;
+
+    static Layout readFromFile(const boost::filesystem::path& file_path);
+    // Returns the default layout if the file does not exist, which is the
+    // case for tables written by older versions.
+
+    void writeToFile(const boost::filesystem::path& file_path) const;
+  };
+
   class Builder {
    public:
     Builder(Builder&&) = default;
@@ -51,24 +101,96 @@ class MphTable {
     ~Builder();
 
     void put(const Slice& key, const Slice& value);
+    // May be called concurrently, unless MULTIMAP_SINGLE_THREADED is defined.
+    // Values put by the same thread keep their order, values of different
+    // threads are interleaved arbitrarily.
 
     Stats build();
 
+    Stats build(size_t max_memory, ThreadPool* pool);
+    // Sorts the records using at most about `max_memory` bytes instead of
+    // `Options::max_build_memory`, and builds the MPH on `pool` if not null.
+    // The returned stats include the build time and the estimated peak memory
+    // usage, which are also logged if `Options::verbose` is set.
+
    private:
-    mt::OutputStream ostream_;
+#ifdef MULTIMAP_SINGLE_THREADED
+    static const size_t NUM_STRIPES = 1;
+#else
+    static const size_t NUM_STRIPES = 8;
+#endif
+
+    struct Stripe {
+      // Records are written to one file per stripe, which is opened on demand.
+      Mutex mutex;
+      mt::OutputStream ostream;
+    };
+
+    std::unique_ptr<Stripe[]> stripes_;
     boost::filesystem::path prefix_;
     Options options_;
   };
 
+  MphTable(MphTable&&);
+  MphTable& operator=(MphTable&&);
+
   explicit MphTable(const boost::filesystem::path& prefix);
 
+  MphTable(const boost::filesystem::path& prefix, const Options& options);
+  // Only `Options::huge_pages`, `Options::max_list_cache_memory`, and
+  // `Options::compare` are taken into account. The second limits the size of
+  // a cache of decompressed lists, which is shared by all threads. The latter
+  // must be the comparator the table was built with, if any.
+
+  ~MphTable();
+
   std::unique_ptr<Iterator> get(const Slice& key) const;
 
-  void forEachKey(Procedure process) const;
+  std::unique_ptr<Iterator> get(const Slice& key, size_t first_value) const;
+  // Returns an iterator over the values of the key's list that starts at the
+  // value with index `first_value`. Takes constant time for indexed lists,
+  // and skips the preceding values one by one otherwise.
+
+  bool contains(const Slice& key) const;
+
+  bool contains(const Slice& key, const Slice& value) const;
+  // Binary searches indexed lists if their values were sorted during the build
+  // and the table was opened with the same `Options::compare`. Otherwise, the
+  // list is scanned. In both cases the value must be equal byte by byte.
+
+  size_t count(const Slice& key) const;
+
+  void forEachKey(Procedure process,
+                  const std::atomic<bool>* cancelled = nullptr) const;
+
+  std::vector<std::unique_ptr<Iterator> > getChunks(const Slice& key,
+                                                    size_t num_chunks) const;
+  // Divides the key's list into at most `num_chunks` chunks with roughly the
+  // same number of values. Finding the chunk boundaries requires a pass over
+  // the size fields of the values, which skips their data.
 
   void forEachValue(const Slice& key, Procedure process) const;
 
-  void forEachEntry(BinaryProcedure process) const;
+  void forEachEntry(BinaryProcedure process,
+                    const std::atomic<bool>* cancelled = nullptr) const;
+
+  std::vector<std::pair<uint64_t, uint64_t> > getSplits(
+      size_t num_splits) const;
+  // Divides the lists file into at most `num_splits` ranges of block ids that
+  // contain roughly the same number of lists. Each range begins at a list.
+
+  std::unique_ptr<Cursor> newCursor(uint64_t begin_block,
+                                    uint64_t end_block) const;
+  // Returns a cursor over the lists stored in the given range of block ids,
+  // which must be one of the ranges returned by getSplits().
+
+  bool hasKeyIndex() const { return layout_.sorted_keys != 0; }
+
+  std::unique_ptr<Cursor> newCursor(const Slice& begin_key,
+                                    const Slice& end_key) const;
+  // Returns a cursor over the lists whose keys are in [begin_key, end_key), in
+  // ascending key order. An empty `end_key` means that there is no upper bound.
+  // Requires a table built with `Options::sorted_keys`.
 
   Stats getStats() const { return stats_; }
 
@@ -78,10 +200,49 @@ class MphTable {
                            BinaryProcedure process);
 
  private:
+  class ListCache;
+
+  struct Values {
+    const byte* begin = nullptr;
+    uint32_t num_values = 0;
+    std::shared_ptr<const Bytes> owner;
+    // Owns the values if they had to be decompressed.
+    const uint32_t* positions = nullptr;
+    // The position of each value relative to `begin`, if the list is indexed.
+  };
+
+  const byte* findList(const Slice& key) const;
+  // Returns a pointer to the number of values of the key's list, which follows
+  // the key, or null if there is no such key.
+
+  Values readValues(const byte* pos) const;
+  // Reads the values of a list as returned by findList(). Compressed values
+  // are taken from the cache or decompressed and put into it.
+
+  const uint32_t* findPositions(const byte* pos) const;
+  // Returns the value positions of a list as returned by findList(), or null
+  // if the list is not indexed.
+
+  const byte* getList(uint32_t id) const;
+  // Returns the beginning of the list with the id stored in its slot.
+
   Mph mph_;
   mt::AutoUnmapMemory table_;
   mt::AutoUnmapMemory lists_;
   Stats stats_;
+  Layout layout_;
+  size_t slot_size_;
+  EliasFano offsets_;
+  KeyIndex key_index_;
+  mt::AutoUnmapMemory positions_;
+  std::vector<uint64_t> indexed_lists_;
+  std::vector<uint64_t> first_positions_;
+  // The positions file holds the value positions of all indexed lists as
+  // 32-bit integers. `indexed_lists_` contains the offsets of the lists as
+  // returned by findList(), and `first_positions_` the index of their first
+  // position in the file. Both are read from the end of the file.
+  Compare compare_;
+  std::unique_ptr<ListCache> cache_;
 };
 
 }  // namespace internal
@@ -16,12 +16,16 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <algorithm>
+#include <chrono>  // NOLINT
+#include <random>
 #include <set>
 #include <string>
 #include <type_traits>
+#include <vector>
 #include <boost/filesystem/operations.hpp>  // NOLINT
 #include "multimap/internal/MphTable.h"
 #include "multimap/thirdparty/mt/assert.h"
+#include "multimap/thirdparty/mt/common.h"
 #include "gmock/gmock.h"
 
 namespace multimap {
@@ -61,6 +65,21 @@ TEST(MphTableBuilderTest, IsMoveConstructibleAndAssignable) {
   ASSERT_TRUE(std::is_move_assignable<MphTable::Builder>::value);
 }
 
+TEST(MphTableBuilderTest, ConstructorWithInvalidFingerprintWidthThrows) {
+  Options options;
+  for (size_t fingerprint_bits : {4, 12, 64}) {
+    options.fingerprint_bits = fingerprint_bits;
+    ASSERT_THROW(MphTable::Builder("/tmp/prefix", options),
+                 std::runtime_error);
+  }
+}
+
+TEST(MphTableBuilderTest, ConstructorWithTooManyInlineListBytesThrows) {
+  Options options;
+  options.inline_list_bytes = 256;
+  ASSERT_THROW(MphTable::Builder("/tmp/prefix", options), std::runtime_error);
+}
+
 class MphTableBuilderFixture : public testing::Test {
  public:
   void SetUp() override {
@@ -401,6 +420,490 @@ TEST_P(MphTableTestWithParam, BuildWithListSortingAndIterateTwice) {
   }
 }
 
+TEST_P(MphTableTestWithParam, ContainsAndCountReturnCorrectValues) {
+  Options options;
+  options.verbose = false;
+  buildMphTable(getPrefix(), options, GetParam(), GetParam());
+
+  MphTable table(getPrefix());
+  for (int k = 0; k < GetParam(); k++) {
+    ASSERT_TRUE(table.contains(std::to_string(k)));
+    ASSERT_EQ(GetParam(), table.count(std::to_string(k)));
+  }
+  ASSERT_FALSE(table.contains(std::to_string(GetParam())));
+  ASSERT_EQ(0, table.count(std::to_string(GetParam())));
+}
+
+TEST_P(MphTableTestWithParam, CursorsOverSplitsVisitEachEntryOnce) {
+  Options options;
+  options.verbose = false;
+  buildMphTable(getPrefix(), options, GetParam(), GetParam());
+
+  MphTable table(getPrefix());
+  for (size_t num_splits : {1, 3, 7, 10000}) {
+    const auto splits = table.getSplits(num_splits);
+    ASSERT_EQ(std::min<size_t>(num_splits, GetParam()), splits.size());
+    std::set<int> keys;
+    for (const auto& split : splits) {
+      auto cursor = table.newCursor(split.first, split.second);
+      while (cursor->next()) {
+        ASSERT_TRUE(keys.insert(std::stoi(cursor->key().toString())).second);
+        auto iter = cursor->values();
+        for (int v = 0; v < GetParam(); v++) {
+          ASSERT_TRUE(iter->hasNext());
+          ASSERT_EQ(std::to_string(v), iter->next());
+        }
+        ASSERT_FALSE(iter->hasNext());
+      }
+    }
+    ASSERT_EQ(GetParam(), keys.size());
+  }
+}
+
+TEST_P(MphTableTestWithParam, TableWithCompactOffsetsReturnsSameLists) {
+  Options options;
+  options.verbose = false;
+  options.compact_offsets = true;
+  buildMphTable(getPrefix(), options, GetParam(), GetParam());
+  ASSERT_TRUE(boost::filesystem::exists(getPrefix() + ".offsets"));
+
+  MphTable table(getPrefix());
+  for (int k = 0; k < GetParam(); k++) {
+    auto iter = table.get(std::to_string(k));
+    ASSERT_EQ(GetParam(), iter->available());
+    for (int v = 0; v < GetParam(); v++) {
+      ASSERT_EQ(std::to_string(v), iter->next());
+    }
+  }
+  ASSERT_FALSE(table.contains("absent"));
+  std::set<std::string> keys;
+  for (const auto& split : table.getSplits(7)) {
+    auto cursor = table.newCursor(split.first, split.second);
+    while (cursor->next()) {
+      ASSERT_TRUE(keys.insert(cursor->key().toString()).second);
+      ASSERT_EQ(GetParam(), cursor->values()->available());
+    }
+  }
+  ASSERT_EQ(GetParam(), keys.size());
+}
+
+TEST_P(MphTableTestWithParam, TableWithCompressedListsReturnsSameLists) {
+  // Key k has k % 3 * 10 values, so that some lists stay below the threshold.
+  Options options;
+  options.verbose = false;
+  options.compress_lists = true;
+  options.min_compressed_list_size = 64;
+  for (size_t max_list_cache_memory : {0, 256, 1 << 20}) {
+    options.max_list_cache_memory = max_list_cache_memory;
+    {
+      MphTable::Builder builder(getPrefix(), options);
+      for (int k = 0; k < GetParam(); k++) {
+        for (int v = 0; v < k % 3 * 10; v++) {
+          builder.put(std::to_string(k), "value" + std::to_string(v));
+        }
+      }
+      builder.build();
+    }
+    MphTable table(getPrefix(), options);
+    for (int repeat = 0; repeat < 2; repeat++) {
+      for (int k = 0; k < GetParam(); k++) {
+        const std::string key = std::to_string(k);
+        auto iter = table.get(key);
+        ASSERT_EQ(k % 3 * 10, table.count(key));
+        ASSERT_EQ(k % 3 * 10, iter->available());
+        for (int v = 0; v < k % 3 * 10; v++) {
+          ASSERT_EQ("value" + std::to_string(v), iter->next());
+        }
+        int v = 0;
+        for (auto& chunk : table.getChunks(key, 3)) {
+          while (chunk->hasNext()) {
+            ASSERT_EQ("value" + std::to_string(v++), chunk->next());
+          }
+        }
+        ASSERT_EQ(k % 3 * 10, v);
+      }
+    }
+    size_t num_values = 0;
+    table.forEachEntry([&num_values](const Slice&, Iterator* iter) {
+      while (iter->hasNext()) {
+        ASSERT_EQ(0, iter->next().toString().find("value"));
+        num_values++;
+      }
+    });
+    ASSERT_EQ(table.getStats().num_values_total, num_values);
+    num_values = 0;
+    for (const auto& split : table.getSplits(5)) {
+      auto cursor = table.newCursor(split.first, split.second);
+      while (cursor->next()) {
+        const int k = std::stoi(cursor->key().toString());
+        ASSERT_EQ(k % 3 * 10, cursor->values()->available());
+        num_values += cursor->values()->available();
+      }
+    }
+    ASSERT_EQ(table.getStats().num_values_total, num_values);
+  }
+}
+
+TEST_P(MphTableTestWithParam, TableWithSortedKeysReturnsRangesInOrder) {
+  Options options;
+  options.verbose = false;
+  options.sorted_keys = true;
+  options.key_index_block_size = 64;
+  std::set<std::string> keys;
+  for (int k = 0; k < GetParam(); k++) {
+    keys.insert(std::to_string(k));
+  }
+  for (bool compact_offsets : {false, true}) {
+    options.compact_offsets = compact_offsets;
+    buildMphTable(getPrefix(), options, GetParam(), 3);
+    ASSERT_TRUE(boost::filesystem::exists(getPrefix() + ".index"));
+
+    MphTable table(getPrefix());
+    ASSERT_TRUE(table.hasKeyIndex());
+    const std::vector<std::pair<std::string, std::string> > ranges = {
+        {"", ""}, {"1", "2"}, {"5", ""}, {"42", "420"}, {"9", "1"}, {"a", ""}};
+    for (const auto& range : ranges) {
+      std::vector<std::string> expected;
+      for (const auto& key : keys) {
+        if (key < range.first) continue;
+        if (range.second.empty() || key < range.second) {
+          expected.push_back(key);
+        }
+      }
+      std::vector<std::string> actual;
+      auto cursor = table.newCursor(range.first, range.second);
+      while (cursor->next()) {
+        actual.push_back(cursor->key().toString());
+        ASSERT_EQ(3, cursor->values()->available());
+      }
+      ASSERT_EQ(expected, actual);
+    }
+  }
+}
+
+TEST_P(MphTableTestWithParam, CursorDecodesValuesOnlyWhenRequested) {
+  // The values of every other list are skipped without being decoded.
+  Options options;
+  options.verbose = false;
+  options.sorted_keys = true;
+  options.min_compressed_list_size = 1;
+  for (bool compress_lists : {false, true}) {
+    options.compress_lists = compress_lists;
+    buildMphTable(getPrefix(), options, GetParam(), 100);
+
+    MphTable table(getPrefix(), options);
+    auto cursor = table.newCursor(Slice(), Slice());
+    size_t num_keys = 0;
+    while (cursor->next()) {
+      if (num_keys++ % 2 == 0) continue;
+      Iterator* values = cursor->values();
+      ASSERT_EQ(values, cursor->values());
+      ASSERT_EQ(100, values->available());
+      for (int v = 0; v < 100; v++) {
+        ASSERT_EQ(std::to_string(v), values->next());
+      }
+    }
+    ASSERT_EQ(GetParam(), num_keys);
+  }
+}
+
+TEST_P(MphTableTestWithParam, TableWithIndexedListsSeeksAndFindsValues) {
+  // Key k has k % 3 * 10 values, so that some lists stay below the threshold.
+  // The values are put in descending order and sorted during the build.
+  Options options;
+  options.verbose = false;
+  options.index_lists = true;
+  options.min_indexed_list_size = 15;
+  options.min_compressed_list_size = 64;
+  const auto get_value = [](int v) { return "value" + std::to_string(v); };
+  for (bool compress_lists : {false, true}) {
+    for (bool compare : {false, true}) {
+      options.compress_lists = compress_lists;
+      options.compare = nullptr;
+      if (compare) {
+        options.compare = [](const Slice& a, const Slice& b) { return a < b; };
+      }
+      {
+        MphTable::Builder builder(getPrefix(), options);
+        for (int k = 0; k < GetParam(); k++) {
+          for (int v = k % 3 * 10 - 1; v >= 0; v--) {
+            builder.put(std::to_string(k), get_value(v));
+          }
+        }
+        builder.build();
+      }
+      ASSERT_TRUE(boost::filesystem::exists(getPrefix() + ".positions"));
+
+      MphTable table(getPrefix(), options);
+      for (int k = 0; k < GetParam(); k++) {
+        const std::string key = std::to_string(k);
+        std::vector<std::string> values;
+        auto iter = table.get(key);
+        while (iter->hasNext()) {
+          values.push_back(iter->next().toString());
+        }
+        ASSERT_EQ(k % 3 * 10, values.size());
+        for (size_t first = 0; first <= values.size(); first++) {
+          iter = table.get(key, first);
+          ASSERT_EQ(values.size() - first, iter->available());
+          for (size_t i = first; i != values.size(); i++) {
+            ASSERT_EQ(values[i], iter->next());
+          }
+        }
+        ASSERT_EQ(0, table.get(key, values.size() + 1)->available());
+        for (const auto& value : values) {
+          ASSERT_TRUE(table.contains(key, value));
+        }
+        ASSERT_FALSE(table.contains(key, "value"));
+        ASSERT_FALSE(table.contains(key, get_value(30)));
+        ASSERT_FALSE(table.contains(key, "zzz"));
+        size_t i = 0;
+        for (auto& chunk : table.getChunks(key, 4)) {
+          while (chunk->hasNext()) {
+            ASSERT_EQ(values[i++], chunk->next());
+          }
+        }
+        ASSERT_EQ(values.size(), i);
+      }
+      ASSERT_FALSE(table.contains("absent", get_value(0)));
+      ASSERT_EQ(0, table.get("absent", 0)->available());
+    }
+  }
+}
+
+TEST_P(MphTableTestWithParam, IndexedListsWithFilterFindAllValues) {
+  // The filter reverses the sorted values, which must not be binary searched.
+  Options options;
+  options.verbose = false;
+  options.index_lists = true;
+  options.min_indexed_list_size = 1;
+  options.compare = [](const Slice& a, const Slice& b) { return a < b; };
+  options.filter = [](const Slice&, Iterator* iter, Procedure emit) {
+    std::vector<std::string> values;
+    while (iter->hasNext()) {
+      values.push_back(iter->next().toString());
+    }
+    for (auto it = values.rbegin(); it != values.rend(); ++it) {
+      emit(*it);
+    }
+  };
+  buildMphTable(getPrefix(), options, GetParam(), 9);
+
+  MphTable table(getPrefix(), options);
+  for (int k = 0; k < GetParam(); k++) {
+    auto iter = table.get(std::to_string(k));
+    ASSERT_EQ("8", iter->peekNext().toString());
+    for (int v = 0; v < 9; v++) {
+      ASSERT_TRUE(table.contains(std::to_string(k), std::to_string(v)));
+    }
+    ASSERT_FALSE(table.contains(std::to_string(k), "9"));
+  }
+}
+
+TEST_P(MphTableTestWithParam, ChunksOfListVisitEachValueInOrder) {
+  Options options;
+  options.verbose = false;
+  buildMphTable(getPrefix(), options, GetParam(), GetParam());
+
+  MphTable table(getPrefix());
+  for (size_t num_chunks : {1, 3, 7, 10000}) {
+    for (int k = 0; k < GetParam(); k++) {
+      const auto chunks = table.getChunks(std::to_string(k), num_chunks);
+      ASSERT_EQ(std::min<size_t>(num_chunks, GetParam()), chunks.size());
+      int v = 0;
+      for (const auto& chunk : chunks) {
+        while (chunk->hasNext()) {
+          ASSERT_EQ(std::to_string(v), chunk->next());
+          v++;
+        }
+      }
+      ASSERT_EQ(GetParam(), v);
+    }
+  }
+  ASSERT_TRUE(table.getChunks("absent", 3).empty());
+}
+
+TEST_P(MphTableTestWithParam, BuildWithLittleMemoryKeepsOrderOfValues) {
+  Options options;
+  options.verbose = false;
+  options.max_build_memory = GetParam() * GetParam();
+  {
+    MphTable::Builder builder(getPrefix(), options);
+    for (int v = 0; v < GetParam(); v++) {
+      for (int k = 0; k < GetParam(); k++) {
+        builder.put(std::to_string(k), std::to_string(v));
+      }
+    }
+    builder.build();
+  }
+  // Only the files of the table itself are left behind.
+  const auto directory = boost::filesystem::path(getPrefix()).parent_path();
+  ASSERT_EQ(5, std::distance(boost::filesystem::directory_iterator(directory),
+                             boost::filesystem::directory_iterator()));
+
+  MphTable table(getPrefix());
+  for (int k = 0; k < GetParam(); k++) {
+    auto iter = table.get(std::to_string(k));
+    ASSERT_EQ(GetParam(), iter->available());
+    for (int v = 0; v < GetParam(); v++) {
+      ASSERT_EQ(std::to_string(v), iter->next());
+    }
+  }
+}
+
+TEST_P(MphTableTestWithParam, BuildWithLittleMemoryAppliesCompareAndFilter) {
+  Options options;
+  options.verbose = false;
+  options.max_build_memory = GetParam() * GetParam();
+  options.compare = [](const Slice& a, const Slice& b) {
+    return std::stoi(a.toString()) > std::stoi(b.toString());
+  };
+  options.filter = [](const Slice&, Iterator* values, Procedure output) {
+    while (values->hasNext()) {
+      const Slice value = values->next();
+      if (std::stoi(value.toString()) % 2 == 0) output(value);
+    }
+  };
+  buildMphTable(getPrefix(), options, GetParam(), GetParam());
+
+  MphTable table(getPrefix());
+  for (int k = 0; k < GetParam(); k++) {
+    auto iter = table.get(std::to_string(k));
+    ASSERT_EQ(GetParam() / 2, iter->available());
+    for (int v = GetParam() - 2; v >= 0; v -= 2) {
+      ASSERT_EQ(std::to_string(v), iter->next());
+    }
+  }
+}
+
+TEST_P(MphTableTestWithParam, BuildWithLittleMemoryStreamsLargeLists) {
+  // The list of key 0 exceeds the budget, the others have one value each.
+  const int num_values = 100000;
+  Options options;
+  options.verbose = false;
+  options.max_build_memory = 1 << 16;
+  options.index_lists = true;
+  options.min_indexed_list_size = 2;
+  for (bool compress_lists : {false, true}) {
+    options.compress_lists = compress_lists;
+    Stats stats;
+    {
+      MphTable::Builder builder(getPrefix(), options);
+      for (int k = 1; k < GetParam(); k++) {
+        builder.put(std::to_string(k), "value");
+      }
+      for (int v = 0; v < num_values; v++) {
+        builder.put("0", std::to_string(v));
+      }
+      stats = builder.build();
+    }
+    ASSERT_EQ(GetParam(), stats.num_keys_valid);
+    ASSERT_EQ(num_values, stats.list_size_max);
+    ASSERT_EQ(num_values + GetParam() - 1, stats.num_values_valid);
+
+    MphTable table(getPrefix(), options);
+    auto iter = table.get("0");
+    ASSERT_EQ(num_values, iter->available());
+    for (int v = 0; v < num_values; v++) {
+      ASSERT_EQ(std::to_string(v), iter->next());
+    }
+    for (int first : {1, num_values / 2, num_values - 1}) {
+      ASSERT_EQ(std::to_string(first), table.get("0", first)->next());
+    }
+    ASSERT_TRUE(table.contains("0", std::to_string(num_values - 1)));
+    ASSERT_FALSE(table.contains("0", std::to_string(num_values)));
+    for (int k = 1; k < GetParam(); k++) {
+      ASSERT_EQ(1, table.count(std::to_string(k)));
+    }
+  }
+}
+
+TEST_P(MphTableTestWithParam, TableBackedByHugePagesReturnsSameLists) {
+  Options options;
+  options.verbose = false;
+  options.huge_pages = true;
+  buildMphTable(getPrefix(), options, GetParam(), GetParam());
+
+  MphTable table(getPrefix(), options);
+  for (int k = 0; k < GetParam(); k++) {
+    auto iter = table.get(std::to_string(k));
+    ASSERT_EQ(GetParam(), iter->available());
+    for (int v = 0; v < GetParam(); v++) {
+      ASSERT_EQ(std::to_string(v), iter->next());
+    }
+  }
+  ASSERT_FALSE(table.get("absent")->hasNext());
+}
+
+TEST_P(MphTableTestWithParam, TableWithFingerprintsReturnsSameLists) {
+  Options options;
+  options.verbose = false;
+  for (size_t fingerprint_bits : {8, 16, 32}) {
+    options.fingerprint_bits = fingerprint_bits;
+    buildMphTable(getPrefix(), options, GetParam(), GetParam());
+
+    MphTable table(getPrefix());
+    for (int k = 0; k < GetParam(); k++) {
+      auto iter = table.get(std::to_string(k));
+      ASSERT_EQ(GetParam(), iter->available());
+      for (int v = 0; v < GetParam(); v++) {
+        ASSERT_EQ(std::to_string(v), iter->next());
+      }
+    }
+    for (int k = GetParam(); k < GetParam() * 2; k++) {
+      ASSERT_FALSE(table.contains(std::to_string(k)));
+    }
+    size_t num_keys = 0;
+    table.forEachKey([&num_keys](const Slice&) { num_keys++; });
+    ASSERT_EQ(GetParam(), num_keys);
+  }
+}
+
+TEST_P(MphTableTestWithParam, TableWithInlineListsReturnsSameLists) {
+  Options options;
+  options.verbose = false;
+  options.fingerprint_bits = 8;
+  for (size_t inline_list_bytes : {1, 16, 255}) {
+    // Key k has k % 5 + 1 values, so that some lists fit and some do not.
+    options.inline_list_bytes = inline_list_bytes;
+    MphTable::Builder builder(getPrefix(), options);
+    for (int k = 0; k < GetParam(); k++) {
+      for (int v = 0; v <= k % 5; v++) {
+        builder.put(std::to_string(k), std::to_string(v));
+      }
+    }
+    builder.build();
+
+    MphTable table(getPrefix());
+    for (int k = 0; k < GetParam(); k++) {
+      auto iter = table.get(std::to_string(k));
+      ASSERT_EQ(k % 5 + 1, iter->available());
+      for (int v = 0; v <= k % 5; v++) {
+        ASSERT_EQ(std::to_string(v), iter->next());
+      }
+    }
+    ASSERT_FALSE(table.contains("absent"));
+    size_t num_values = 0;
+    table.forEachEntry([&num_values](const Slice&, Iterator* iter) {
+      num_values += iter->available();
+    });
+    ASSERT_EQ(table.getStats().num_values_total, num_values);
+  }
+}
+
+TEST_P(MphTableTestWithParam, TableWithoutLayoutFileIsReadAsBefore) {
+  Options options;
+  options.verbose = false;
+  buildMphTable(getPrefix(), options, GetParam(), GetParam());
+  ASSERT_TRUE(boost::filesystem::remove(getPrefix() + ".layout"));
+
+  MphTable table(getPrefix());
+  for (int k = 0; k < GetParam(); k++) {
+    ASSERT_EQ(GetParam(), table.count(std::to_string(k)));
+  }
+  ASSERT_FALSE(table.contains("absent"));
+}
+
 INSTANTIATE_TEST_CASE_P(Parameterized, MphTableTestWithParam,
                         testing::Values(10, 100, 1000));
 // CMPH does not work for very small keysets, i.e. less than 10.
@@ -467,6 +970,202 @@ TEST_F(MphTableBuilderFixture, PutTenMillionValuesPerKeyThenBuildAndIterate) {
   }
 }
 
+TEST_F(MphTableBuilderFixture, BuildWithAndWithoutMemoryLimit) {
+  Options options;
+  options.verbose = false;
+  const int num_keys = mt::MiB(1);
+  const int num_values = 10;
+  for (size_t max_build_memory : {mt::GiB(1), mt::MiB(16)}) {
+    options.max_build_memory = max_build_memory;
+    MphTable::Builder builder(getPrefix(), options);
+    for (int v = 0; v < num_values; v++) {
+      for (int k = 0; k < num_keys; k++) {
+        builder.put(std::to_string(k), std::to_string(v));
+      }
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const Stats stats = builder.build();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(num_keys * num_values, stats.num_values_total);
+    mt::log() << "max_build_memory = " << max_build_memory << ": "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     elapsed).count()
+              << " ms\n";
+  }
+}
+
+TEST_F(MphTableBuilderFixture, RandomLookupsWithAndWithoutHugePages) {
+  Options options;
+  options.verbose = false;
+  const int num_keys = mt::MiB(4);
+  buildMphTable(getPrefix(), options, num_keys, 1);
+
+  std::vector<std::string> keys;
+  std::mt19937 random;
+  for (int i = 0; i < num_keys; i++) {
+    keys.push_back(std::to_string(random() % num_keys));
+  }
+  for (bool huge_pages : {false, true}) {
+    options.huge_pages = huge_pages;
+    MphTable table(getPrefix(), options);
+    size_t num_values = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& key : keys) {
+      num_values += table.get(key)->available();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(num_keys, num_values);
+    mt::log() << "huge_pages = " << huge_pages << ": "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     elapsed).count() / num_keys
+              << " ns per lookup\n";
+  }
+}
+
+TEST_F(MphTableBuilderFixture, MissingKeyLookupsWithAndWithoutFingerprints) {
+  Options options;
+  options.verbose = false;
+  const int num_keys = mt::MiB(4);
+
+  std::vector<std::string> keys;
+  std::mt19937 random;
+  for (int i = 0; i < num_keys; i++) {
+    keys.push_back(std::to_string(num_keys + random() % num_keys));
+  }
+  for (size_t fingerprint_bits : {0, 8, 16, 32}) {
+    options.fingerprint_bits = fingerprint_bits;
+    buildMphTable(getPrefix(), options, num_keys, 1);
+    MphTable table(getPrefix());
+    size_t num_values = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& key : keys) {
+      num_values += table.get(key)->available();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(0, num_values);
+    mt::log() << "fingerprint_bits = " << fingerprint_bits << ": "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     elapsed).count() / num_keys
+              << " ns per missing key, table size "
+              << boost::filesystem::file_size(getPrefix() + ".table")
+              << " bytes\n";
+  }
+}
+
+TEST_F(MphTableBuilderFixture, RandomLookupsWithAndWithoutCompactOffsets) {
+  Options options;
+  options.verbose = false;
+  const int num_keys = mt::MiB(4);
+  std::vector<std::string> keys;
+  std::mt19937 random;
+  for (int i = 0; i < num_keys; i++) {
+    keys.push_back(std::to_string(random() % num_keys));
+  }
+  for (bool compact_offsets : {false, true}) {
+    options.compact_offsets = compact_offsets;
+    buildMphTable(getPrefix(), options, num_keys, 1);
+    MphTable table(getPrefix());
+    size_t num_values = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& key : keys) {
+      num_values += table.get(key)->available();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(num_keys, num_values);
+    const auto offsets_file = getPrefix() + ".offsets";
+    mt::log() << "compact_offsets = " << compact_offsets << ": "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     elapsed).count() / num_keys
+              << " ns per lookup, offsets file size "
+              << (compact_offsets ? boost::filesystem::file_size(offsets_file)
+                                  : 0)
+              << " bytes\n";
+  }
+}
+
+TEST_F(MphTableBuilderFixture, RandomLookupsWithAndWithoutCompression) {
+  // The values are decimal numbers below 100000 in ascending order, which
+  // compress about 3x. Every 16th key has 1000 values, the others have 10.
+  Options options;
+  options.verbose = false;
+  const int num_keys = mt::MiB(1);
+  std::vector<std::string> keys;
+  std::mt19937 random;
+  for (int i = 0; i < num_keys; i++) {
+    keys.push_back(std::to_string(random() % num_keys));
+  }
+  for (bool compress_lists : {false, true}) {
+    options.compress_lists = compress_lists;
+    MphTable::Builder builder(getPrefix(), options);
+    for (int k = 0; k < num_keys; k++) {
+      const int num_values = (k % 16 == 0) ? 1000 : 10;
+      for (int v = 0; v < num_values; v++) {
+        builder.put(std::to_string(k), std::to_string(v * 100));
+      }
+    }
+    builder.build();
+
+    MphTable table(getPrefix(), options);
+    size_t num_values = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& key : keys) {
+      auto iter = table.get(key);
+      while (iter->hasNext()) {
+        num_values += iter->next().size() != 0;
+      }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_LT(num_keys, num_values);
+    mt::log() << "compress_lists = " << compress_lists << ": "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     elapsed).count() / num_keys
+              << " ns per lookup and scan, lists file size "
+              << boost::filesystem::file_size(getPrefix() + ".lists")
+              << " bytes\n";
+  }
+}
+
+TEST_F(MphTableBuilderFixture, RandomLookupsWithAndWithoutInlineLists) {
+  // Most keys have a single value, but a few have many, and these make up
+  // about half of all values.
+  Options options;
+  options.verbose = false;
+  const int num_keys = mt::MiB(4);
+  std::vector<std::string> keys;
+  std::mt19937 random;
+  for (int i = 0; i < num_keys; i++) {
+    keys.push_back(std::to_string(random() % num_keys));
+  }
+  for (size_t inline_list_bytes : {0, 24, 56}) {
+    options.inline_list_bytes = inline_list_bytes;
+    MphTable::Builder builder(getPrefix(), options);
+    for (int k = 0; k < num_keys; k++) {
+      const int num_values = (k % 32 == 0) ? 32 : 1;
+      for (int v = 0; v < num_values; v++) {
+        builder.put(std::to_string(k), std::to_string(v * k));
+      }
+    }
+    builder.build();
+
+    MphTable table(getPrefix());
+    size_t num_values = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& key : keys) {
+      auto iter = table.get(key);
+      num_values += iter->available();
+      num_values += iter->next().size();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_LT(num_keys, num_values);
+    mt::log() << "inline_list_bytes = " << inline_list_bytes << ": "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     elapsed).count() / num_keys
+              << " ns per lookup, table size "
+              << boost::filesystem::file_size(getPrefix() + ".table")
+              << " bytes\n";
+  }
+}
+
 #endif
 
 }  // namespace internal
@@ -15,6 +15,9 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <chrono>  // NOLINT
+#include <functional>
+#include <random>
 #include <string>
 #include <type_traits>
 #include <vector>
@@ -22,6 +25,7 @@
 #include "gmock/gmock.h"
 #include "multimap/internal/Mph.h"
 #include "multimap/thirdparty/mt/assert.h"
+#include "multimap/thirdparty/mt/common.h"
 #include "multimap/thirdparty/mt/fileio.h"
 #include "multimap/Arena.h"
 
@@ -166,5 +170,120 @@ TEST_P(MphTestWithParam, WriteMphToFileThenReadBackAndEvaluate) {
   }
 }
 
+// -----------------------------------------------------------------------------
+// Native Function
+// -----------------------------------------------------------------------------
+
+std::vector<uint64_t> makeHashes(int num_keys) {
+  std::vector<uint64_t> hashes(num_keys);
+  for (int i = 0; i < num_keys; i++) {
+    hashes[i] = Mph::hash(makeKey(i));
+  }
+  return hashes;
+}
+
+void assertIsBijective(const Mph& mph, int num_keys) {
+  ASSERT_EQ(num_keys, mph.size());
+  std::vector<bool> seen(num_keys);
+  for (int i = 0; i < num_keys; i++) {
+    const uint32_t value = mph(makeKey(i));
+    ASSERT_LT(value, mph.size());
+    ASSERT_FALSE(seen[value]);
+    seen[value] = true;
+  }
+}
+
+TEST(MphTest, BuildNativeFromVerySmallKeysets) {
+  for (int num_keys = 0; num_keys != 10; num_keys++) {
+    const auto hashes = makeHashes(num_keys);
+    const Mph mph = Mph::build(hashes.data(), hashes.size());
+    ASSERT_TRUE(mph.isNative());
+    assertIsBijective(mph, num_keys);
+  }
+}
+
+TEST(MphTest, BuildNativeFromEqualHashesThrows) {
+  std::vector<uint64_t> hashes = makeHashes(100);
+  hashes[50] = hashes[10];
+  ASSERT_THROW(Mph::build(hashes.data(), hashes.size()), std::runtime_error);
+}
+
+TEST_P(MphTestWithParam, BuildNativeFromHashes) {
+  const auto hashes = makeHashes(GetParam());
+  const Mph mph = Mph::build(hashes.data(), hashes.size());
+  assertIsBijective(mph, GetParam());
+  for (int i = 0; i < GetParam(); i++) {
+    ASSERT_EQ(mph(makeKey(i)), mph(hashes[i]));
+  }
+}
+
+TEST_P(MphTestWithParam, BuildNativeInParallelGivesSameFunction) {
+  const auto hashes = makeHashes(GetParam());
+  const Mph mph = Mph::build(hashes.data(), hashes.size());
+  ThreadPool pool(3);
+  const Mph parallel_mph = Mph::build(hashes.data(), hashes.size(), &pool);
+  for (int i = 0; i < GetParam(); i++) {
+    ASSERT_EQ(mph(hashes[i]), parallel_mph(hashes[i]));
+  }
+}
+
+TEST_P(MphTestWithParam, WriteNativeMphToFileThenReadBackAndEvaluate) {
+  const auto hashes = makeHashes(GetParam());
+  const Mph mph = Mph::build(hashes.data(), hashes.size());
+  mph.writeToFile(getMphFileName());
+
+  const Mph mph_read = Mph::readFromFile(getMphFileName());
+  ASSERT_TRUE(mph_read.isNative());
+  ASSERT_EQ(mph.size(), mph_read.size());
+  for (int i = 0; i < GetParam(); i++) {
+    ASSERT_EQ(mph(hashes[i]), mph_read(hashes[i]));
+  }
+}
+
+#ifdef MULTIMAP_RUN_LARGE_TESTS
+
+TEST(MphTest, BuildTimeAndLatencyOfNativeAndCmph) {
+  const int num_keys = 10000000;
+  Arena arena;
+  std::vector<const byte*> keys(num_keys);
+  for (int i = 0; i < num_keys; i++) {
+    keys[i] = makeCmphEncodedKey(i, &arena);
+  }
+  const auto hashes = makeHashes(num_keys);
+  std::vector<std::string> lookups;
+  std::mt19937 random;
+  for (int i = 0; i < num_keys; i++) {
+    lookups.push_back(makeKey(random() % num_keys));
+  }
+
+  const auto millis_since = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start).count();
+  };
+  const auto measure = [&](const char* name, std::function<Mph()> build) {
+    auto start = std::chrono::steady_clock::now();
+    const Mph mph = build();
+    const auto build_millis = millis_since(start);
+    start = std::chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (const auto& key : lookups) {
+      sum += mph(key);
+    }
+    const auto lookup_nanos = millis_since(start) * 1000000 / num_keys;
+    mt::log() << name << ": build " << build_millis << " ms, lookup "
+              << lookup_nanos << " ns (" << sum % 10 << ")\n";
+  };
+  measure("CMPH", [&]() { return Mph::build(keys.data(), keys.size()); });
+  measure("Native", [&]() {
+    return Mph::build(hashes.data(), hashes.size());
+  });
+  measure("Native, 4 threads", [&]() {
+    ThreadPool pool(3);
+    return Mph::build(hashes.data(), hashes.size(), &pool);
+  });
+}
+
+#endif  // MULTIMAP_RUN_LARGE_TESTS
+
 }  // namespace internal
 }  // namespace multimap
@@ -0,0 +1,129 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "multimap/internal/Numa.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <boost/filesystem/operations.hpp>  // NOLINT
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+namespace multimap {
+namespace internal {
+
+namespace {
+
+const char* NODES_DIRECTORY = "/sys/devices/system/node";
+
+// Constants from <numaif.h>, which is part of libnuma.
+const int MPOL_PREFERRED = 1;
+const int MPOL_F_NODE = 1 << 0;
+const int MPOL_F_ADDR = 1 << 1;
+
+const size_t BITS_PER_ULONG = 8 * sizeof(unsigned long);  // NOLINT
+
+std::vector<size_t> getAllCpus() {
+  std::vector<size_t> cpus(std::max(1u, std::thread::hardware_concurrency()));
+  for (size_t i = 0; i != cpus.size(); ++i) {
+    cpus[i] = i;
+  }
+  return cpus;
+}
+
+std::vector<size_t> parseCpuList(const std::string& cpu_list) {
+  // Format: "0-3,8-11" or "0,2,4".
+  std::vector<size_t> cpus;
+  std::istringstream stream(cpu_list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    const size_t dash = range.find('-');
+    const size_t first = std::stoul(range.substr(0, dash));
+    const size_t last = (dash == std::string::npos)
+                            ? first
+                            : std::stoul(range.substr(dash + 1));
+    for (size_t cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}  // namespace
+
+size_t Numa::getNumNodes() {
+  size_t num_nodes = 0;
+  boost::system::error_code error;
+  while (fs::is_directory(fs::path(NODES_DIRECTORY) /
+                              ("node" + std::to_string(num_nodes)),
+                          error)) {
+    ++num_nodes;
+  }
+  return std::max<size_t>(num_nodes, 1);
+}
+
+std::vector<size_t> Numa::getCpus(size_t node) {
+  const fs::path file = fs::path(NODES_DIRECTORY) /
+                        ("node" + std::to_string(node)) / "cpulist";
+  std::ifstream stream(file.string());
+  std::string cpu_list;
+  if (std::getline(stream, cpu_list)) {
+    const auto cpus = parseCpuList(cpu_list);
+    if (!cpus.empty()) return cpus;
+  }
+  return (node == 0) ? getAllCpus() : std::vector<size_t>();
+}
+
+bool Numa::bind(void* data, size_t size, size_t node) {
+#ifdef __linux__
+  std::vector<unsigned long> mask(node / BITS_PER_ULONG + 1);  // NOLINT
+  mask[node / BITS_PER_ULONG] = 1UL << (node % BITS_PER_ULONG);
+  // The kernel reads maxnode - 1 bits from the mask.
+  const unsigned long max_node = mask.size() * BITS_PER_ULONG + 1;  // NOLINT
+  return syscall(SYS_mbind, data, size, MPOL_PREFERRED, mask.data(), max_node,
+                 0) == 0;
+#else
+  (void)data;
+  (void)size;
+  (void)node;
+  return false;
+#endif
+}
+
+int Numa::getNode(const void* data) {
+#ifdef __linux__
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, nullptr, 0, data,
+              MPOL_F_NODE | MPOL_F_ADDR) == 0) {
+    return node;
+  }
+#else
+  (void)data;
+#endif
+  return -1;
+}
+
+}  // namespace internal
+}  // namespace multimap
@@ -0,0 +1,53 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MULTIMAP_INTERNAL_NUMA_H_
+#define MULTIMAP_INTERNAL_NUMA_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace multimap {
+namespace internal {
+
+struct Numa {
+  // Thin wrappers around the Linux NUMA system calls, so that no dependency
+  // on libnuma is needed. On other platforms the system is reported to have
+  // a single node that contains all CPUs, and binding memory has no effect.
+
+  static size_t getNumNodes();
+  // Returns the number of NUMA nodes, which is at least one.
+
+  static std::vector<size_t> getCpus(size_t node);
+  // Returns the ids of the CPUs that belong to `node`.
+
+  static bool bind(void* data, size_t size, size_t node);
+  // Sets the memory policy of the page-aligned range [data, data + size) so
+  // that its pages are preferably allocated on `node` when first touched.
+  // Returns false if the policy could not be set.
+
+  static int getNode(const void* data);
+  // Returns the node where the page containing `data` is located,
+  // or -1 if unknown. The page must have been touched before.
+
+  Numa() = delete;
+};
+
+}  // namespace internal
+}  // namespace multimap
+
+#endif  // MULTIMAP_INTERNAL_NUMA_H_
@@ -0,0 +1,53 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <sys/mman.h>
+#include "gmock/gmock.h"
+#include "multimap/internal/Numa.h"
+#include "multimap/thirdparty/mt/common.h"
+#include "multimap/thirdparty/mt/memory.h"
+
+namespace multimap {
+namespace internal {
+
+using testing::Eq;
+using testing::Ge;
+using testing::Lt;
+
+TEST(NumaTest, SystemHasAtLeastOneNodeWithCpus) {
+  ASSERT_THAT(Numa::getNumNodes(), Ge(1));
+  ASSERT_FALSE(Numa::getCpus(0).empty());
+  ASSERT_TRUE(Numa::getCpus(Numa::getNumNodes() + 1).empty());
+}
+
+TEST(NumaTest, BoundMemoryIsLocatedOnNode) {
+  auto memory = mt::mmap(mt::KiB(64), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  const size_t node = Numa::getNumNodes() - 1;
+  if (!Numa::bind(memory.data(), memory.size(), node)) {
+    return;  // NUMA system calls are not available.
+  }
+  memory.data()[0] = 1;  // Touch the page.
+  const int actual = Numa::getNode(memory.data());
+  ASSERT_THAT(actual, Lt(static_cast<int>(Numa::getNumNodes())));
+  if (actual != -1) {
+    ASSERT_THAT(actual, Eq(static_cast<int>(node)));
+  }
+}
+
+}  // namespace internal
+}  // namespace multimap
@@ -21,9 +21,12 @@
 #include <cmath>
 #include <limits>
 #include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include <boost/filesystem/operations.hpp>  // NOLINT
 #include "multimap/internal/Base64.h"
+#include "multimap/internal/HugePages.h"
 #include "multimap/internal/Locks.h"
 #include "multimap/thirdparty/mt/check.h"
 
@@ -36,6 +39,15 @@ namespace {
 
 const char* READ_ONLY_VIOLATION = "Attempt to write to read-only partition";
 
+// Memory that is bound to a NUMA node is mapped block by block, hence larger
+// blocks are used to keep the number of mappings low.
+const size_t NUMA_ARENA_BLOCK_SIZE = mt::KiB(64);
+
+size_t getArenaBlockSize(const Options& options, int numa_node) {
+  if (options.huge_pages) return HugePages::getSize();
+  return (numa_node < 0) ? Arena::DEFAULT_BLOCK_SIZE : NUMA_ARENA_BLOCK_SIZE;
+}
+
 struct SliceEqual {
   explicit SliceEqual(const Slice& value) : value_(value) {}
 
@@ -45,6 +57,46 @@ struct SliceEqual {
   const Slice value_;
 };
 
+template <typename List>
+class PartitionCursor : public Cursor {
+ public:
+  typedef typename List::Store Store;
+
+  explicit PartitionCursor(const Store* store) : store_(store) {}
+
+  void add(const Slice& key, const std::shared_ptr<List>& list) {
+    entries_.emplace_back(key.makeCopy(&arena_), list);
+    // Keys are copied, because the originals are freed when a list is purged.
+  }
+
+  bool next() override {
+    iter_.reset();
+    while (index_ != entries_.size()) {
+      iter_ = entries_[index_++].second->newSnapshotIterator(*store_);
+      if (iter_->hasNext()) return true;
+    }
+    iter_.reset();
+    return false;
+  }
+
+  Slice key() const override {
+    MT_REQUIRE_NOT_NULL(iter_.get());
+    return entries_[index_ - 1].first;
+  }
+
+  Iterator* values() override {
+    MT_REQUIRE_NOT_NULL(iter_.get());
+    return iter_.get();
+  }
+
+ private:
+  const Store* store_;
+  std::vector<std::pair<Slice, std::shared_ptr<List> > > entries_;
+  std::unique_ptr<Iterator> iter_;
+  size_t index_ = 0;
+  Arena arena_;
+};
+
 fs::path getPathOfMapFile(const fs::path& prefix) {
   return prefix.string() + ".map";
 }
@@ -59,18 +111,38 @@ fs::path getPathOfStoreFile(const fs::path& prefix) {
 
 }  // namespace
 
-size_t Partition::Limits::maxKeySize() {
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::Limits::maxKeySize() {
   return std::numeric_limits<uint32_t>::max();
 }
 
-size_t Partition::Limits::maxValueSize() {
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::Limits::maxValueSize() {
   return List::Limits::maxValueSize();
 }
 
-Partition::Partition(const fs::path& prefix) : Partition(prefix, Options()) {}
-
-Partition::Partition(const fs::path& prefix, const Options& options)
-    : prefix_(prefix) {
+template <typename LockPolicy>
+BasicPartition<LockPolicy>::BasicPartition(const fs::path& prefix)
+    : BasicPartition(prefix, Options()) {}
+
+template <typename LockPolicy>
+BasicPartition<LockPolicy>::BasicPartition(const fs::path& prefix,
+                                           const Options& options)
+    : BasicPartition(prefix, options, -1) {}
+
+template <typename LockPolicy>
+BasicPartition<LockPolicy>::BasicPartition(const fs::path& prefix,
+                                           const Options& options,
+                                           int numa_node)
+    : arena_(getArenaBlockSize(options, numa_node), numa_node,
+             options.huge_pages),
+      // Lists that are only accessed by one thread are never locked by
+      // another one, so that there is nothing to combine.
+      combiner_(std::is_same<LockPolicy, NullLockPolicy>::value
+                    ? nullptr
+                    : new AppendCombiner()),
+      prefix_(prefix),
+      numa_node_(numa_node) {
   Options store_options;
   store_options.readonly = options.readonly;
   store_options.block_size = options.block_size;
@@ -87,19 +159,23 @@ Partition::Partition(const fs::path& prefix, const Options& options)
       List list = List::readFromStream(map_istream.get());
       stats_.num_values_total -= list.getStatsUnlocked().num_values_total;
       stats_.num_values_valid -= list.getStatsUnlocked().num_values_valid();
-      map_.emplace(new_key, std::unique_ptr<List>(new List(std::move(list))));
+      map_.emplace(new_key, std::make_shared<List>(std::move(list)));
     }
 
-    // Reset stats, but preserve number of total and valid values.
+    // Reset stats, but preserve number of total and valid values,
+    // and the counters that accumulate over the lifetime of the partition.
     Stats stats;
     stats.num_values_total = stats_.num_values_total;
     stats.num_values_valid = stats_.num_values_valid;
+    stats.num_bytes_reclaimed = stats_.num_bytes_reclaimed;
+    stats.num_values_combined = stats_.num_values_combined;
     stats_ = stats;
   }
   store_ = Store(getPathOfStoreFile(prefix), store_options);
 }
 
-Partition::~Partition() {
+template <typename LockPolicy>
+BasicPartition<LockPolicy>::~BasicPartition() {
   if (store_.isReadOnly()) return;
 
   const fs::path map_file_path = getPathOfMapFile(prefix_);
@@ -108,7 +184,7 @@ Partition::~Partition() {
     fs::rename(map_file_path, map_file_path_old);
   }
 
-  List::Stats list_stats;
+  typename List::Stats list_stats;
   mt::OutputStream map_ostream = mt::newFileOutputStream(map_file_path);
   for (const auto& entry : map_) {
     const Slice& key = entry.first;
@@ -148,7 +224,9 @@ Partition::~Partition() {
   }
   stats_.block_size = store_.getBlockSize();
   stats_.num_blocks = store_.getNumBlocks();
-  stats_.num_keys_total = map_.size();
+  // Empty lists are not written to disk, so they are gone after reopening.
+  stats_.num_keys_total = stats_.num_keys_valid;
+  stats_.num_values_combined += num_values_combined_;
 
   stats_.writeToFile(getPathOfStatsFile(prefix_));
 
@@ -158,128 +236,313 @@ Partition::~Partition() {
   }
 }
 
-void Partition::put(const Slice& key, const Slice& value) {
-  getListOrCreate(key)->append(value, &store_, &arena_);
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::put(const Slice& key, const Slice& value) {
+  if (getListOrCreate(key)->append(value, &store_, &arena_, combiner_.get())) {
+    ++num_values_combined_;
+  }
+}
+
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::write(
+    std::vector<WriteBatch::Operation> operations) {
+  mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
+  typedef WriteBatch::Operation Operation;
+  std::stable_sort(operations.begin(), operations.end(),
+                   [](const Operation& a, const Operation& b) {
+                     return a.key < b.key;
+                   });
+
+  // Each group is a range of operations on the same key.
+  std::vector<std::pair<size_t, size_t> > groups;
+  for (size_t i = 0; i != operations.size(); i = groups.back().second) {
+    size_t end = i + 1;
+    while (end != operations.size() &&
+           operations[end].key == operations[i].key) {
+      ++end;
+    }
+    MT_REQUIRE_LE(operations[i].key.size(), Limits::maxKeySize());
+    groups.emplace_back(i, end);
+  }
+
+  std::vector<std::shared_ptr<List> > lists(groups.size());
+  {
+    WriterLockGuard<Mutex> lock(mutex_);
+    retryPurgeCandidatesUnlocked();
+    for (size_t g = 0; g != groups.size(); ++g) {
+      const Slice& key = operations[groups[g].first].key;
+      auto iter = map_.find(key);
+      if (iter == map_.end()) {
+        const bool has_put = std::any_of(
+            operations.begin() + groups[g].first,
+            operations.begin() + groups[g].second,
+            [](const Operation& operation) { return !operation.is_remove; });
+        if (!has_put) continue;
+        const Slice new_key = key.makeCopy(&arena_);
+        iter = map_.emplace(new_key, std::make_shared<List>()).first;
+      }
+      lists[g] = iter->second;
+    }
+  }
+
+  std::vector<Slice> values;
+  std::vector<Slice> keys_to_purge;
+  for (size_t g = 0; g != groups.size(); ++g) {
+    if (!lists[g]) continue;
+    size_t i = groups[g].first;
+    while (i != groups[g].second) {
+      if (operations[i].is_remove) {
+        lists[g]->clear();
+        ++i;
+        continue;
+      }
+      values.clear();
+      while (i != groups[g].second && !operations[i].is_remove) {
+        values.push_back(operations[i].value);
+        ++i;
+      }
+      lists[g]->append(values.begin(), values.end(), &store_, &arena_);
+    }
+    if (operations[groups[g].second - 1].is_remove) {
+      keys_to_purge.push_back(operations[groups[g].first].key);
+    }
+  }
+  lists.clear();
+  tryPurge(keys_to_purge);
 }
 
-std::unique_ptr<Iterator> Partition::get(const Slice& key) const {
-  const List* list = getList(key);
+template <typename LockPolicy>
+std::unique_ptr<Iterator> BasicPartition<LockPolicy>::get(
+    const Slice& key) const {
+  const auto list = getList(key);
   return list ? list->newIterator(store_) : Iterator::newEmptyInstance();
 }
 
-size_t Partition::remove(const Slice& key) {
+template <typename LockPolicy>
+bool BasicPartition<LockPolicy>::contains(const Slice& key) const {
+  return count(key) != 0;
+}
+
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::count(const Slice& key) const {
+  const auto list = getList(key);
+  return list ? list->size() : 0;
+}
+
+template <typename LockPolicy>
+std::vector<std::unique_ptr<Iterator> > BasicPartition<LockPolicy>::getMany(
+    const std::vector<Slice>& keys) const {
+  std::vector<std::shared_ptr<List> > lists(keys.size());
+  {
+    ReaderLockGuard<Mutex> lock(mutex_);
+    for (size_t i = 0; i != keys.size(); ++i) {
+      const auto iter = map_.find(keys[i]);
+      if (iter != map_.end()) lists[i] = iter->second;
+    }
+  }
+  std::vector<std::unique_ptr<Iterator> > iters(keys.size());
+  for (size_t i = 0; i != keys.size(); ++i) {
+    iters[i] = lists[i] ? lists[i]->newSnapshotIterator(store_)
+                        : Iterator::newEmptyInstance();
+  }
+  return iters;
+}
+
+template <typename LockPolicy>
+std::vector<std::unique_ptr<Iterator> > BasicPartition<LockPolicy>::getChunks(
+    const Slice& key, size_t num_chunks) const {
+  const auto list = getList(key);
+  return list ? list->newChunkIterators(num_chunks, store_)
+              : std::vector<std::unique_ptr<Iterator> >();
+}
+
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::remove(const Slice& key) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
-  List* list = getList(key);
-  return list ? list->clear() : 0;
+  size_t num_values_removed = 0;
+  if (auto list = getList(key)) {
+    num_values_removed = list->clear();
+    list.reset();
+    tryPurge(key);
+  }
+  return num_values_removed;
 }
 
-bool Partition::removeFirstEqual(const Slice& key, const Slice& value) {
+template <typename LockPolicy>
+bool BasicPartition<LockPolicy>::removeFirstEqual(const Slice& key,
+                                                  const Slice& value) {
   return removeFirstMatch(key, SliceEqual(value));
 }
 
-size_t Partition::removeAllEqual(const Slice& key, const Slice& value) {
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::removeAllEqual(const Slice& key,
+                                                  const Slice& value) {
   return removeAllMatches(key, SliceEqual(value));
 }
 
-bool Partition::removeFirstMatch(const Slice& key, Predicate predicate) {
+template <typename LockPolicy>
+bool BasicPartition<LockPolicy>::removeFirstMatch(const Slice& key,
+                                                  Predicate predicate) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
-  List* list = getList(key);
-  return list ? list->removeFirstMatch(predicate, &store_) : false;
+  bool removed = false;
+  if (auto list = getList(key)) {
+    removed = list->removeFirstMatch(predicate, &store_);
+    const bool is_empty = list->empty();
+    list.reset();
+    if (removed && is_empty) tryPurge(key);
+  }
+  return removed;
 }
 
-size_t Partition::removeFirstMatch(Predicate predicate) {
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::removeFirstMatch(
+    Predicate predicate, std::atomic<bool>* claimed) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
-  ReaderLockGuard<boost::shared_mutex> lock(mutex_);
+  Bytes removed_key;
   size_t num_values_removed = 0;
-  for (const auto& entry : map_) {
-    if (predicate(entry.first)) {
-      num_values_removed = entry.second->clear();
-      if (num_values_removed != 0) break;
+  {
+    ReaderLockGuard<Mutex> lock(mutex_);
+    for (const auto& entry : map_) {
+      if (claimed && *claimed) break;
+      if (predicate(entry.first)) {
+        num_values_removed = entry.second->clear(claimed);
+        if (num_values_removed != 0) {
+          entry.first.copyTo(&removed_key);
+          break;
+        }
+      }
     }
   }
+  if (num_values_removed != 0) tryPurge(removed_key);
   return num_values_removed;
 }
 
-size_t Partition::removeAllMatches(const Slice& key, Predicate predicate) {
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::removeAllMatches(const Slice& key,
+                                                    Predicate predicate) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
-  List* list = getList(key);
-  return list ? list->removeAllMatches(predicate, &store_) : 0;
+  size_t num_values_removed = 0;
+  if (auto list = getList(key)) {
+    num_values_removed = list->removeAllMatches(predicate, &store_);
+    const bool is_empty = list->empty();
+    list.reset();
+    if (num_values_removed != 0 && is_empty) tryPurge(key);
+  }
+  return num_values_removed;
 }
 
-std::pair<size_t, size_t> Partition::removeAllMatches(Predicate predicate) {
+template <typename LockPolicy>
+std::pair<size_t, size_t> BasicPartition<LockPolicy>::removeAllMatches(
+    Predicate predicate, const std::atomic<bool>* cancelled) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
-  ReaderLockGuard<boost::shared_mutex> lock(mutex_);
-  size_t num_keys_removed = 0;
+  Arena removed_keys_arena;
+  std::vector<Slice> removed_keys;
   size_t num_values_removed = 0;
-  for (const auto& entry : map_) {
-    if (predicate(entry.first)) {
-      const size_t old_size = entry.second->clear();
-      if (old_size != 0) {
-        num_values_removed += old_size;
-        num_keys_removed++;
+  {
+    ReaderLockGuard<Mutex> lock(mutex_);
+    for (const auto& entry : map_) {
+      if (cancelled && *cancelled) break;
+      if (predicate(entry.first)) {
+        const size_t old_size = entry.second->clear();
+        if (old_size != 0) {
+          num_values_removed += old_size;
+          removed_keys.push_back(entry.first.makeCopy(&removed_keys_arena));
+        }
       }
     }
   }
-  return std::make_pair(num_keys_removed, num_values_removed);
+  for (const Slice& key : removed_keys) {
+    tryPurge(key);
+  }
+  return std::make_pair(removed_keys.size(), num_values_removed);
 }
 
-bool Partition::replaceFirstEqual(const Slice& key, const Slice& old_value,
-                                  const Slice& new_value) {
+template <typename LockPolicy>
+bool BasicPartition<LockPolicy>::replaceFirstEqual(const Slice& key,
+                                                   const Slice& old_value,
+                                                   const Slice& new_value) {
   return replaceFirstMatch(
       key, [&old_value, &new_value](const Slice& input, Bytes* output) {
         if (input == old_value) new_value.copyTo(output);
       });
 }
 
-size_t Partition::replaceAllEqual(const Slice& key, const Slice& old_value,
-                                  const Slice& new_value) {
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::replaceAllEqual(const Slice& key,
+                                                   const Slice& old_value,
+                                                   const Slice& new_value) {
   return replaceAllMatches(
       key, [&old_value, &new_value](const Slice& input, Bytes* output) {
         if (input == old_value) new_value.copyTo(output);
       });
 }
 
-bool Partition::replaceFirstMatch(const Slice& key, Function map) {
+template <typename LockPolicy>
+bool BasicPartition<LockPolicy>::replaceFirstMatch(const Slice& key,
+                                                   Function map) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
-  List* list = getList(key);
+  const auto list = getList(key);
   return list ? list->replaceFirstMatch(map, &store_, &arena_) : false;
 }
 
-size_t Partition::replaceAllMatches(const Slice& key, Function map) {
+template <typename LockPolicy>
+size_t BasicPartition<LockPolicy>::replaceAllMatches(const Slice& key,
+                                                     Function map) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
-  List* list = getList(key);
+  const auto list = getList(key);
   return list ? list->replaceAllMatches(map, &store_, &arena_) : 0;
 }
 
-void Partition::forEachKey(Procedure process) const {
-  ReaderLockGuard<boost::shared_mutex> lock(mutex_);
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::forEachKey(
+    Procedure process, const std::atomic<bool>* cancelled) const {
+  ReaderLockGuard<Mutex> lock(mutex_);
   for (const auto& entry : map_) {
+    if (cancelled && *cancelled) break;
     if (!entry.second->empty()) {
       process(entry.first);
     }
   }
 }
 
-void Partition::forEachValue(const Slice& key, Procedure process) const {
-  if (const List* list = getList(key)) {
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::forEachValue(const Slice& key,
+                                              Procedure process) const {
+  if (const auto list = getList(key)) {
     list->forEachValue(process, store_);
   }
 }
 
-void Partition::forEachEntry(BinaryProcedure process) const {
-  ReaderLockGuard<boost::shared_mutex> lock(mutex_);
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::forEachEntry(
+    BinaryProcedure process, const std::atomic<bool>* cancelled) const {
+  const auto cursor = newCursor([](const Slice&) { return true; });
+  while (!(cancelled && *cancelled) && cursor->next()) {
+    process(cursor->key(), cursor->values());
+  }
+}
+
+template <typename LockPolicy>
+std::unique_ptr<Cursor> BasicPartition<LockPolicy>::newCursor(
+    Predicate select) const {
+  std::unique_ptr<PartitionCursor<List> > cursor(
+      new PartitionCursor<List>(&store_));
+  ReaderLockGuard<Mutex> lock(mutex_);
   for (const auto& entry : map_) {
-    auto iter = entry.second->newIterator(store_);
-    if (iter->hasNext()) {
-      process(entry.first, iter.get());
+    if (select(entry.first)) {
+      cursor->add(entry.first, entry.second);
     }
   }
+  return cursor;
 }
 
-Stats Partition::getStats() const {
-  boost::shared_lock<boost::shared_mutex> lock(mutex_);
+template <typename LockPolicy>
+Stats BasicPartition<LockPolicy>::getStats() const {
+  ReaderLock<Mutex> lock(mutex_);
   Stats stats = stats_;
-  List::Stats list_stats;
+  typename List::Stats list_stats;
+  // Like on shutdown, keys with an empty list are not counted, as they are
+  // about to be purged. Keys whose list is locked are counted as total only.
   for (const auto& entry : map_) {
     if (entry.second->tryGetStats(&list_stats)) {
       stats.num_values_total += list_stats.num_values_total;
@@ -287,6 +550,7 @@ Stats Partition::getStats() const {
       const auto list_size = list_stats.num_values_valid();
       if (list_size != 0) {
         const auto& key = entry.first;
+        stats.num_keys_total++;
         stats.num_keys_valid++;
         stats.key_size_avg += key.size();
         stats.key_size_max = mt::max(stats.key_size_max, key.size());
@@ -299,6 +563,8 @@ Stats Partition::getStats() const {
                                   ? mt::min(stats.list_size_min, list_size)
                                   : list_size;
       }
+    } else {
+      stats.num_keys_total++;
     }
   }
   if (stats.num_keys_valid) {
@@ -307,11 +573,13 @@ Stats Partition::getStats() const {
   }
   stats.block_size = store_.getBlockSize();
   stats.num_blocks = store_.getNumBlocks();
-  stats.num_keys_total = map_.size();
+  stats.num_values_combined += num_values_combined_;
   return stats;
 }
 
-void Partition::forEachEntry(const fs::path& prefix, BinaryProcedure process) {
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::forEachEntry(const fs::path& prefix,
+                                              BinaryProcedure process) {
   const Stats stats = Stats::readFromFile(getPathOfStatsFile(prefix));
 
   Bytes key;
@@ -328,27 +596,94 @@ void Partition::forEachEntry(const fs::path& prefix, BinaryProcedure process) {
   }
 }
 
-Stats Partition::stats(const fs::path& prefix) {
+template <typename LockPolicy>
+Stats BasicPartition<LockPolicy>::stats(const fs::path& prefix) {
   return Stats::readFromFile(getPathOfStatsFile(prefix));
 }
 
-List* Partition::getList(const Slice& key) const {
-  ReaderLockGuard<boost::shared_mutex> lock(mutex_);
+template <typename LockPolicy>
+std::shared_ptr<typename BasicPartition<LockPolicy>::List>
+BasicPartition<LockPolicy>::getList(const Slice& key) const {
+  ReaderLockGuard<Mutex> lock(mutex_);
   const auto iter = map_.find(key);
-  return (iter != map_.end()) ? iter->second.get() : nullptr;
+  return (iter != map_.end()) ? iter->second : std::shared_ptr<List>();
 }
 
-List* Partition::getListOrCreate(const Slice& key) {
+template <typename LockPolicy>
+std::shared_ptr<typename BasicPartition<LockPolicy>::List>
+BasicPartition<LockPolicy>::getListOrCreate(const Slice& key) {
   mt::Check::isFalse(store_.isReadOnly(), READ_ONLY_VIOLATION);
   MT_REQUIRE_LE(key.size(), Limits::maxKeySize());
-  WriterLockGuard<boost::shared_mutex> lock(mutex_);
+  WriterLockGuard<Mutex> lock(mutex_);
   auto iter = map_.find(key);
   if (iter == map_.end()) {
+    retryPurgeCandidatesUnlocked();
     const Slice new_key = key.makeCopy(&arena_);
-    iter = map_.emplace(new_key, std::unique_ptr<List>(new List())).first;
+    iter = map_.emplace(new_key, std::make_shared<List>()).first;
+  }
+  return iter->second;
+}
+
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::tryPurge(const Slice& key) {
+  WriterLockGuard<Mutex> lock(mutex_);
+  retryPurgeCandidatesUnlocked();
+  tryPurgeUnlocked(key);
+}
+
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::tryPurge(const std::vector<Slice>& keys) {
+  if (keys.empty()) return;
+  WriterLockGuard<Mutex> lock(mutex_);
+  retryPurgeCandidatesUnlocked();
+  for (const Slice& key : keys) {
+    tryPurgeUnlocked(key);
+  }
+}
+
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::tryPurgeUnlocked(const Slice& key) {
+  const auto iter = map_.find(key);
+  if (iter == map_.end()) return;
+
+  // Lists are only handed out while holding the partition lock, hence no other
+  // thread can obtain a reference to the list from now on. A list that is
+  // still referenced or locked, e.g. by an iterator, is kept for now and
+  // retried later on.
+  typename List::Stats list_stats;
+  size_t num_bytes_released = 0;
+  if (iter->second.use_count() == 1 &&
+      iter->second->tryRelease(&arena_, &list_stats, &num_bytes_released)) {
+    const Slice old_key = iter->first;
+    purge_candidates_.erase(old_key);
+    map_.erase(iter);
+    arena_.deallocate(const_cast<byte*>(old_key.data()), old_key.size());
+    stats_.num_values_total += list_stats.num_values_total;
+    stats_.num_bytes_reclaimed += old_key.size() + num_bytes_released;
+  } else {
+    purge_candidates_.insert(iter->first);
   }
-  return iter->second.get();
 }
 
+template <typename LockPolicy>
+void BasicPartition<LockPolicy>::retryPurgeCandidatesUnlocked() {
+  if (purge_candidates_.empty()) return;
+  const std::vector<Slice> candidates(purge_candidates_.begin(),
+                                      purge_candidates_.end());
+  purge_candidates_.clear();
+  typename List::Stats list_stats;
+  for (const Slice& key : candidates) {
+    // Candidates whose list has been refilled in the meantime are dropped.
+    const auto& list = map_.at(key);
+    if (list->tryGetStats(&list_stats) && list_stats.num_values_valid() != 0) {
+      continue;
+    }
+    tryPurgeUnlocked(key);
+  }
+}
+
+template class BasicPartition<ConcurrentLockPolicy>;
+template class BasicPartition<NullLockPolicy>;
+
 }  // namespace internal
 }  // namespace multimap
@@ -18,17 +18,27 @@
 #ifndef MULTIMAP_INTERNAL_PARTITION_H_
 #define MULTIMAP_INTERNAL_PARTITION_H_
 
+#include <atomic>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 #include <boost/filesystem/path.hpp>  // NOLINT
 #include "multimap/internal/List.h"
+#include "multimap/Cursor.h"
 #include "multimap/Stats.h"
+#include "multimap/WriteBatch.h"
 
 namespace multimap {
 namespace internal {
 
-class Partition {
+template <typename LockPolicy>
+class BasicPartition {
  public:
+  typedef BasicList<LockPolicy> List;
+  typedef BasicStore<LockPolicy> Store;
+
   struct Limits {
     static size_t maxKeySize();
     static size_t maxValueSize();
@@ -36,11 +46,17 @@ class Partition {
     Limits() = delete;
   };
 
-  explicit Partition(const boost::filesystem::path& prefix);
+  explicit BasicPartition(const boost::filesystem::path& prefix);
+
+  BasicPartition(const boost::filesystem::path& prefix, const Options& options);
 
-  Partition(const boost::filesystem::path& prefix, const Options& options);
+  BasicPartition(const boost::filesystem::path& prefix, const Options& options,
+                 int numa_node);
+  // If `numa_node` is not negative, the memory for keys and write buffers is
+  // bound to the given NUMA node. If `Options::huge_pages` is set, this memory
+  // is allocated in chunks of the huge page size backed by huge pages.
 
-  ~Partition();
+  ~BasicPartition();
 
   void put(const Slice& key, const Slice& value);
 
@@ -49,8 +65,31 @@ class Partition {
     getListOrCreate(key)->append(begin, end, &store_, &arena_);
   }
 
+  void write(std::vector<WriteBatch::Operation> operations);
+  // Applies the operations in the given order per key. The operations are
+  // grouped by key, so that all lists are looked up or created under a single
+  // acquisition of the partition lock, and consecutive puts to the same key
+  // are appended under a single acquisition of the list lock.
+
   std::unique_ptr<Iterator> get(const Slice& key) const;
 
+  bool contains(const Slice& key) const;
+
+  size_t count(const Slice& key) const;
+
+  std::vector<std::unique_ptr<Iterator> > getMany(
+      const std::vector<Slice>& keys) const;
+  // Looks up all keys under a single acquisition of the partition lock and
+  // returns snapshot iterators in the same order, see
+  // List::newSnapshotIterator() for how they observe later removals. Creating
+  // the iterators up front issues read-ahead advice for all involved blocks
+  // in one pass.
+
+  std::vector<std::unique_ptr<Iterator> > getChunks(const Slice& key,
+                                                    size_t num_chunks) const;
+  // Returns iterators over consecutive chunks of the key's list, see
+  // List::newChunkIterators(), or an empty vector if there is no such key.
+
   size_t remove(const Slice& key);
 
   bool removeFirstEqual(const Slice& key, const Slice& value);
@@ -59,11 +98,16 @@ class Partition {
 
   bool removeFirstMatch(const Slice& key, Predicate predicate);
 
-  size_t removeFirstMatch(Predicate predicate);
+  size_t removeFirstMatch(Predicate predicate,
+                          std::atomic<bool>* claimed = nullptr);
+  // If `claimed` is given, it is used to coordinate a concurrent search in
+  // several partitions: a list is only cleared by the caller that flips the
+  // flag to true, and the search stops as soon as the flag is set.
 
   size_t removeAllMatches(const Slice& key, Predicate predicate);
 
-  std::pair<size_t, size_t> removeAllMatches(Predicate predicate);
+  std::pair<size_t, size_t> removeAllMatches(
+      Predicate predicate, const std::atomic<bool>* cancelled = nullptr);
 
   bool replaceFirstEqual(const Slice& key, const Slice& old_value,
                          const Slice& new_value);
@@ -75,11 +119,22 @@ class Partition {
 
   size_t replaceAllMatches(const Slice& key, Function map);
 
-  void forEachKey(Procedure process) const;
+  void forEachKey(Procedure process,
+                  const std::atomic<bool>* cancelled = nullptr) const;
 
   void forEachValue(const Slice& key, Procedure process) const;
 
-  void forEachEntry(BinaryProcedure process) const;
+  void forEachEntry(BinaryProcedure process,
+                    const std::atomic<bool>* cancelled = nullptr) const;
+  // forEachEntry() visits the keys present at the start of the scan via
+  // snapshots of their lists and does not block concurrent writers.
+
+  std::unique_ptr<Cursor> newCursor(Predicate select) const;
+  // Returns a cursor over all entries whose key satisfies `select`. The set of
+  // keys is determined on creation. Each list is captured via a snapshot when
+  // visited, so that neither the partition nor its lists are kept locked.
+
+  int getNumaNode() const { return numa_node_; }
 
   Stats getStats() const;
   // Returns various statistics about the partition.
@@ -91,18 +146,39 @@ class Partition {
   static Stats stats(const boost::filesystem::path& prefix);
 
  private:
-  List* getList(const Slice& key) const;
+  std::shared_ptr<List> getList(const Slice& key) const;
+
+  std::shared_ptr<List> getListOrCreate(const Slice& key);
+
+  void tryPurge(const Slice& key);
+  // Removes the key and its list from the partition, if the list is empty
+  // and not in use by any other thread. The memory of the key and of the
+  // list's write buffer is given back to the arena for reuse. A key whose
+  // list is still in use becomes a purge candidate and is retried by the
+  // next write that takes the partition lock exclusively.
+
+  void tryPurge(const std::vector<Slice>& keys);
 
-  List* getListOrCreate(const Slice& key);
+  void tryPurgeUnlocked(const Slice& key);
 
-  mutable boost::shared_mutex mutex_;
-  std::unordered_map<Slice, std::unique_ptr<List>> map_;
+  void retryPurgeCandidatesUnlocked();
+
+  typedef typename LockPolicy::ReaderWriterMutex Mutex;
+
+  mutable Mutex mutex_;
+  std::unordered_map<Slice, std::shared_ptr<List>> map_;
+  std::unordered_set<Slice> purge_candidates_;  // Keys owned by `map_`.
   Store store_;
   Arena arena_;
   Stats stats_;
+  std::atomic<uint64_t> num_values_combined_{0};
+  std::unique_ptr<AppendCombiner> combiner_;  // Null for NullLockPolicy.
   boost::filesystem::path prefix_;
+  int numa_node_ = -1;
 };
 
+typedef BasicPartition<DefaultLockPolicy> Partition;
+
 }  // namespace internal
 }  // namespace multimap
 
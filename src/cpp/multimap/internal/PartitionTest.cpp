@@ -29,6 +29,7 @@ namespace internal {
 
 using testing::Eq;
 using testing::ElementsAre;
+using testing::Gt;
 using testing::UnorderedElementsAre;
 
 std::unique_ptr<Partition> openPartition(const std::string& prefix,
@@ -476,7 +477,7 @@ TEST_F(PartitionTestFixture, GetStatsReturnsCorrectValues) {
   ASSERT_THAT(stats.list_size_max, Eq(4));
   ASSERT_THAT(stats.list_size_min, Eq(1));
   ASSERT_THAT(stats.num_blocks, Eq(0));
-  ASSERT_THAT(stats.num_keys_total, Eq(5));
+  ASSERT_THAT(stats.num_keys_total, Eq(4));
   ASSERT_THAT(stats.num_keys_valid, Eq(4));
   ASSERT_THAT(stats.num_values_total, Eq(15));
   ASSERT_THAT(stats.num_values_valid, Eq(10));
@@ -505,7 +506,7 @@ TEST_F(PartitionTestFixture, GetStatsReturnsCorrectValuesAfterRemovingKeys) {
     partition->removeFirstMatch([](const Slice& key) { return key == "kk"; });
 
     const Stats stats = partition->getStats();
-    ASSERT_THAT(stats.num_keys_total, Eq(5));
+    ASSERT_THAT(stats.num_keys_total, Eq(3));
     ASSERT_THAT(stats.num_keys_valid, Eq(3));
     ASSERT_THAT(stats.num_values_total, Eq(15));
     ASSERT_THAT(stats.num_values_valid, Eq(12));
@@ -542,7 +543,7 @@ TEST_F(PartitionTestFixture, GetStatsReturnsCorrectValuesAfterRemovingValues) {
     partition->removeAllEqual("kk", "vvvv");
 
     const Stats stats = partition->getStats();
-    ASSERT_THAT(stats.num_keys_total, Eq(5));
+    ASSERT_THAT(stats.num_keys_total, Eq(3));
     ASSERT_THAT(stats.num_keys_valid, Eq(3));
     ASSERT_THAT(stats.num_values_total, Eq(15));
     ASSERT_THAT(stats.num_values_valid, Eq(12));
@@ -556,6 +557,120 @@ TEST_F(PartitionTestFixture, GetStatsReturnsCorrectValuesAfterRemovingValues) {
   ASSERT_THAT(stats.num_values_valid, Eq(12));
 }
 
+TEST_F(PartitionTestFixture, RemovedKeysArePurgedAndTheirMemoryIsReclaimed) {
+  auto partition = openOrCreatePartition(prefix);
+  partition->put("k1", "v1");
+  partition->put("k2", "v2");
+  partition->put("k2", "v3");
+  ASSERT_THAT(partition->getStats().num_bytes_reclaimed, Eq(0));
+
+  ASSERT_THAT(partition->remove("k1"), Eq(1));
+  Stats stats = partition->getStats();
+  ASSERT_THAT(stats.num_keys_total, Eq(1));
+  ASSERT_THAT(stats.num_values_total, Eq(3));
+  ASSERT_THAT(stats.num_values_valid, Eq(2));
+  ASSERT_THAT(stats.num_bytes_reclaimed, Gt(2));
+
+  ASSERT_TRUE(partition->removeFirstEqual("k2", "v2"));
+  ASSERT_THAT(partition->getStats().num_keys_total, Eq(1));
+  ASSERT_TRUE(partition->removeFirstEqual("k2", "v3"));
+  stats = partition->getStats();
+  ASSERT_THAT(stats.num_keys_total, Eq(0));
+  ASSERT_THAT(stats.num_values_total, Eq(3));
+  ASSERT_THAT(stats.num_values_valid, Eq(0));
+
+  partition->put("k1", "v4");
+  ASSERT_THAT(partition->getStats().num_keys_total, Eq(1));
+  ASSERT_THAT(partition->get("k1")->next(), Eq("v4"));
+}
+
+TEST_F(PartitionTestFixture, KeysInUseWhenRemovedArePurgedByLaterWrites) {
+  auto partition = openOrCreatePartition(prefix);
+  partition->put("k1", "v1");
+  partition->put("k2", "v2");
+  auto cursor = partition->newCursor([](const Slice&) { return true; });
+  ASSERT_THAT(partition->remove("k1"), Eq(1));
+  Stats stats = partition->getStats();
+  ASSERT_THAT(stats.num_bytes_reclaimed, Eq(0));
+  ASSERT_THAT(stats.num_keys_total, Eq(1));  // Same as after reopening.
+  ASSERT_THAT(stats.num_keys_valid, Eq(1));
+
+  cursor.reset();
+  partition->put("k3", "v3");
+  ASSERT_THAT(partition->getStats().num_bytes_reclaimed, Gt(2));
+  ASSERT_FALSE(partition->contains("k1"));
+}
+
+TEST_F(PartitionTestFixture, WriteAppliesOperationsInOrderPerKey) {
+  auto partition = openOrCreatePartition(prefix);
+  partition->put("k1", "v1");
+  partition->put("k3", "v1");
+  WriteBatch batch;
+  batch.put("k2", "v1");
+  batch.remove("k1");
+  batch.put("k1", "v2");
+  batch.put("k2", "v2");
+  batch.remove("k3");
+  batch.remove("k4");
+  partition->write(batch.operations());
+
+  auto iter = partition->get("k1");
+  ASSERT_THAT(iter->available(), Eq(1));
+  ASSERT_THAT(iter->next(), Eq("v2"));
+  iter = partition->get("k2");
+  ASSERT_THAT(iter->available(), Eq(2));
+  ASSERT_THAT(iter->next(), Eq("v1"));
+  ASSERT_THAT(iter->next(), Eq("v2"));
+  iter.reset();
+  ASSERT_FALSE(partition->contains("k3"));
+  ASSERT_FALSE(partition->contains("k4"));
+  ASSERT_THAT(partition->getStats().num_keys_total, Eq(2));  // k3 is purged.
+}
+
+TEST_F(PartitionTestFixture, ForEachEntryDoesNotBlockWriters) {
+  auto partition = openOrCreatePartition(prefix);
+  partition->put("k1", "v1");
+  partition->put("k2", "v2");
+  size_t num_keys = 0;
+  partition->forEachEntry([&](const Slice& key, Iterator* iter) {
+    // Appending to the visited list and adding new keys does not deadlock.
+    partition->put(key, "v3");
+    partition->put("k" + std::to_string(10 + num_keys), "v4");
+    ASSERT_THAT(iter->available(), Eq(1));
+    ++num_keys;
+  });
+  ASSERT_THAT(num_keys, Eq(2));
+  ASSERT_THAT(partition->getStats().num_keys_valid, Eq(4));
+}
+
+TEST_F(PartitionTestFixture, ConcurrentPutsToHotKeyAreCountedAsCombined) {
+  const size_t num_threads = 4;
+  const size_t num_values_per_thread = 10000;
+  uint64_t num_values_combined = 0;
+  {
+    auto partition = openOrCreatePartition(prefix);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != num_threads; ++i) {
+      threads.emplace_back([&] {
+        for (size_t k = 0; k != num_values_per_thread; ++k) {
+          partition->put("key", "value");
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto stats = partition->getStats();
+    ASSERT_THAT(stats.num_values_total,
+                Eq(num_threads * num_values_per_thread));
+    ASSERT_LE(stats.num_values_combined, stats.num_values_total);
+    num_values_combined = stats.num_values_combined;
+  }
+  auto partition = openOrCreatePartition(prefix);
+  ASSERT_THAT(partition->getStats().num_values_combined,
+              Eq(num_values_combined));
+}
+
 TEST_F(PartitionTestFixture, PutThrowsIfOpenedAsReadOnly) {
   auto partition = openOrCreatePartitionAsReadOnly(prefix);
   ASSERT_THROW(partition->put(k1, v1), std::runtime_error);
@@ -30,12 +30,19 @@ namespace {
 
 const size_t SEGMENT_SIZE = mt::MiB(2);
 
+boost::filesystem::path getPathOfNextOffsetsFile(
+    const boost::filesystem::path& file_path) {
+  return file_path.string() + ".offsets";
+}
+
 }  // namespace
 
-Store::Store() : mutex_(new std::mutex()) {}
+const uint32_t StoreBase::NO_OFFSET = -1;
+const uint32_t StoreBase::OFFSET_INTERVAL = 16;
 
-Store::Store(const boost::filesystem::path& file_path, const Options& options)
-    : mutex_(new std::mutex()), options_(options) {
+StoreBase::StoreBase(const boost::filesystem::path& file_path,
+                     const Options& options)
+    : options_(options) {
   MT_REQUIRE_NOT_ZERO(options.block_size);
   if (boost::filesystem::is_regular_file(file_path)) {
     fd_ = mt::open(file_path, options.readonly ? O_RDONLY : O_RDWR);
@@ -66,17 +73,35 @@ Store::Store(const boost::filesystem::path& file_path, const Options& options)
   } else {
     fd_ = mt::open(file_path, O_RDWR | O_CREAT, 0644);
   }
+
+  // The offsets may not cover all blocks, e.g. if the store was written by an
+  // older version or was not closed properly. Missing offsets are unknown.
+  const size_t num_next_offsets =
+      (getNumBlocksUnlocked() + OFFSET_INTERVAL - 1) / OFFSET_INTERVAL;
+  next_offsets_file_path_ = getPathOfNextOffsetsFile(file_path);
+  if (boost::filesystem::is_regular_file(next_offsets_file_path_)) {
+    const mt::AutoCloseFile stream = mt::fopen(next_offsets_file_path_, "r");
+    const uint64_t file_size = boost::filesystem::file_size(
+        next_offsets_file_path_);
+    next_offsets_.resize(file_size / sizeof(uint32_t));
+    mt::freadAll(stream.get(), next_offsets_.data(),
+                 next_offsets_.size() * sizeof(uint32_t));
+    if (next_offsets_.size() > num_next_offsets) next_offsets_.clear();
+  }
+  next_offsets_.resize(num_next_offsets, NO_OFFSET);
 }
 
-Store::~Store() {
+StoreBase::~StoreBase() {
   if (fd_ && !options_.readonly) {
     const uint64_t file_size = getNumBlocksUnlocked() * options_.block_size;
     mt::ftruncate(fd_.get(), file_size);
+    const mt::AutoCloseFile stream = mt::fopen(next_offsets_file_path_, "w");
+    mt::fwriteAll(stream.get(), next_offsets_.data(),
+                  next_offsets_.size() * sizeof(uint32_t));
   }
 }
 
-uint32_t Store::put(const Block& block) {
-  std::lock_guard<std::mutex> lock(*mutex_);
+uint32_t StoreBase::putUnlocked(const Block& block, uint32_t next_offset) {
   if (segments_.empty() || segments_.back().isFull()) {
     const uint64_t old_file_size = segments_.size() * SEGMENT_SIZE;
     const uint64_t new_file_size = old_file_size + SEGMENT_SIZE;
@@ -85,14 +110,31 @@ uint32_t Store::put(const Block& block) {
                                     MAP_SHARED, fd_.get(), old_file_size));
   }
   segments_.back().append(block);
-  return getNumBlocksUnlocked() - 1;
+  const uint32_t block_id = getNumBlocksUnlocked() - 1;
+  if (block_id % OFFSET_INTERVAL == 0) {
+    next_offsets_.push_back(next_offset);
+  }
+  return block_id;
+}
+
+uint32_t StoreBase::getNextOffsetUnlocked(uint32_t block_id) const {
+  if (block_id % OFFSET_INTERVAL != 0) return NO_OFFSET;
+  MT_ASSERT_LT(block_id / OFFSET_INTERVAL, next_offsets_.size());
+  return next_offsets_[block_id / OFFSET_INTERVAL];
+}
+
+StoreBase::Block StoreBase::getUnlocked(uint32_t block_id) const {
+  const size_t blocks_per_segment = SEGMENT_SIZE / options_.block_size;
+  const size_t seg_id = block_id / blocks_per_segment;
+  const size_t seg_block_id = block_id % blocks_per_segment;
+  MT_ASSERT_LT(seg_id, segments_.size());
+  return segments_[seg_id].get(seg_block_id, options_.block_size);
 }
 
-Store::Blocks Store::get(const BlockIds& block_ids) const {
+StoreBase::Blocks StoreBase::getUnlocked(const BlockIds& block_ids) const {
   Blocks blocks;
   blocks.reserve(block_ids.size());
   const size_t blocks_per_segment = SEGMENT_SIZE / options_.block_size;
-  std::lock_guard<std::mutex> lock(*mutex_);
   for (uint32_t block_id : block_ids) {
     const size_t seg_id = block_id / blocks_per_segment;
     const size_t seg_block_id = block_id % blocks_per_segment;
@@ -102,7 +144,7 @@ Store::Blocks Store::get(const BlockIds& block_ids) const {
   return blocks;
 }
 
-size_t Store::getNumBlocksUnlocked() const {
+size_t StoreBase::getNumBlocksUnlocked() const {
   const size_t num_segments = segments_.size();
   const size_t blocks_per_segment = SEGMENT_SIZE / options_.block_size;
   return (num_segments != 0)
@@ -111,21 +153,22 @@ size_t Store::getNumBlocksUnlocked() const {
              : 0;
 }
 
-Store::Segment::Segment(mt::AutoUnmapMemory memory)
+StoreBase::Segment::Segment(mt::AutoUnmapMemory memory)
     : memory_(std::move(memory)) {}
 
-Store::Segment::Segment(mt::AutoUnmapMemory memory, size_t offset)
+StoreBase::Segment::Segment(mt::AutoUnmapMemory memory, size_t offset)
     : memory_(std::move(memory)), offset_(offset) {
   MT_REQUIRE_LE(offset_, memory_.size())
 }
 
-void Store::Segment::append(const Block& block) {
+void StoreBase::Segment::append(const Block& block) {
   MT_REQUIRE_FALSE(isFull());
   std::memcpy(memory_.data() + offset_, block.data, block.size);
   offset_ += block.size;
 }
 
-Store::Block Store::Segment::get(uint32_t block_id, size_t block_size) const {
+StoreBase::Block StoreBase::Segment::get(uint32_t block_id,
+                                         size_t block_size) const {
   MT_REQUIRE_LT(block_id, getNumBlocks(block_size));
   Block block;
   block.data = memory_.data() + block_id * block_size;
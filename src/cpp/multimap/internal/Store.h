@@ -18,9 +18,11 @@
 #ifndef MULTIMAP_INTERNAL_STORE_H_
 #define MULTIMAP_INTERNAL_STORE_H_
 
+#include <memory>
 #include <mutex>  // NOLINT
 #include <vector>
 #include <boost/filesystem/path.hpp>  // NOLINT
+#include "multimap/internal/LockPolicy.h"
 #include "multimap/thirdparty/mt/fileio.h"
 #include "multimap/thirdparty/mt/memory.h"
 #include "multimap/Bytes.h"
@@ -29,9 +31,10 @@
 namespace multimap {
 namespace internal {
 
-class List;
+class StoreBase {
+  // Contains the state and the unsynchronized operations of a store.
+  // BasicStore adds the locking according to its lock policy.
 
-class Store {
  public:
   struct Block {
     byte* data = nullptr;
@@ -60,31 +63,38 @@ class Store {
   typedef std::vector<uint32_t> BlockIds;
   typedef std::vector<Block> Blocks;
 
-  Store();
+  static const uint32_t NO_OFFSET;
+  static const uint32_t OFFSET_INTERVAL;
+  // For every OFFSET_INTERVAL-th block the store records the offset at which
+  // the first value begins in the block that follows it in its list. These
+  // offsets allow to start reading a list in the middle. They are kept in a
+  // separate file next to the data file, which is optional when reading.
 
-  Store(Store&&) = default;
-  Store& operator=(Store&&) = default;
+  size_t getBlockSize() const { return options_.block_size; }
 
-  Store(const boost::filesystem::path& file, const Options& options);
+  bool isReadOnly() const { return options_.readonly; }
 
-  ~Store();
+ protected:
+  StoreBase() = default;
 
-  uint32_t put(const Block& block);
+  StoreBase(StoreBase&&) = default;
+  StoreBase& operator=(StoreBase&&) = default;
 
-  Blocks get(const BlockIds& block_ids) const;
+  StoreBase(const boost::filesystem::path& file, const Options& options);
 
-  size_t getNumBlocks() const {
-    std::lock_guard<std::mutex> lock(*mutex_);
-    return getNumBlocksUnlocked();
-  }
+  ~StoreBase();
 
-  size_t getBlockSize() const { return options_.block_size; }
+  uint32_t putUnlocked(const Block& block, uint32_t next_offset);
 
-  bool isReadOnly() const { return options_.readonly; }
+  uint32_t getNextOffsetUnlocked(uint32_t block_id) const;
+
+  Block getUnlocked(uint32_t block_id) const;
+
+  Blocks getUnlocked(const BlockIds& block_ids) const;
 
- private:
   size_t getNumBlocksUnlocked() const;
 
+ private:
   class Segment {
    public:
     explicit Segment(mt::AutoUnmapMemory memory);
@@ -106,12 +116,61 @@ class Store {
     size_t offset_ = 0;
   };
 
-  std::unique_ptr<std::mutex> mutex_;
   std::vector<Segment> segments_;
+  std::vector<uint32_t> next_offsets_;
+  boost::filesystem::path next_offsets_file_path_;
   mt::AutoCloseFd fd_;
   Options options_;
 };
 
+template <typename LockPolicy>
+class BasicStore : public StoreBase {
+ public:
+  BasicStore() : mutex_(new Mutex()) {}
+
+  BasicStore(BasicStore&&) = default;
+  BasicStore& operator=(BasicStore&&) = default;
+
+  BasicStore(const boost::filesystem::path& file, const Options& options)
+      : StoreBase(file, options), mutex_(new Mutex()) {}
+
+  uint32_t put(const Block& block, uint32_t next_offset = NO_OFFSET) {
+    std::lock_guard<Mutex> lock(*mutex_);
+    return putUnlocked(block, next_offset);
+  }
+  // `next_offset` is the offset of the first value in the block that follows
+  // `block` in its list, or NO_OFFSET if no value begins in that block.
+
+  uint32_t getNextOffset(uint32_t block_id) const {
+    std::lock_guard<Mutex> lock(*mutex_);
+    return getNextOffsetUnlocked(block_id);
+  }
+  // Returns the offset passed to put() for `block_id`, or NO_OFFSET if it
+  // was not recorded.
+
+  Block get(uint32_t block_id) const {
+    std::lock_guard<Mutex> lock(*mutex_);
+    return getUnlocked(block_id);
+  }
+
+  Blocks get(const BlockIds& block_ids) const {
+    std::lock_guard<Mutex> lock(*mutex_);
+    return getUnlocked(block_ids);
+  }
+
+  size_t getNumBlocks() const {
+    std::lock_guard<Mutex> lock(*mutex_);
+    return getNumBlocksUnlocked();
+  }
+
+ private:
+  typedef typename LockPolicy::Mutex Mutex;
+
+  std::unique_ptr<Mutex> mutex_;
+};
+
+typedef BasicStore<DefaultLockPolicy> Store;
+
 }  // namespace internal
 }  // namespace multimap
 
@@ -16,6 +16,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <type_traits>
+#include <boost/filesystem/operations.hpp>  // NOLINT
 #include "gmock/gmock.h"
 #include "multimap/internal/Store.h"
 
@@ -36,5 +37,36 @@ TEST(StoreTest, IsMoveConstructibleAndAssignable) {
   ASSERT_TRUE(std::is_move_assignable<Store>::value);
 }
 
+TEST(StoreTest, NextOffsetsAreRecordedPerIntervalAndPersisted) {
+  const boost::filesystem::path directory = "/tmp/multimap.StoreTest";
+  boost::filesystem::remove_all(directory);
+  ASSERT_TRUE(boost::filesystem::create_directory(directory));
+  const auto check_offsets = [](const Store& store, uint32_t num_blocks) {
+    for (uint32_t i = 0; i != num_blocks; ++i) {
+      const uint32_t expected =
+          (i % Store::OFFSET_INTERVAL == 0) ? i : Store::NO_OFFSET;
+      ASSERT_EQ(expected, store.getNextOffset(i));
+    }
+  };
+  const uint32_t num_blocks = Store::OFFSET_INTERVAL * 2 + 1;
+  {
+    Store store(directory / "store", Options());
+    Bytes data(store.getBlockSize());
+    Store::Block block;
+    block.data = data.data();
+    block.size = data.size();
+    for (uint32_t i = 0; i != num_blocks; ++i) {
+      ASSERT_EQ(i, store.put(block, i));
+    }
+    check_offsets(store, num_blocks);
+  }
+  {
+    Store store(directory / "store", Options());
+    ASSERT_EQ(num_blocks, store.getNumBlocks());
+    check_offsets(store, num_blocks);
+  }
+  boost::filesystem::remove_all(directory);
+}
+
 }  // namespace internal
 }  // namespace multimap
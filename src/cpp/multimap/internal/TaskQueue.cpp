@@ -0,0 +1,65 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "multimap/internal/TaskQueue.h"
+
+#include <utility>
+#include "multimap/thirdparty/mt/assert.h"
+
+namespace multimap {
+namespace internal {
+
+TaskQueue::~TaskQueue() { wait(); }
+
+void TaskQueue::push(std::function<void()> task, ThreadPool* pool) {
+  MT_REQUIRE_TRUE(task);
+  MT_REQUIRE_NOT_NULL(pool);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+    if (scheduled_) return;
+    scheduled_ = true;
+  }
+  pool->submit([this] { drain(); });
+}
+
+void TaskQueue::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this] { return !scheduled_; });
+}
+
+void TaskQueue::drain() {
+  std::deque<std::function<void()> > batch;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (tasks_.empty()) {
+        scheduled_ = false;
+        cond_.notify_all();
+        return;
+      }
+      batch.swap(tasks_);
+    }
+    for (auto& task : batch) {
+      task();
+    }
+    batch.clear();
+  }
+}
+
+}  // namespace internal
+}  // namespace multimap
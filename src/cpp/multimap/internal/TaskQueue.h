@@ -0,0 +1,63 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MULTIMAP_INTERNAL_TASKQUEUE_H_
+#define MULTIMAP_INTERNAL_TASKQUEUE_H_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <mutex>  // NOLINT
+#include "multimap/ThreadPool.h"
+
+namespace multimap {
+namespace internal {
+
+class TaskQueue {
+  // Executes tasks on a thread pool one after another in FIFO order.
+  // Tasks that are pushed while the queue is being drained are executed by
+  // the same pool task, so that a burst of tasks is processed as one batch.
+
+ public:
+  TaskQueue() = default;
+
+  TaskQueue(const TaskQueue&) = delete;
+  TaskQueue& operator=(const TaskQueue&) = delete;
+
+  ~TaskQueue();
+  // Waits until all pushed tasks have been executed.
+
+  void push(std::function<void()> task, ThreadPool* pool);
+  // Appends `task` to the queue and schedules a drain on `pool` if no drain
+  // is pending. The task must not throw.
+
+  void wait();
+  // Blocks until all pushed tasks have been executed.
+
+ private:
+  void drain();
+
+  std::deque<std::function<void()> > tasks_;
+  std::condition_variable cond_;
+  std::mutex mutex_;
+  bool scheduled_ = false;
+};
+
+}  // namespace internal
+}  // namespace multimap
+
+#endif  // MULTIMAP_INTERNAL_TASKQUEUE_H_
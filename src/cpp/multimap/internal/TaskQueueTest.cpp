@@ -0,0 +1,61 @@
+// This file is part of Multimap.  http://multimap.io
+//
+// Copyright (C) 2015-2016  Martin Trenkmann
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <type_traits>
+#include <vector>
+#include "gmock/gmock.h"
+#include "multimap/internal/TaskQueue.h"
+
+namespace multimap {
+namespace internal {
+
+using testing::ElementsAreArray;
+using testing::Eq;
+
+TEST(TaskQueueTest, IsNotCopyConstructibleOrAssignable) {
+  ASSERT_FALSE(std::is_copy_constructible<TaskQueue>::value);
+  ASSERT_FALSE(std::is_copy_assignable<TaskQueue>::value);
+}
+
+TEST(TaskQueueTest, ExecutesTasksInFifoOrder) {
+  ThreadPool pool(4);
+  TaskQueue queue;
+  std::vector<int> actual;  // Accessed by one task at a time.
+  std::vector<int> expected;
+  for (int i = 0; i != 1000; ++i) {
+    queue.push([&actual, i] { actual.push_back(i); }, &pool);
+    expected.push_back(i);
+  }
+  queue.wait();
+  ASSERT_THAT(actual, ElementsAreArray(expected));
+}
+
+TEST(TaskQueueTest, DestructorWaitsForPushedTasks) {
+  ThreadPool pool(2);
+  std::atomic<int> counter(0);
+  {
+    TaskQueue queue;
+    for (int i = 0; i != 100; ++i) {
+      queue.push([&counter] { ++counter; }, &pool);
+    }
+  }
+  ASSERT_THAT(counter.load(), Eq(100));
+}
+
+}  // namespace internal
+}  // namespace multimap
@@ -43,6 +43,14 @@ void writeFixedInt32ToBuffer(byte* begin, byte* end, uint32_t value) {
 
 }  // namespace
 
+uint32_t UintVector::Reader::next() {
+  MT_REQUIRE_TRUE(hasNext());
+  uint32_t delta = 0;
+  pos_ += mt::readVarint32FromBuffer(pos_, &delta);
+  value_ += delta;
+  return value_;
+}
+
 void UintVector::add(uint32_t value) {
   allocateMoreIfFull();
   if (empty()) {
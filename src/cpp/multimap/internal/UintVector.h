@@ -28,6 +28,24 @@ namespace internal {
 
 class UintVector {
  public:
+  class Reader {
+    // Decodes the values of a vector one by one without allocating memory.
+    // The vector must not be modified while being read.
+
+   public:
+    explicit Reader(const UintVector& vector)
+        : pos_(vector.begin()), end_(vector.current()) {}
+
+    bool hasNext() const { return pos_ != end_; }
+
+    uint32_t next();
+
+   private:
+    const byte* pos_;
+    const byte* end_;
+    uint32_t value_ = 0;
+  };
+
   void add(uint32_t value);
 
   std::vector<uint32_t> unpack() const;
@@ -59,6 +59,21 @@ TEST(UintVector, AddIncreasingValuesAndUnpack) {
   ASSERT_THAT(vector.unpack(), ElementsAreArray(values));
 }
 
+TEST(UintVector, ReaderYieldsAddedValues) {
+  const uint32_t values[] = {0, 1, 10, 1000, 10000000, 100000000};
+  UintVector vector;
+  ASSERT_FALSE(UintVector::Reader(vector).hasNext());
+  for (uint32_t value : values) {
+    vector.add(value);
+  }
+  UintVector::Reader reader(vector);
+  for (uint32_t value : values) {
+    ASSERT_TRUE(reader.hasNext());
+    ASSERT_EQ(value, reader.next());
+  }
+  ASSERT_FALSE(reader.hasNext());
+}
+
 TEST(UintVector, AddDecreasingValuesAndThrow) {
   UintVector vector;
   const uint32_t values[] = {100000000, 10000000};
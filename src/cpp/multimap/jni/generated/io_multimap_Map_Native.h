@@ -23,6 +23,14 @@ JNIEXPORT jobject JNICALL Java_io_multimap_Map_00024Native_newMap
 JNIEXPORT void JNICALL Java_io_multimap_Map_00024Native_put
   (JNIEnv *, jclass, jobject, jbyteArray, jbyteArray);
 
+/*
+ * Class:     io_multimap_Map_Native
+ * Method:    write
+ * Signature: (Ljava/nio/ByteBuffer;[[B[[B)V
+ */
+JNIEXPORT void JNICALL Java_io_multimap_Map_00024Native_write
+  (JNIEnv *, jclass, jobject, jobjectArray, jobjectArray);
+
 /*
  * Class:     io_multimap_Map_Native
  * Method:    get
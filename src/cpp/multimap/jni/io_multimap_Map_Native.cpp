@@ -83,6 +83,41 @@ Java_io_multimap_Map_00024Native_put(JNIEnv* env, jclass, jobject self,
   }
 }
 
+/*
+ * Class:     io_multimap_Map_Native
+ * Method:    write
+ * Signature: (Ljava/nio/ByteBuffer;[[B[[B)V
+ */
+JNIEXPORT void JNICALL
+Java_io_multimap_Map_00024Native_write(JNIEnv* env, jclass, jobject self,
+                                       jobjectArray jkeys,
+                                       jobjectArray jvalues) {
+  multimap::WriteBatch batch;
+  const jsize size = env->GetArrayLength(jkeys);
+  for (jsize i = 0; i != size; ++i) {
+    // The batch copies keys and values, hence the local references to the
+    // array elements can be dropped right away.
+    const auto jkey = env->GetObjectArrayElement(jkeys, i);
+    const auto jvalue = env->GetObjectArrayElement(jvalues, i);
+    {
+      multimap::jni::JByteArrayRaiiHelper key(env, jkey);
+      if (jvalue == nullptr) {
+        batch.remove(key.get());
+      } else {
+        multimap::jni::JByteArrayRaiiHelper value(env, jvalue);
+        batch.put(key.get(), value.get());
+      }
+    }
+    env->DeleteLocalRef(jkey);
+    if (jvalue != nullptr) env->DeleteLocalRef(jvalue);
+  }
+  try {
+    getMapPtrFromByteBuffer(env, self)->write(batch);
+  } catch (std::exception& error) {
+    multimap::jni::throwJavaException(env, error.what());
+  }
+}
+
 /*
  * Class:     io_multimap_Map_Native
  * Method:    get
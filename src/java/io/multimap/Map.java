@@ -375,6 +375,38 @@ public class Map implements AutoCloseable {
       return numPartitions;
     }
 
+    /**
+     * Returns the number of bytes of keys and write buffers that have been given back for reuse
+     * after their lists became empty. The value accumulates over the lifetime of a map.
+     */
+    public long getNumBytesReclaimed() {
+      return numBytesReclaimed;
+    }
+
+    /**
+     * Returns the number of values that have been appended by another thread on behalf of a writer
+     * that found the key's list locked. The value accumulates over the lifetime of a map.
+     */
+    public long getNumValuesCombined() {
+      return numValuesCombined;
+    }
+
+    /**
+     * Returns the time in milliseconds it took to build an immutable map or partition. For
+     * mutable maps the value is 0.
+     */
+    public long getBuildTimeMs() {
+      return buildTimeMs;
+    }
+
+    /**
+     * Returns the peak memory usage in number of bytes while building an immutable partition, or
+     * the largest such value of all partitions of a map. For mutable maps the value is 0.
+     */
+    public long getBuildMemoryMax() {
+      return buildMemoryMax;
+    }
+
     @Override
     public String toString() {
       return String.format("block_size        %d\n"
@@ -389,9 +421,14 @@ public class Map implements AutoCloseable {
               + "num_keys_valid    %d\n"
               + "num_values_total  %d\n"
               + "num_values_valid  %d\n"
-              + "num_partitions    %d\n",
+              + "num_partitions    %d\n"
+              + "num_bytes_reclaimed %d\n"
+              + "num_values_combined %d\n"
+              + "build_time_ms     %d\n"
+              + "build_memory_max  %d\n",
           blockSize, keySizeAvg, keySizeMax, keySizeMin, listSizeAvg, listSizeMax, listSizeMin,
-          numBlocks, numKeysTotal, numKeysValid, numValuesTotal, numValuesValid, numPartitions);
+          numBlocks, numKeysTotal, numKeysValid, numValuesTotal, numValuesValid, numPartitions,
+          numBytesReclaimed, numValuesCombined, buildTimeMs, buildMemoryMax);
     }
 
     protected void parseFromBuffer(ByteBuffer buffer) {
@@ -409,9 +446,13 @@ public class Map implements AutoCloseable {
       numValuesTotal = buffer.getLong();
       numValuesValid = buffer.getLong();
       numPartitions = buffer.getLong();
+      numBytesReclaimed = buffer.getLong();
+      numValuesCombined = buffer.getLong();
+      buildTimeMs = buffer.getLong();
+      buildMemoryMax = buffer.getLong();
     }
 
-    // Needs to be synchronized with struct Table::Stats in C++.
+    // Needs to be synchronized with struct Stats in C++.
     private long blockSize;
     private long keySizeAvg;
     private long keySizeMax;
@@ -425,6 +466,10 @@ public class Map implements AutoCloseable {
     private long numValuesTotal;
     private long numValuesValid;
     private long numPartitions;
+    private long numBytesReclaimed;
+    private long numValuesCombined;
+    private long buildTimeMs;
+    private long buildMemoryMax;
   }
 
   private ByteBuffer self;
@@ -529,6 +574,29 @@ public class Map implements AutoCloseable {
     Native.put(self, Utils.toByteArray(key), value);
   }
 
+  /**
+   * Applies all operations of {@code batch}. The operations are grouped by partition and key, so
+   * that each partition is locked only once. Operations on the same key are applied in the order
+   * they were added to the batch.
+   *
+   * <p><b>Acquires:</b></p>
+   * <ul>
+   * <li>a writer lock on each partition involved.</li>
+   * <li>a writer lock on each list involved.</li>
+   * </ul>
+   *
+   * @throws Exception if one of the following is true:
+   * <ul>
+   * <li>a key or value exceeds its maximum size</li>
+   * <li>the map was opened in read-only mode</li>
+   * </ul>
+   * @since 0.6.0
+   */
+  public void write(WriteBatch batch) throws Exception {
+    Check.notNull(batch);
+    Native.write(self, batch.getKeys(), batch.getValues());
+  }
+
   /**
    * Returns a read-only iterator for the list associated with the specified key. If the key does
    * not exist, an empty iterator that has no values is returned. A non-empty iterator owns a reader
@@ -1111,6 +1179,7 @@ public class Map implements AutoCloseable {
   private static class Native {
     static native ByteBuffer newMap(String directory, Options options) throws Exception;
     static native void put(ByteBuffer self, byte[] key, byte[] value) throws Exception;
+    static native void write(ByteBuffer self, byte[][] keys, byte[][] values) throws Exception;
     static native ByteBuffer get(ByteBuffer self, byte[] key);
     static native boolean contains(ByteBuffer self, byte[] key);
     static native int remove(ByteBuffer self, byte[] key);
@@ -211,6 +211,31 @@ public class MapTest {
     map.close();
   }
 
+  @Test
+  public void testWrite() throws Exception {
+    int numKeys = 1000;
+    int numValuesPerKeys = 10;
+    Map map = createAndFillMap(DIRECTORY, numKeys, numValuesPerKeys);
+    WriteBatch batch = new WriteBatch();
+    for (int i = 0; i < numKeys; ++i) {
+      if (i % 2 == 0) {
+        batch.remove(makeKey(i));
+      }
+      batch.put(makeKey(i), makeValue(numValuesPerKeys));
+    }
+    map.write(batch);
+    for (int i = 0; i < numKeys; ++i) {
+      Iterator iter = map.get(makeKey(i));
+      if (i % 2 == 0) {
+        Assert.assertEquals(1, iter.available());
+      } else {
+        Assert.assertEquals(numValuesPerKeys + 1, iter.available());
+      }
+      iter.close();
+    }
+    map.close();
+  }
+
   @Test
   public void testRemove() throws Exception {
     int numKeys = 1000;
@@ -598,6 +623,10 @@ public class MapTest {
     Assert.assertEquals(1000 * 1000, stats.getNumValuesTotal());
     Assert.assertEquals(1000 * 1000, stats.getNumValuesValid());
     Assert.assertEquals(Options.DEFAULT.getNumPartitions(), stats.getNumPartitions());
+    Assert.assertEquals(0, stats.getNumBytesReclaimed());
+    Assert.assertTrue(stats.getNumValuesCombined() <= stats.getNumValuesTotal());
+    Assert.assertEquals(0, stats.getBuildTimeMs());
+    Assert.assertEquals(0, stats.getBuildMemoryMax());
     map.close();
   }
 
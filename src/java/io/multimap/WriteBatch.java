@@ -0,0 +1,101 @@
+/*
+ * This file is part of Multimap.  http://multimap.io
+ *
+ * Copyright (C) 2015-2016  Martin Trenkmann
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+package io.multimap;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Collects puts and removes for many keys which are then applied to a map at once via
+ * {@link Map#write(WriteBatch)}. Applying a batch locks each partition of the map only once,
+ * which is considerably faster than calling {@link Map#put(byte[], byte[])} for each pair.
+ *
+ * <br>
+ * For more information please visit the
+ * <a href="http://multimap.io/cppreference/#writebatchhpp">C++ Reference for class WriteBatch</a>.
+ *
+ * @since 0.6.0
+ */
+public class WriteBatch {
+
+  private final List<byte[]> keys = new ArrayList<>();
+  private final List<byte[]> values = new ArrayList<>();
+
+  /**
+   * Appends {@code value} to the list associated with {@code key} when the batch is written.
+   */
+  public void put(byte[] key, byte[] value) {
+    Check.notNull(key);
+    Check.notNull(value);
+    keys.add(key);
+    values.add(value);
+  }
+
+  /**
+   * Same as before, but taking {@code key} as string instead of byte array. Internally the key is
+   * converted into a byte array via {@link Utils#toByteArray(String)}.
+   */
+  public void put(String key, byte[] value) {
+    put(Utils.toByteArray(key), value);
+  }
+
+  /**
+   * Removes all values associated with {@code key} when the batch is written, including those
+   * that were put by earlier operations of the same batch.
+   */
+  public void remove(byte[] key) {
+    Check.notNull(key);
+    keys.add(key);
+    values.add(null);
+  }
+
+  /**
+   * Same as before, but taking {@code key} as string instead of byte array. Internally the key is
+   * converted into a byte array via {@link Utils#toByteArray(String)}.
+   */
+  public void remove(String key) {
+    remove(Utils.toByteArray(key));
+  }
+
+  /**
+   * Returns the number of operations in this batch.
+   */
+  public int size() {
+    return keys.size();
+  }
+
+  /**
+   * Removes all operations, so that the batch can be reused.
+   */
+  public void clear() {
+    keys.clear();
+    values.clear();
+  }
+
+  byte[][] getKeys() {
+    return keys.toArray(new byte[keys.size()][]);
+  }
+
+  byte[][] getValues() {
+    // A null element denotes a remove operation.
+    return values.toArray(new byte[values.size()][]);
+  }
+}